@@ -0,0 +1,173 @@
+#ifndef CASCADED_SHADOWS
+#define CASCADED_SHADOWS
+
+#include "glad/glad.h"
+#include "glm/glm.hpp"
+#include "glm/gtc/matrix_transform.hpp"
+#include "shader_manager.h"
+
+#include <cmath>
+
+//cascaded shadow maps for the sun. the camera frustum up to shadow_distance is split into CASCADES slices, each one
+//fit with a bounding sphere, so a cascade's size never changes as the camera turns, and its origin is snapped to
+//whole shadow map texels, so edges do not shimmer as the camera moves. cascades are layers of one depth texture
+//array rendered with a position only program (src/shadow_depth.vert); src/shadows.glsl selects and filters them.
+//the far cascades only hold static geometry. they are fit with a margin and kept until the camera leaves it, the
+//sun moves or the static geometry changes, so most frames only redraw the near cascades.
+namespace shadows
+{
+    constexpr int CASCADES = 4;                 //SHADOW_CASCADES in shadows.glsl
+    constexpr int FIRST_CACHED_CASCADE = 2;
+    constexpr float CACHE_MARGIN = 1.5f;        //cached cascades cover this many times their slice's radius
+    constexpr int SHADOW_MAP_UNIT = 13;         //binding of sun_shadow_map
+
+    //draws the shadow casters with program_id, only the static ones when static_only is set. returns the draws issued.
+    typedef int (*draw_casters_proc)(unsigned int program_id, bool static_only);
+
+    class sun_cascades
+    {
+        struct cascade
+        {
+            glm::mat4 view_projection = glm::mat4(1.0f);
+            glm::vec3 center = glm::vec3(0.0f);     //world space centre of the sphere the cascade was fit to
+            float radius = 0.0f;
+            float texel_size = 0.0f;                //world space size of one shadow map texel
+            glm::vec3 direction = glm::vec3(0.0f);  //sun direction when it was last rendered
+            bool rendered = false;
+        };
+        cascade cascades[CASCADES];
+        unsigned int framebuffer = 0, depth_maps = 0;
+        int map_size = 0;
+        glm::vec3 direction = glm::vec3(0.0f, -1.0f, 0.0f);
+        bool static_dirty = true;
+        int rendered_last_update = 0, draws_last_update = 0;
+        shader_manager* manager = nullptr;
+        shader_manager::handle depth_program = 0;
+
+        void fit(cascade &target, const glm::vec3 &center, float radius)
+        {
+            const glm::vec3 up = std::fabs(direction.y) > 0.99f ? glm::vec3(1, 0, 0) : glm::vec3(0, 1, 0);
+            const glm::mat4 light_view = glm::lookAt(glm::vec3(0.0f), direction, up);
+            glm::vec3 light_center = glm::vec3(light_view*glm::vec4(center, 1.0f));
+            const float texel_size = 2.0f*radius/map_size;
+            light_center.x = std::floor(light_center.x/texel_size)*texel_size;
+            light_center.y = std::floor(light_center.y/texel_size)*texel_size;
+            //casters between the sun and the near plane are clamped onto it by GL_DEPTH_CLAMP
+            const glm::mat4 projection = glm::ortho(light_center.x - radius, light_center.x + radius,
+            light_center.y - radius, light_center.y + radius, -light_center.z - radius, -light_center.z + radius);
+            target.view_projection = projection*light_view;
+            target.center = center;
+            target.radius = radius;
+            target.texel_size = texel_size;
+        }
+        void render(int layer, unsigned int program_id, bool static_only, draw_casters_proc draw_casters)
+        {
+            glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depth_maps, 0, layer);
+            glClear(GL_DEPTH_BUFFER_BIT);
+            glUseProgram(program_id);
+            glUniformMatrix4fv(glGetUniformLocation(program_id, "light_view_projection"), 1, GL_FALSE, &cascades[layer].view_projection[0][0]);
+            draws_last_update += draw_casters(program_id, static_only);
+            cascades[layer].direction = direction;
+            cascades[layer].rendered = true;
+            rendered_last_update++;
+        }
+    public:
+        float shadow_distance = 30.0f;  //view depth the last cascade ends at
+        float split_lambda = 0.75f;     //0 splits the distance evenly, 1 logarithmically
+
+        //creates the shadow maps and submits the depth program. call once GL is loaded.
+        void init(shader_manager &shaders, int size = 2048)
+        {
+            manager = &shaders;
+            map_size = size;
+            depth_program = shaders.submit("src/shadow_depth.vert", "src/shadow_depth.frag");
+            glGenTextures(1, &depth_maps);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, depth_maps);
+            glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_DEPTH_COMPONENT32F, size, size, CASCADES);
+            //linear filtering of a comparison sampler gives every PCF tap a free 2x2 bilinear weighting
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+            const float cleared = 1.0f;     //nothing is shadowed until the first update
+            glClearTexImage(depth_maps, 0, GL_DEPTH_COMPONENT, GL_FLOAT, &cleared);
+            glGenFramebuffers(1, &framebuffer);
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+            glDrawBuffer(GL_NONE);
+            glReadBuffer(GL_NONE);
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        }
+        //the direction the sunlight travels in. every cascade is redrawn when it changes.
+        void set_direction(const glm::vec3 &new_direction) {direction = glm::normalize(new_direction);}
+        //call when static geometry was added, removed or moved, so the cached cascades are redrawn
+        void invalidate_static() {static_dirty = true;}
+
+        //fits the cascades to the camera (the parameters passed to lookAt and glm::perspective) and redraws the ones
+        //that need it. restores the framebuffer and viewport. returns the number of cascades drawn.
+        int update(const glm::mat4 &view, float fov_y, float aspect, float z_near, draw_casters_proc draw_casters)
+        {
+            rendered_last_update = draws_last_update = 0;
+            const unsigned int program_id = manager->program(depth_program);
+            if (!program_id)
+                return 0;
+            int viewport[4];
+            glGetIntegerv(GL_VIEWPORT, viewport);
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+            glViewport(0, 0, map_size, map_size);
+            glEnable(GL_DEPTH_CLAMP);
+            glEnable(GL_POLYGON_OFFSET_FILL);
+            glPolygonOffset(1.5f, 2.0f);
+            const glm::mat4 camera_to_world = glm::inverse(view);
+            const float tan_half_fov = std::tan(0.5f*fov_y);
+            float split_near = z_near;
+            for (int i = 0; i < CASCADES; i++)
+            {
+                const float t = float(i + 1)/CASCADES;
+                const float split_far = split_lambda*z_near*std::pow(shadow_distance/z_near, t) +
+                (1.0f - split_lambda)*(z_near + (shadow_distance - z_near)*t);
+                //the sphere around the slice only depends on its depths, so turning the camera keeps its size
+                const float center_depth = 0.5f*(split_near + split_far);
+                const glm::vec3 near_corner(split_near*tan_half_fov*aspect, split_near*tan_half_fov, split_near - center_depth);
+                const glm::vec3 far_corner(split_far*tan_half_fov*aspect, split_far*tan_half_fov, split_far - center_depth);
+                const float radius = std::ceil(std::max(glm::length(near_corner), glm::length(far_corner))*16.0f)/16.0f;
+                const glm::vec3 center = glm::vec3(camera_to_world*glm::vec4(0.0f, 0.0f, -center_depth, 1.0f));
+                split_near = split_far;
+
+                cascade &target = cascades[i];
+                const bool cached = i >= FIRST_CACHED_CASCADE;
+                if (cached && target.rendered && !static_dirty && target.direction == direction &&
+                glm::length(center - target.center) + radius + target.texel_size <= target.radius)
+                    continue;
+                fit(target, center, cached ? radius*CACHE_MARGIN : radius);
+                render(i, program_id, cached, draw_casters);
+            }
+            static_dirty = false;
+            glDisable(GL_POLYGON_OFFSET_FILL);
+            glDisable(GL_DEPTH_CLAMP);
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+            return rendered_last_update;
+        }
+        //sends the cascades to a program built with SUN_SHADOWS and binds the shadow maps
+        void bind(unsigned int program_id) const
+        {
+            glm::mat4 matrices[CASCADES];
+            float texel_sizes[CASCADES];
+            for (int i = 0; i < CASCADES; i++)
+            {
+                matrices[i] = cascades[i].view_projection;
+                texel_sizes[i] = cascades[i].texel_size;
+            }
+            glUniformMatrix4fv(glGetUniformLocation(program_id, "sun_shadow_matrices"), CASCADES, GL_FALSE, &matrices[0][0][0]);
+            glUniform1fv(glGetUniformLocation(program_id, "sun_texel_sizes"), CASCADES, texel_sizes);
+            glBindTextureUnit(SHADOW_MAP_UNIT, depth_maps);
+        }
+        unsigned int texture() const {return depth_maps;}
+        int rendered_cascades() const {return rendered_last_update;}
+        int shadow_draws() const {return draws_last_update;}
+    };
+}
+#endif
@@ -0,0 +1,132 @@
+#ifndef CLUSTERED_LIGHTING
+#define CLUSTERED_LIGHTING
+
+#include "glad/glad.h"
+#include "glm/glm.hpp"
+#include "shader_manager.h"
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+//clustered forward shading. point lights live in a shader storage buffer; every frame a compute pass bins them into
+//a 3D grid of view frustum cells (screen tiles x exponential depth slices) and the fragment shader only shades the
+//lights of its own cell. grid size and buffer bindings are shared with src/clusters.glsl.
+namespace clustered
+{
+    constexpr unsigned int GRID_X = 16, GRID_Y = 9, GRID_Z = 24;
+    constexpr unsigned int MAX_LIGHTS_PER_CLUSTER = 128;
+    constexpr unsigned int CLUSTER_COUNT = GRID_X*GRID_Y*GRID_Z;
+    constexpr unsigned int CULL_GROUP_SIZE = 128;   //BATCH_SIZE in cluster_cull.comp
+
+    //std430 layout of clustered_light
+    struct point_light
+    {
+        glm::vec4 position_radius;  //world space position, radius of influence in w
+        glm::vec4 color;            //rgb, shadow_atlas::shadow_index() in w, 0 for no shadow
+    };
+    //std140 layout of the cluster_params block
+    struct cluster_params
+    {
+        glm::mat4 inverse_projection;
+        glm::vec2 tile_size;
+        float slice_scale, slice_bias;
+        float z_near, z_far;
+        uint32_t light_count;
+        uint32_t padding;
+    };
+    enum buffer_binding {LIGHTS = 0, BOUNDS = 1, COUNTS = 2, INDICES = 3};
+    constexpr unsigned int PARAMS_BINDING = 1;      //uniform block binding, 0 holds the view matrices
+
+    class light_clusters
+    {
+        unsigned int buffers[4] = {0, 0, 0, 0};
+        unsigned int params_buffer = 0;
+        size_t light_capacity = 0;
+        cluster_params params{};
+        bool bounds_dirty = true;
+        unsigned int bounds_built_with = 0;         //a reloaded bounds program rebuilds them too
+        shader_manager* manager = nullptr;
+        shader_manager::handle bounds_program = 0, cull_program = 0;
+    public:
+        //creates the buffers and submits both compute programs. call once GL is loaded.
+        void init(shader_manager &shaders)
+        {
+            manager = &shaders;
+            bounds_program = shaders.submit_compute("src/cluster_bounds.comp");
+            cull_program = shaders.submit_compute("src/cluster_cull.comp");
+            glGenBuffers(4, buffers);
+            const size_t sizes[4] = {sizeof(point_light), 2*sizeof(glm::vec4)*CLUSTER_COUNT,
+            sizeof(uint32_t)*CLUSTER_COUNT, sizeof(uint32_t)*CLUSTER_COUNT*MAX_LIGHTS_PER_CLUSTER};
+            for (int i = 0; i < 4; i++)
+            {
+                glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[i]);
+                glBufferData(GL_SHADER_STORAGE_BUFFER, sizes[i], NULL, GL_DYNAMIC_DRAW);
+                glBindBufferBase(GL_SHADER_STORAGE_BUFFER, i, buffers[i]);
+            }
+            //no cluster holds a light until the first cull ran
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[COUNTS]);
+            glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+            glGenBuffers(1, &params_buffer);
+            glBindBuffer(GL_UNIFORM_BUFFER, params_buffer);
+            glBufferData(GL_UNIFORM_BUFFER, sizeof(cluster_params), &params, GL_DYNAMIC_DRAW);
+            glBindBufferBase(GL_UNIFORM_BUFFER, PARAMS_BINDING, params_buffer);
+            glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        }
+        //the parameters passed to glm::perspective and the framebuffer size. cluster bounds are rebuilt when they change.
+        void set_projection(const glm::mat4 &projection, float z_near, float z_far, int width, int height)
+        {
+            const glm::vec2 tile_size(float(width)/GRID_X, float(height)/GRID_Y);
+            if (params.z_near == z_near && params.z_far == z_far && params.tile_size == tile_size &&
+            params.inverse_projection == glm::inverse(projection))
+                return;
+            params.inverse_projection = glm::inverse(projection);
+            params.tile_size = tile_size;
+            params.z_near = z_near;
+            params.z_far = z_far;
+            params.slice_scale = GRID_Z/std::log(z_far/z_near);
+            params.slice_bias = -GRID_Z*std::log(z_near)/std::log(z_far/z_near);
+            bounds_dirty = true;
+        }
+        //replaces the light list. the buffer only grows, so animating lights every frame never reallocates.
+        void set_lights(const std::vector<point_light> &lights)
+        {
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[LIGHTS]);
+            if (lights.size() > light_capacity)
+            {
+                light_capacity = lights.size();
+                glBufferData(GL_SHADER_STORAGE_BUFFER, light_capacity*sizeof(point_light), lights.data(), GL_DYNAMIC_DRAW);
+            }
+            else if (!lights.empty())
+                glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, lights.size()*sizeof(point_light), lights.data());
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+            params.light_count = uint32_t(lights.size());
+        }
+        //bins the lights for this frame's view. the view matrices uniform block must be current.
+        //returns false while the compute programs are still compiling.
+        bool cull()
+        {
+            const unsigned int bounds_id = manager->program(bounds_program), cull_id = manager->program(cull_program);
+            if (!bounds_id || !cull_id)
+                return false;
+            glBindBuffer(GL_UNIFORM_BUFFER, params_buffer);
+            glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(cluster_params), &params);
+            glBindBuffer(GL_UNIFORM_BUFFER, 0);
+            if (bounds_dirty || bounds_id != bounds_built_with)
+            {
+                glUseProgram(bounds_id);
+                glDispatchCompute(1, 1, GRID_Z);
+                glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+                bounds_dirty = false;
+                bounds_built_with = bounds_id;
+            }
+            glUseProgram(cull_id);
+            glDispatchCompute((CLUSTER_COUNT + CULL_GROUP_SIZE - 1)/CULL_GROUP_SIZE, 1, 1);
+            return true;    //the barrier before the lists are read is left to the caller's render graph
+        }
+        unsigned int light_count() const {return params.light_count;}
+        unsigned int buffer(buffer_binding binding) const {return buffers[binding];}
+    };
+}
+#endif
@@ -0,0 +1,253 @@
+#ifndef COMMAND_BUFFER
+#define COMMAND_BUFFER
+
+#include "glad/glad.h"
+#include "glm/glm.hpp"
+#include "job_system.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//draws recorded on any thread into compact binary command buffers, replayed on the GL thread. recording only appends
+//bytes and never calls GL, so the draw data of a scene can be built by one thread per partition; replay is a tight
+//decode loop that also drops binds and uniforms setting what is already set. uniforms are recorded by interned name
+//and resolved to locations during replay, the only place a program is known to be linked.
+namespace commands
+{
+    constexpr int MAX_TEXTURE_UNITS = 16;   //the fragment units GL 4.6 guarantees
+    constexpr int FIRST_RESERVED_UNIT = 12; //units from here on hold the shadow maps and the image based lighting
+
+    typedef uint16_t uniform_name;
+    namespace detail
+    {
+        struct name_registry
+        {
+            std::mutex lock;
+            std::deque<std::string> names;  //a deque keeps references valid as it grows
+            std::unordered_map<std::string, uniform_name> ids;
+        };
+        inline name_registry& registry()
+        {
+            static name_registry names;
+            return names;
+        }
+    }
+    //the id commands carry for a uniform's name. thread safe, keep the ids of fixed names in statics.
+    inline uniform_name intern(const std::string &name)
+    {
+        detail::name_registry &names = detail::registry();
+        std::lock_guard<std::mutex> guard(names.lock);
+        auto found = names.ids.find(name);
+        if (found != names.ids.end())
+            return found->second;
+        const uniform_name id = uniform_name(names.names.size());
+        names.names.push_back(name);
+        names.ids.emplace(name, id);
+        return id;
+    }
+    inline const std::string& name(uniform_name id)
+    {
+        detail::name_registry &names = detail::registry();
+        std::lock_guard<std::mutex> guard(names.lock);
+        return names.names[id];
+    }
+
+    //a stream of commands, each an opcode byte followed by its operands. clear() keeps the memory, so a buffer
+    //recorded every frame stops allocating after the first.
+    class command_buffer
+    {
+    public:
+        enum opcode : uint8_t {USE_PROGRAM, BIND_VERTEX_ARRAY, BIND_TEXTURE, UNIFORM_INT, UNIFORM_FLOAT, UNIFORM_MAT4, DRAW_ARRAYS, DRAW_ELEMENTS};
+    private:
+        std::vector<uint8_t> bytes;
+        size_t count = 0;
+
+        template <typename T>
+        void push(const T &value)
+        {
+            const size_t at = bytes.size();
+            bytes.resize(at + sizeof(T));
+            std::memcpy(&bytes[at], &value, sizeof(T));
+        }
+        void begin(opcode op)
+        {
+            bytes.push_back(op);
+            count++;
+        }
+    public:
+        void use_program(unsigned int program_id) {begin(USE_PROGRAM); push<uint32_t>(program_id);}
+        void bind_vertex_array(unsigned int vertex_array) {begin(BIND_VERTEX_ARRAY); push<uint32_t>(vertex_array);}
+        //binds any texture target, like glBindTextureUnit
+        void bind_texture(unsigned int unit, unsigned int texture) {begin(BIND_TEXTURE); push<uint8_t>(unit); push<uint32_t>(texture);}
+        void uniform(uniform_name name, int value) {begin(UNIFORM_INT); push(name); push<int32_t>(value);}
+        void uniform(uniform_name name, float value) {begin(UNIFORM_FLOAT); push(name); push(value);}
+        void uniform(uniform_name name, const glm::mat4 &value) {begin(UNIFORM_MAT4); push(name); push(value);}
+        void draw_arrays(GLenum mode, int first, int vertices) {begin(DRAW_ARRAYS); push<uint32_t>(mode); push<int32_t>(first); push<int32_t>(vertices);}
+        //indices of type GL_UNSIGNED_INT from the start of the element buffer
+        void draw_elements(GLenum mode, int indices) {begin(DRAW_ELEMENTS); push<uint32_t>(mode); push<int32_t>(indices);}
+        void clear()
+        {
+            bytes.clear();
+            count = 0;
+        }
+        const std::vector<uint8_t>& data() const {return bytes;}
+        size_t commands() const {return count;}
+    };
+
+    struct replay_statistics
+    {
+        size_t commands = 0, draws = 0;
+        size_t skipped = 0;     //binds and uniforms that set what was already set
+        size_t bytes = 0;
+    };
+    namespace detail
+    {
+        template <typename T>
+        T read(const uint8_t* &at)
+        {
+            T value;
+            std::memcpy(&value, at, sizeof(T));
+            at += sizeof(T);
+            return value;
+        }
+        struct uniform_state
+        {
+            int location = -1;
+            bool resolved = false, set = false;
+            float value[16];    //ints are kept as their bits
+        };
+    }
+    //executes the buffers in order on the GL thread, as one stream: state one buffer leaves is reused by the next.
+    //the vertex array is unbound afterwards, like object_3D::drawable::draw() leaves it.
+    inline replay_statistics replay(const std::vector<command_buffer> &buffers)
+    {
+        replay_statistics stats;
+        unsigned int program = ~0u, vertex_array = ~0u;
+        unsigned int textures[MAX_TEXTURE_UNITS];
+        std::fill(textures, textures + MAX_TEXTURE_UNITS, ~0u);
+        std::unordered_map<uint64_t, detail::uniform_state> uniforms;   //by program and name
+        //the uniform's state in the current program, its location looked up the first time
+        auto lookup = [&](uniform_name name) -> detail::uniform_state&
+        {
+            detail::uniform_state &state = uniforms[uint64_t(program) << 16 | name];
+            if (!state.resolved)
+            {
+                state.location = glGetUniformLocation(program, commands::name(name).c_str());
+                state.resolved = true;
+            }
+            return state;
+        };
+        //true if the value differs from the last one set, which it then becomes
+        auto changed = [&stats](detail::uniform_state &state, const void* value, size_t size)
+        {
+            if (state.location < 0 || (state.set && std::memcmp(state.value, value, size) == 0))
+            {
+                stats.skipped++;
+                return false;
+            }
+            std::memcpy(state.value, value, size);
+            state.set = true;
+            return true;
+        };
+        for (const command_buffer &buffer : buffers)
+        {
+            stats.commands += buffer.commands();
+            stats.bytes += buffer.data().size();
+            const uint8_t* at = buffer.data().data();
+            const uint8_t* const end = at + buffer.data().size();
+            while (at < end)
+                switch (*at++)
+                {
+                case command_buffer::USE_PROGRAM:
+                {
+                    const unsigned int id = detail::read<uint32_t>(at);
+                    if (id != program)
+                        glUseProgram(program = id);
+                    else
+                        stats.skipped++;
+                    break;
+                }
+                case command_buffer::BIND_VERTEX_ARRAY:
+                {
+                    const unsigned int id = detail::read<uint32_t>(at);
+                    if (id != vertex_array)
+                        glBindVertexArray(vertex_array = id);
+                    else
+                        stats.skipped++;
+                    break;
+                }
+                case command_buffer::BIND_TEXTURE:
+                {
+                    const unsigned int unit = detail::read<uint8_t>(at), id = detail::read<uint32_t>(at);
+                    if (id != textures[unit])
+                        glBindTextureUnit(unit, textures[unit] = id);
+                    else
+                        stats.skipped++;
+                    break;
+                }
+                case command_buffer::UNIFORM_INT:
+                {
+                    detail::uniform_state &state = lookup(detail::read<uniform_name>(at));
+                    const int32_t value = detail::read<int32_t>(at);
+                    if (changed(state, &value, sizeof(value)))
+                        glUniform1i(state.location, value);
+                    break;
+                }
+                case command_buffer::UNIFORM_FLOAT:
+                {
+                    detail::uniform_state &state = lookup(detail::read<uniform_name>(at));
+                    const float value = detail::read<float>(at);
+                    if (changed(state, &value, sizeof(value)))
+                        glUniform1f(state.location, value);
+                    break;
+                }
+                case command_buffer::UNIFORM_MAT4:
+                {
+                    detail::uniform_state &state = lookup(detail::read<uniform_name>(at));
+                    const glm::mat4 value = detail::read<glm::mat4>(at);
+                    if (changed(state, &value, sizeof(value)))
+                        glUniformMatrix4fv(state.location, 1, GL_FALSE, &value[0][0]);
+                    break;
+                }
+                case command_buffer::DRAW_ARRAYS:
+                {
+                    const GLenum mode = detail::read<uint32_t>(at);
+                    const int first = detail::read<int32_t>(at), vertices = detail::read<int32_t>(at);
+                    glDrawArrays(mode, first, vertices);
+                    stats.draws++;
+                    break;
+                }
+                case command_buffer::DRAW_ELEMENTS:
+                {
+                    const GLenum mode = detail::read<uint32_t>(at);
+                    const int indices = detail::read<int32_t>(at);
+                    glDrawElements(mode, indices, GL_UNSIGNED_INT, 0);
+                    stats.draws++;
+                    break;
+                }
+                default:
+                    return stats;   //a corrupt buffer, nothing after this can be decoded
+                }
+        }
+        glBindVertexArray(0);
+        return stats;
+    }
+    //clears partitions.size() buffers and records partition i into partitions[i] with record(i, buffer), as jobs
+    //of the engine's job system
+    template <typename F>
+    void record_parallel(std::vector<command_buffer> &partitions, F record)
+    {
+        jobs::parallel_for(partitions.size(), [&](size_t i)
+        {
+            partitions[i].clear();
+            record(i, partitions[i]);
+        });
+    }
+}
+#endif
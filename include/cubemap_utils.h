@@ -0,0 +1,200 @@
+#ifndef CUBEMAP_UTILS
+#define CUBEMAP_UTILS
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+//CPU side cubemap helpers. faces are ordered like GL_TEXTURE_CUBE_MAP_POSITIVE_X + i.
+namespace cubemap
+{
+    constexpr float PI = 3.14159265358979f;
+
+    //direction through texel centre (x, y) of face, following the GL cube map face selection table.
+    //sc and tc are the face coordinates in [-1, 1], rows run top to bottom as in the uploaded image.
+    inline void face_direction(int face, float sc, float tc, float &x, float &y, float &z)
+    {
+        switch (face)
+        {
+            case 0: x =  1.0f; y = -tc;   z = -sc;   break;
+            case 1: x = -1.0f; y = -tc;   z =  sc;   break;
+            case 2: x =  sc;   y =  1.0f; z =  tc;   break;
+            case 3: x =  sc;   y = -1.0f; z = -tc;   break;
+            case 4: x =  sc;   y = -tc;   z =  1.0f; break;
+            default:x = -sc;   y = -tc;   z = -1.0f; break;
+        }
+    }
+
+    //inverse of face_direction : picks the face hit by (x, y, z) and its coordinates in [-1, 1].
+    inline int direction_face(float x, float y, float z, float &sc, float &tc)
+    {
+        const float ax = std::fabs(x), ay = std::fabs(y), az = std::fabs(z);
+        if (ax >= ay && ax >= az)
+        {
+            sc = (x > 0 ? -z : z)/ax; tc = -y/ax;
+            return x > 0 ? 0 : 1;
+        }
+        if (ay >= az)
+        {
+            sc = x/ay; tc = (y > 0 ? z : -z)/ay;
+            return y > 0 ? 2 : 3;
+        }
+        sc = (z > 0 ? x : -x)/az; tc = -y/az;
+        return z > 0 ? 4 : 5;
+    }
+
+    //one mip level of a cube map, RGB float texels per face.
+    struct cube_image
+    {
+        int size = 0;
+        std::vector<float> faces[6];
+        void resize(int face_size)
+        {
+            size = face_size;
+            for (auto &face : faces)
+                face.assign(size_t(size)*size*3, 0.0f);
+        }
+        float* texel(int face, int x, int y) {return &faces[face][(size_t(y)*size + x)*3];}
+        const float* texel(int face, int x, int y) const {return &faces[face][(size_t(y)*size + x)*3];}
+        //bilinear lookup along a direction. filtering stops at face edges.
+        void sample(float x, float y, float z, float* out) const
+        {
+            float sc, tc;
+            const int face = direction_face(x, y, z, sc, tc);
+            const float fx = std::min(std::max((sc + 1.0f)*0.5f*size - 0.5f, 0.0f), size - 1.0f);
+            const float fy = std::min(std::max((tc + 1.0f)*0.5f*size - 0.5f, 0.0f), size - 1.0f);
+            const int x0 = int(fx), y0 = int(fy);
+            const int x1 = std::min(x0 + 1, size - 1), y1 = std::min(y0 + 1, size - 1);
+            const float wx = fx - x0, wy = fy - y0;
+            const float *t00 = texel(face, x0, y0), *t10 = texel(face, x1, y0);
+            const float *t01 = texel(face, x0, y1), *t11 = texel(face, x1, y1);
+            for (int c = 0; c < 3; c++)
+            {
+                const float top = t00[c] + (t10[c] - t00[c])*wx;
+                const float bottom = t01[c] + (t11[c] - t01[c])*wx;
+                out[c] = top + (bottom - top)*wy;
+            }
+        }
+        //2x2 box filtered copy at half the size
+        cube_image downsample() const
+        {
+            cube_image half;
+            half.resize(std::max(1, size/2));
+            for (int face = 0; face < 6; face++)
+                for (int y = 0; y < half.size; y++)
+                    for (int x = 0; x < half.size; x++)
+                    {
+                        const int x0 = std::min(2*x, size - 1), x1 = std::min(2*x + 1, size - 1);
+                        const int y0 = std::min(2*y, size - 1), y1 = std::min(2*y + 1, size - 1);
+                        for (int c = 0; c < 3; c++)
+                            half.texel(face, x, y)[c] = 0.25f*(texel(face, x0, y0)[c] + texel(face, x1, y0)[c] +
+                            texel(face, x0, y1)[c] + texel(face, x1, y1)[c]);
+                    }
+            return half;
+        }
+    };
+
+    //bilinear lookup into an RGB float image, wrapping horizontally and clamping vertically.
+    inline void sample_equirect(const float* image, int width, int height, float u, float v, float* out)
+    {
+        const float fx = u*width - 0.5f, fy = v*height - 0.5f;
+        const int x0 = int(std::floor(fx)), y0 = int(std::floor(fy));
+        const float wx = fx - x0, wy = fy - y0;
+        const int xa = ((x0 % width) + width) % width, xb = (xa + 1) % width;
+        const int ya = y0 < 0 ? 0 : (y0 >= height ? height - 1 : y0);
+        const int yb = y0 + 1 >= height ? height - 1 : (y0 + 1 < 0 ? 0 : y0 + 1);
+        const float* t00 = image + (size_t(ya)*width + xa)*3;
+        const float* t10 = image + (size_t(ya)*width + xb)*3;
+        const float* t01 = image + (size_t(yb)*width + xa)*3;
+        const float* t11 = image + (size_t(yb)*width + xb)*3;
+        for (int c = 0; c < 3; c++)
+        {
+            const float top = t00[c] + (t10[c] - t00[c])*wx;
+            const float bottom = t01[c] + (t11[c] - t01[c])*wx;
+            out[c] = top + (bottom - top)*wy;
+        }
+    }
+
+#if defined(__SSE2__)
+    namespace simd
+    {
+        inline __m128 abs(__m128 x) {return _mm_andnot_ps(_mm_set1_ps(-0.0f), x);}
+        inline __m128 select(__m128 mask, __m128 a, __m128 b) {return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));}
+        //max error ~1e-5 rad
+        inline __m128 atan2(__m128 y, __m128 x)
+        {
+            const __m128 ax = abs(x), ay = abs(y);
+            const __m128 a = _mm_div_ps(_mm_min_ps(ax, ay), _mm_max_ps(_mm_max_ps(ax, ay), _mm_set1_ps(1e-30f)));
+            const __m128 s = _mm_mul_ps(a, a);
+            __m128 r = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(-0.0464964749f), s), _mm_set1_ps(0.15931422f));
+            r = _mm_sub_ps(_mm_mul_ps(r, s), _mm_set1_ps(0.327622764f));
+            r = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(r, s), a), a);
+            r = select(_mm_cmpgt_ps(ay, ax), _mm_sub_ps(_mm_set1_ps(0.5f*PI), r), r);
+            r = select(_mm_cmplt_ps(x, _mm_setzero_ps()), _mm_sub_ps(_mm_set1_ps(PI), r), r);
+            return _mm_or_ps(r, _mm_and_ps(y, _mm_set1_ps(-0.0f)));  //copy the sign of y
+        }
+        //Abramowitz & Stegun 4.4.45, max error ~7e-5 rad
+        inline __m128 acos(__m128 x)
+        {
+            const __m128 ax = _mm_min_ps(abs(x), _mm_set1_ps(1.0f));
+            __m128 p = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(-0.0187293f), ax), _mm_set1_ps(0.0742610f));
+            p = _mm_sub_ps(_mm_mul_ps(p, ax), _mm_set1_ps(0.2121144f));
+            p = _mm_add_ps(_mm_mul_ps(p, ax), _mm_set1_ps(1.5707288f));
+            const __m128 r = _mm_mul_ps(p, _mm_sqrt_ps(_mm_sub_ps(_mm_set1_ps(1.0f), ax)));
+            return select(_mm_cmplt_ps(x, _mm_setzero_ps()), _mm_sub_ps(_mm_set1_ps(PI), r), r);
+        }
+    }
+#endif
+
+    //resamples one face_size x face_size RGB float face of a cube map from an equirectangular RGB float image.
+    //directions and their spherical coordinates are computed 4 texels at a time when SSE2 is available.
+    void equirect_to_face(const float* image, int width, int height, int face, int face_size, std::vector<float> &face_texels)
+    {
+        face_texels.resize(size_t(face_size)*face_size*3);
+        std::vector<float> u(face_size + 4), v(face_size + 4);
+        const float texel = 2.0f/face_size;
+        for (int row = 0; row < face_size; row++)
+        {
+            const float tc = (row + 0.5f)*texel - 1.0f;
+            int col = 0;
+#if defined(__SSE2__)
+            const __m128 lane_offsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+            for (; col + 4 <= face_size; col += 4)
+            {
+                const __m128 sc = _mm_sub_ps(_mm_mul_ps(_mm_add_ps(_mm_set1_ps(float(col)), lane_offsets), _mm_set1_ps(texel)), _mm_set1_ps(1.0f));
+                const __m128 t = _mm_set1_ps(tc), one = _mm_set1_ps(1.0f);
+                const __m128 zero = _mm_setzero_ps();
+                __m128 x, y, z;
+                switch (face)
+                {
+                    case 0: x = one;                  y = _mm_sub_ps(zero, t); z = _mm_sub_ps(zero, sc); break;
+                    case 1: x = _mm_sub_ps(zero, one); y = _mm_sub_ps(zero, t); z = sc;                   break;
+                    case 2: x = sc;                   y = one;                  z = t;                    break;
+                    case 3: x = sc;                   y = _mm_sub_ps(zero, one); z = _mm_sub_ps(zero, t);  break;
+                    case 4: x = sc;                   y = _mm_sub_ps(zero, t); z = one;                  break;
+                    default:x = _mm_sub_ps(zero, sc); y = _mm_sub_ps(zero, t); z = _mm_sub_ps(zero, one); break;
+                }
+                const __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z)));
+                const __m128 us = _mm_add_ps(_mm_mul_ps(simd::atan2(z, x), _mm_set1_ps(0.5f/PI)), _mm_set1_ps(0.5f));
+                const __m128 vs = _mm_mul_ps(simd::acos(_mm_div_ps(y, length)), _mm_set1_ps(1.0f/PI));
+                _mm_storeu_ps(&u[col], us);
+                _mm_storeu_ps(&v[col], vs);
+            }
+#endif
+            for (; col < face_size; col++)
+            {
+                float x, y, z;
+                face_direction(face, (col + 0.5f)*texel - 1.0f, tc, x, y, z);
+                u[col] = std::atan2(z, x)*(0.5f/PI) + 0.5f;
+                v[col] = std::acos(y/std::sqrt(x*x + y*y + z*z))/PI;
+            }
+            float* out = &face_texels[size_t(row)*face_size*3];
+            for (col = 0; col < face_size; col++)
+                sample_equirect(image, width, height, u[col], v[col], out + col*3);
+        }
+    }
+}
+#endif
@@ -0,0 +1,143 @@
+#ifndef DEFERRED_RENDERER
+#define DEFERRED_RENDERER
+
+#include "glad/glad.h"
+#include "glm/glm.hpp"
+#include "shader_manager.h"
+#include "shader_permutations.h"
+#include "render_graph.h"
+#include "post_processing.h"
+
+
+//deferred shading path. the geometry pass writes surfaces into a compact G-buffer (layout in src/gbuffer.glsl) and
+//marks covered pixels in the stencil buffer; the lighting pass then shades each covered pixel once with a fullscreen
+//triangle, so lighting cost no longer scales with overdraw. both passes are specialised through shader_permutations
+//like the forward pass, and share its shading model (src/shading.glsl).
+namespace deferred
+{
+    //the G-buffer's targets, transient textures of the frame's render graph
+    struct gbuffer
+    {
+        graph::resource albedo_spec = graph::NONE, normal = graph::NONE, motion = graph::NONE, depth_stencil = graph::NONE;
+
+        //declares them for a width x height output, the scene may cover only part of them
+        void create(graph::render_graph &frame, int width, int height)
+        {
+            albedo_spec = frame.create_texture("gbuffer albedo", {width, height, 1, GL_RGBA8, GL_NEAREST, GL_NEAREST});
+            normal = frame.create_texture("gbuffer normal", {width, height, 1, GL_RG16_SNORM, GL_NEAREST, GL_NEAREST});
+            motion = frame.create_texture("gbuffer motion", {width, height, 1, GL_RG16F, GL_NEAREST, GL_NEAREST});
+            //same format as the scene target's, so the lighting pass can blit its depth and stencil there
+            depth_stencil = frame.create_texture("gbuffer depth", {width, height, 1, GL_DEPTH24_STENCIL8, GL_NEAREST, GL_NEAREST});
+        }
+    };
+
+    class renderer
+    {
+        shader_permutations geometry_variants, lighting_variants;
+        unsigned int empty_vao = 0;     //the fullscreen triangle has no vertex buffer, but core profile draws need a VAO
+
+        //binds the G-buffer with a width x height viewport, clears it and sets the stencil up to mark every pixel drawn
+        void begin_geometry(unsigned int framebuffer, int width, int height)
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+            glViewport(0, 0, width, height);
+            glStencilMask(0xFF);
+            glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+            glStencilFunc(GL_ALWAYS, 1, 0xFF);
+            glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+            glDisable(GL_BLEND);   //alpha carries the specular intensity
+        }
+        //copies depth and stencil to the output framebuffer, so later forward draws (the skybox) depth test against
+        //the scene, binds it and the lighting variant with the G-buffer. returns 0 while that variant is still compiling.
+        unsigned int begin_lighting(unsigned int gbuffer_framebuffer, const unsigned int (&textures)[4], unsigned int output_framebuffer,
+        int width, int height, const shader_features &lighting, const glm::mat4 &view_projection)
+        {
+            glBlitNamedFramebuffer(gbuffer_framebuffer, output_framebuffer, 0, 0, width, height, 0, 0, width, height,
+            GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT, GL_NEAREST);
+            glBindFramebuffer(GL_FRAMEBUFFER, output_framebuffer);
+            glViewport(0, 0, width, height);
+            glEnable(GL_BLEND);
+            const unsigned int program_id = lighting_variants.program(lighting);
+            if (!program_id)
+                return 0;
+            glUseProgram(program_id);
+            glUniformMatrix4fv(glGetUniformLocation(program_id, "inverse_view_projection"), 1, GL_FALSE, &glm::inverse(view_projection)[0][0]);
+            for (unsigned int unit = 0; unit < 4; unit++)   //depth/stencil samples depth, the default
+                glBindTextureUnit(unit, textures[unit]);
+            return program_id;
+        }
+        //shades every pixel the geometry pass covered, then restores the default depth and stencil state
+        void draw_lighting()
+        {
+            glDisable(GL_DEPTH_TEST);
+            glStencilFunc(GL_EQUAL, 1, 0xFF);
+            glStencilMask(0x00);
+            glBindVertexArray(empty_vao);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+            glBindVertexArray(0);
+            end_lighting();
+        }
+        //restores the state draw_lighting() changed, also when the lighting variant was not ready
+        void end_lighting()
+        {
+            glStencilMask(0xFF);
+            glStencilFunc(GL_ALWAYS, 0, 0xFF);
+            glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+            glEnable(GL_DEPTH_TEST);
+        }
+    public:
+        renderer(shader_manager &shaders) :
+        geometry_variants(shaders, "src/vShader.vert", "src/gbuffer.frag"),
+        lighting_variants(shaders, "src/fullscreen.vert", "src/deferred_lighting.frag") {}
+
+        //submits the geometry variant for a material and the lighting variant for the scene lights,
+        //so switching to the deferred path does not wait on the compiler
+        void prepare(const shader_features &material, const shader_features &lighting)
+        {
+            geometry_variants.request(material);
+            lighting_variants.request(lighting);
+        }
+        //binds the geometry variant for a material. 0 while it is still compiling.
+        unsigned int use_geometry_program(const shader_features &material)
+        {
+            const unsigned int program_id = geometry_variants.program(material);
+            if (program_id)
+                glUseProgram(program_id);
+            return program_id;
+        }
+        //adds the geometry and lighting passes drawing the opaque scene into scene. draw_geometry draws it with
+        //use_geometry_program(), send_lights sends the lighting variant its light uniforms. returns the lighting pass,
+        //for the resources the lights read.
+        graph::pass_builder add_passes(graph::render_graph &frame, const post::hdr_target &scene, const shader_features &lighting,
+        const glm::mat4 &view_projection, void (*draw_geometry)(), void (*send_lights)(unsigned int program_id))
+        {
+            if (!empty_vao)
+                glGenVertexArrays(1, &empty_vao);
+            gbuffer targets;
+            targets.create(frame, scene.width, scene.height);
+            const int width = scene.render_width, height = scene.render_height;
+            frame.add_pass("gbuffer", [this, &frame, targets, width, height, draw_geometry]()
+            {
+                begin_geometry(frame.framebuffer({targets.albedo_spec, targets.normal, targets.motion}, targets.depth_stencil), width, height);
+                draw_geometry();
+            }).write(targets.albedo_spec, graph::ATTACHMENT).write(targets.normal, graph::ATTACHMENT)
+            .write(targets.motion, graph::ATTACHMENT).write(targets.depth_stencil, graph::ATTACHMENT);
+            return frame.add_pass("deferred lighting", [this, &frame, targets, scene, width, height, lighting, view_projection, send_lights]()
+            {
+                const unsigned int textures[4] = {frame.id(targets.albedo_spec), frame.id(targets.normal), frame.id(targets.depth_stencil), frame.id(targets.motion)};
+                const unsigned int gbuffer_framebuffer = frame.framebuffer({targets.albedo_spec, targets.normal, targets.motion}, targets.depth_stencil);
+                if (unsigned int program_id = begin_lighting(gbuffer_framebuffer, textures, scene.framebuffer(frame), width, height, lighting, view_projection))
+                {
+                    send_lights(program_id);
+                    draw_lighting();
+                }
+                else
+                    end_lighting();
+            }).read(targets.albedo_spec, graph::SAMPLED).read(targets.normal, graph::SAMPLED).read(targets.motion, graph::SAMPLED)
+            .read(targets.depth_stencil, graph::SAMPLED).read(targets.depth_stencil, graph::TRANSFER)
+            .write(scene.color, graph::ATTACHMENT).write(scene.motion, graph::ATTACHMENT).write(scene.depth_stencil, graph::TRANSFER);
+        }
+    };
+}
+#endif
@@ -0,0 +1,107 @@
+#ifndef FILE_WATCHER
+#define FILE_WATCHER
+
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#if defined(__linux__)
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+//reports files that were modified since the last call to changes(), without ever blocking.
+//on linux an inotify instance watches the directories of the watched files, which also catches editors that save
+//by writing a temporary file and renaming it over the original. elsewhere the modification times are compared.
+class file_watcher
+{
+    std::unordered_map<std::string, std::filesystem::file_time_type> files;    //canonical path --> last write time
+#if defined(__linux__)
+    int inotify_fd = -1;
+    std::unordered_map<int, std::string> directories;   //watch descriptor --> canonical directory
+#endif
+
+    static std::string canonical(const std::string &path)
+    {
+        std::error_code error;
+        std::filesystem::path canon = std::filesystem::weakly_canonical(path, error);
+        return error ? path : canon.string();
+    }
+    static std::filesystem::file_time_type write_time(const std::string &path)
+    {
+        std::error_code error;
+        std::filesystem::file_time_type time = std::filesystem::last_write_time(path, error);
+        return error ? std::filesystem::file_time_type::min() : time;
+    }
+public:
+    file_watcher()
+    {
+#if defined(__linux__)
+        inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+    }
+    ~file_watcher()
+    {
+#if defined(__linux__)
+        if (inotify_fd >= 0)
+            close(inotify_fd);
+#endif
+    }
+    file_watcher(const file_watcher&) = delete;
+    file_watcher& operator=(const file_watcher&) = delete;
+
+    bool watch(const std::string &path)
+    {
+        const std::string file = canonical(path);
+        files[file] = write_time(file);
+#if defined(__linux__)
+        if (inotify_fd < 0)
+            return true;    //falls back to comparing write times
+        const std::string directory = std::filesystem::path(file).parent_path().string();
+        const int descriptor = inotify_add_watch(inotify_fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);    //written in place, or renamed over it
+        if (descriptor < 0)
+            return false;
+        directories[descriptor] = directory;
+#endif
+        return true;
+    }
+    //canonical paths of the watched files changed since the last call, each reported once
+    std::vector<std::string> changes()
+    {
+        std::unordered_set<std::string> changed;
+#if defined(__linux__)
+        if (inotify_fd >= 0)
+        {
+            alignas(inotify_event) char buffer[4096];
+            ssize_t length;
+            while ((length = read(inotify_fd, buffer, sizeof(buffer))) > 0)
+                for (char* position = buffer; position < buffer + length;)
+                {
+                    const inotify_event* event = reinterpret_cast<const inotify_event*>(position);
+                    position += sizeof(inotify_event) + event->len;
+                    auto directory = directories.find(event->wd);
+                    if (directory == directories.end() || event->len == 0)
+                        continue;
+                    const std::string file = directory->second + "/" + event->name;
+                    if (files.count(file))
+                        changed.insert(file);
+                }
+            for (const std::string &file : changed)
+                files[file] = write_time(file);
+            return std::vector<std::string>(changed.begin(), changed.end());
+        }
+#endif
+        for (auto &file : files)
+        {
+            const std::filesystem::file_time_type time = write_time(file.first);
+            if (time != file.second)
+            {
+                file.second = time;
+                changed.insert(file.first);
+            }
+        }
+        return std::vector<std::string>(changed.begin(), changed.end());
+    }
+};
+#endif
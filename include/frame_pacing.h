@@ -0,0 +1,96 @@
+#ifndef FRAME_PACING
+#define FRAME_PACING
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+//frames presented at even intervals. an average frame rate hides the frames that stutter, so frame times are kept and
+//reported as percentiles. the pacer holds every frame on screen for the same whole number of display refreshes: as
+//many as the slow frames need, through the swap interval with vsync, or by sleeping until the frame's slot without.
+namespace pacing
+{
+    struct percentiles
+    {
+        float p50 = 0.0f, p99 = 0.0f, p999 = 0.0f;  //milliseconds
+    };
+
+    //the last capacity frame times, in milliseconds
+    class frame_times
+    {
+        std::vector<float> samples;
+        size_t count = 0, next = 0;
+        mutable std::vector<float> sorted;     //scratch, kept to not allocate per query
+    public:
+        explicit frame_times(size_t capacity = 4096) : samples(capacity) {}
+        void record(float milliseconds)
+        {
+            samples[next] = milliseconds;
+            next = (next + 1)%samples.size();
+            count = std::min(count + 1, samples.size());
+        }
+        //the p-th percentile (0 to 100) by nearest rank, 0 while nothing was recorded
+        float percentile(float p) const
+        {
+            if (count == 0)
+                return 0.0f;
+            sorted.assign(samples.begin(), samples.begin() + count);
+            const size_t rank = std::min(count - 1, size_t(std::max(std::ceil(double(p)*count/100.0 - 1e-4), 1.0)) - 1);
+            std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+            return sorted[rank];
+        }
+        percentiles summary() const {return {percentile(50.0f), percentile(99.0f), percentile(99.9f)};}
+        size_t size() const {return count;}
+    };
+
+    class frame_pacer
+    {
+    public:
+        static constexpr int MAX_REFRESHES = 4;
+        float headroom = 0.9f;      //the share of its refreshes a frame may take, the rest absorbs noise
+    private:
+        typedef std::chrono::steady_clock clock;
+        double refresh_ms = 1000.0/60.0;
+        int refreshes = 1;          //display refreshes every frame is held for
+        frame_times costs{120};     //about two seconds of frames
+        clock::time_point next_present;
+        bool timed = false;         //next_present is valid
+    public:
+        void set_refresh_rate(int hz) {refresh_ms = 1000.0/std::max(hz, 1);}
+        //call once a frame's work is submitted, with what it cost the CPU and the GPU. picks how many refreshes every
+        //frame is held for from the slow frames' cost, and returns the swap interval that holds them. without vsync
+        //it returns 0 and sleeps until the frame's slot instead.
+        int pace(float cpu_ms, float gpu_ms, bool vsync)
+        {
+            costs.record(std::max(cpu_ms, gpu_ms));
+            const float cost = costs.percentile(95.0f);
+            int fitting = 1;
+            while (fitting < MAX_REFRESHES && cost > headroom*fitting*refresh_ms)
+                fitting++;
+            //slower at once, as missed refreshes already stutter; faster only once the frames fit with a margin
+            if (fitting > refreshes || cost < 0.8f*headroom*fitting*refresh_ms)
+                refreshes = fitting;
+            if (vsync)
+            {
+                timed = false;
+                return refreshes;
+            }
+            const clock::duration period = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double, std::milli>(refreshes*refresh_ms));
+            const clock::time_point now = clock::now();
+            next_present = timed && now - next_present < period ? next_present + period : now;    //a late frame starts a new schedule
+            timed = true;
+            //the scheduler wakes late by up to a millisecond or so, the rest is spent yielding
+            if (next_present - now > std::chrono::milliseconds(2))
+                std::this_thread::sleep_until(next_present - std::chrono::milliseconds(1));
+            while (clock::now() < next_present)
+                std::this_thread::yield();
+            return 0;
+        }
+        int refreshes_per_frame() const {return refreshes;}
+        float frame_budget_ms() const {return float(refreshes*refresh_ms);}
+    };
+}
+#endif
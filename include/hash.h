@@ -0,0 +1,62 @@
+#ifndef HASH_UTIL
+#define HASH_UTIL
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace resources
+{
+    //xxHash64 (https://github.com/Cyan4973/xxHash), seed 0.
+    namespace xxh
+    {
+        constexpr uint64_t P1 = 11400714785074694791ULL;
+        constexpr uint64_t P2 = 14029467366897019727ULL;
+        constexpr uint64_t P3 = 1609587929392839161ULL;
+        constexpr uint64_t P4 = 9650029242287828579ULL;
+        constexpr uint64_t P5 = 2870177450012600261ULL;
+        inline uint64_t rotl(uint64_t x, int r) {return (x << r) | (x >> (64 - r));}
+        inline uint64_t read64(const unsigned char* p) {uint64_t v; memcpy(&v, p, 8); return v;}
+        inline uint32_t read32(const unsigned char* p) {uint32_t v; memcpy(&v, p, 4); return v;}
+        inline uint64_t round(uint64_t acc, uint64_t input) {return rotl(acc + input*P2, 31) * P1;}
+        inline uint64_t merge_round(uint64_t acc, uint64_t val) {return (acc ^ round(0, val))*P1 + P4;}
+    }
+    uint64_t hash_bytes(const void* data, size_t size, uint64_t seed = 0)
+    {
+        using namespace xxh;
+        const unsigned char* p = static_cast<const unsigned char*>(data);
+        const unsigned char* const end = p + size;
+        uint64_t h;
+        if (size >= 32)
+        {
+            uint64_t v1 = seed + P1 + P2, v2 = seed + P2, v3 = seed, v4 = seed - P1;
+            const unsigned char* const limit = end - 32;
+            do
+            {
+                v1 = round(v1, read64(p)); v2 = round(v2, read64(p + 8));
+                v3 = round(v3, read64(p + 16)); v4 = round(v4, read64(p + 24));
+                p += 32;
+            } while (p <= limit);
+            h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+            h = merge_round(h, v1); h = merge_round(h, v2);
+            h = merge_round(h, v3); h = merge_round(h, v4);
+        }
+        else
+            h = seed + P5;
+        h += size;
+        for (; p + 8 <= end; p += 8)
+            h = rotl(h ^ round(0, read64(p)), 27)*P1 + P4;
+        if (p + 4 <= end)
+        {
+            h = rotl(h ^ (uint64_t(read32(p))*P1), 23)*P2 + P3;
+            p += 4;
+        }
+        for (; p < end; p++)
+            h = rotl(h ^ (*p * P5), 11)*P1;
+        h ^= h >> 33; h *= P2;
+        h ^= h >> 29; h *= P3;
+        h ^= h >> 32;
+        return h;
+    }
+}
+#endif
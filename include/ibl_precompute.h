@@ -0,0 +1,413 @@
+#ifndef IBL_PRECOMPUTE
+#define IBL_PRECOMPUTE
+
+#include "stb_image.h"
+#include "hash.h"
+#include "cubemap_utils.h"
+#include "job_system.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+//CPU precomputation of image based lighting from an environment cube map :
+//  - 9 spherical harmonic coefficients of the irradiance, for diffuse lighting
+//  - a GGX prefiltered radiance mip chain, one roughness per level, for specular lighting
+//  - the split sum BRDF lookup table (scale, bias to F0) indexed by (NdotV, roughness)
+//nothing here touches GL, uploading the results is left to gen_ibl_textures().
+namespace ibl
+{
+    using cubemap::cube_image;
+    using cubemap::PI;
+
+    struct ibl_settings
+    {
+        int specular_size = 128;        //face size of the sharpest prefiltered level
+        int specular_levels = 6;        //roughness 0 at level 0 to roughness 1 at the last level
+        int specular_samples = 128;     //GGX samples per prefiltered texel
+        int lut_size = 64;
+        int lut_samples = 256;
+    };
+    struct ibl_data
+    {
+        float sh[9][3];                 //irradiance (already convolved with the cosine lobe), RGB
+        std::vector<cube_image> specular;
+        int lut_size = 0;
+        std::vector<float> brdf_lut;    //RG pairs, row = roughness, column = NdotV
+    };
+
+    namespace detail
+    {
+        inline float radical_inverse(uint32_t bits)
+        {
+            bits = (bits << 16u) | (bits >> 16u);
+            bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+            bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+            bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+            bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+            return float(bits) * 2.3283064365386963e-10f;
+        }
+        //GGX half vector around +Z for the Hammersley point (i, count), alpha = roughness^2
+        inline void importance_sample_ggx(int i, int count, float alpha, float* h)
+        {
+            const float phi = 2.0f*PI*(i + 0.5f)/count;
+            const float xi = radical_inverse(uint32_t(i));
+            const float cos_theta = std::sqrt((1.0f - xi)/(1.0f + (alpha*alpha - 1.0f)*xi));
+            const float sin_theta = std::sqrt(1.0f - cos_theta*cos_theta);
+            h[0] = sin_theta*std::cos(phi);
+            h[1] = sin_theta*std::sin(phi);
+            h[2] = cos_theta;
+        }
+        inline float ggx_distribution(float n_dot_h, float alpha)
+        {
+            const float a2 = alpha*alpha;
+            const float d = n_dot_h*n_dot_h*(a2 - 1.0f) + 1.0f;
+            return a2/(PI*d*d);
+        }
+        //orthonormal basis around n
+        inline void tangent_frame(const float* n, float* t, float* b)
+        {
+            const float up[3] = {std::fabs(n[2]) < 0.999f ? 0.0f : 1.0f, 0.0f, std::fabs(n[2]) < 0.999f ? 1.0f : 0.0f};
+            t[0] = up[1]*n[2] - up[2]*n[1]; t[1] = up[2]*n[0] - up[0]*n[2]; t[2] = up[0]*n[1] - up[1]*n[0];
+            const float length = std::sqrt(t[0]*t[0] + t[1]*t[1] + t[2]*t[2]);
+            t[0] /= length; t[1] /= length; t[2] /= length;
+            b[0] = n[1]*t[2] - n[2]*t[1]; b[1] = n[2]*t[0] - n[0]*t[2]; b[2] = n[0]*t[1] - n[1]*t[0];
+        }
+        //unit direction through the centre of texel (x, y), and the solid angle that texel covers
+        inline float texel_direction(int face, int x, int y, int size, float* d)
+        {
+            const float sc = (x + 0.5f)*2.0f/size - 1.0f, tc = (y + 0.5f)*2.0f/size - 1.0f;
+            cubemap::face_direction(face, sc, tc, d[0], d[1], d[2]);
+            const float length2 = d[0]*d[0] + d[1]*d[1] + d[2]*d[2];
+            const float inv_length = 1.0f/std::sqrt(length2);
+            d[0] *= inv_length; d[1] *= inv_length; d[2] *= inv_length;
+            return (4.0f/(float(size)*size))*inv_length/length2;
+        }
+        inline void sh_basis(const float* d, float* y)
+        {
+            y[0] = 0.282095f;
+            y[1] = 0.488603f*d[1];
+            y[2] = 0.488603f*d[2];
+            y[3] = 0.488603f*d[0];
+            y[4] = 1.092548f*d[0]*d[1];
+            y[5] = 1.092548f*d[1]*d[2];
+            y[6] = 0.315392f*(3.0f*d[2]*d[2] - 1.0f);
+            y[7] = 1.092548f*d[0]*d[2];
+            y[8] = 0.546274f*(d[0]*d[0] - d[1]*d[1]);
+        }
+    }
+
+    //projects the radiance onto the first 9 SH bands, one job per face, then applies the cosine lobe
+    //convolution (Ramamoorthi & Hanrahan 2001) so the coefficients evaluate straight to irradiance.
+    void project_irradiance_sh(const cube_image &radiance, float sh[9][3])
+    {
+        double partial[6][9][3] = {};
+        jobs::parallel_for(6, [&](size_t face)
+        {
+            for (int y = 0; y < radiance.size; y++)
+                for (int x = 0; x < radiance.size; x++)
+                {
+                    float d[3], basis[9];
+                    const float solid_angle = detail::texel_direction(int(face), x, y, radiance.size, d);
+                    detail::sh_basis(d, basis);
+                    const float* texel = radiance.texel(int(face), x, y);
+                    for (int i = 0; i < 9; i++)
+                        for (int c = 0; c < 3; c++)
+                            partial[face][i][c] += texel[c]*basis[i]*solid_angle;
+                }
+        });
+        const float band_factor[9] = {PI, 2.0f*PI/3.0f, 2.0f*PI/3.0f, 2.0f*PI/3.0f, PI/4.0f, PI/4.0f, PI/4.0f, PI/4.0f, PI/4.0f};
+        for (int i = 0; i < 9; i++)
+            for (int c = 0; c < 3; c++)
+            {
+                double sum = 0.0;
+                for (int face = 0; face < 6; face++)
+                    sum += partial[face][i][c];
+                sh[i][c] = float(sum)*band_factor[i];
+            }
+    }
+    //evaluates irradiance SH along the unit direction d
+    void evaluate_sh(const float sh[9][3], const float* d, float* out)
+    {
+        float basis[9];
+        detail::sh_basis(d, basis);
+        out[0] = out[1] = out[2] = 0.0f;
+        for (int i = 0; i < 9; i++)
+            for (int c = 0; c < 3; c++)
+                out[c] += sh[i][c]*basis[i];
+    }
+
+    //GGX prefiltering with the N = V = R approximation (Karis 2013). each sample reads the source mip whose
+    //texel solid angle matches the sample's, which keeps the result free of fireflies at low sample counts.
+    //source_mips[0] is the full resolution radiance, every following entry half the size of the previous one.
+    std::vector<cube_image> prefilter_specular(const std::vector<cube_image> &source_mips, const ibl_settings &settings)
+    {
+        std::vector<cube_image> levels(settings.specular_levels);
+        for (int level = 0; level < settings.specular_levels; level++)
+            levels[level].resize(std::max(1, settings.specular_size >> level));
+
+        struct task {int level, face;};
+        std::vector<task> tasks;
+        for (int level = 0; level < settings.specular_levels; level++)
+            for (int face = 0; face < 6; face++)
+                tasks.push_back({level, face});
+
+        const float source_texel_solid_angle = 4.0f*PI/(6.0f*source_mips[0].size*source_mips[0].size);
+        jobs::parallel_for(tasks.size(), [&](size_t j)
+        {
+            const int level = tasks[j].level, face = tasks[j].face;
+            cube_image &out = levels[level];
+            const float roughness = settings.specular_levels > 1 ? float(level)/(settings.specular_levels - 1) : 0.0f;
+            const float alpha = roughness*roughness;
+            for (int y = 0; y < out.size; y++)
+                for (int x = 0; x < out.size; x++)
+                {
+                    float n[3], t[3], b[3];
+                    detail::texel_direction(face, x, y, out.size, n);
+                    float* result = out.texel(face, x, y);
+                    if (level == 0 || roughness == 0.0f)
+                    {   //a mirror reflection is the environment itself
+                        size_t mip = 0;
+                        while (mip + 1 < source_mips.size() && source_mips[mip].size > out.size)
+                            mip++;
+                        source_mips[mip].sample(n[0], n[1], n[2], result);
+                        continue;
+                    }
+                    detail::tangent_frame(n, t, b);
+                    float sum[3] = {0.0f, 0.0f, 0.0f}, weight = 0.0f;
+                    for (int s = 0; s < settings.specular_samples; s++)
+                    {
+                        float h_tangent[3];
+                        detail::importance_sample_ggx(s, settings.specular_samples, alpha, h_tangent);
+                        float h[3];
+                        for (int c = 0; c < 3; c++)
+                            h[c] = t[c]*h_tangent[0] + b[c]*h_tangent[1] + n[c]*h_tangent[2];
+                        const float n_dot_h = h_tangent[2];
+                        float l[3];
+                        for (int c = 0; c < 3; c++)
+                            l[c] = 2.0f*n_dot_h*h[c] - n[c];
+                        const float n_dot_l = l[0]*n[0] + l[1]*n[1] + l[2]*n[2];
+                        if (n_dot_l <= 0.0f)
+                            continue;
+                        const float pdf = detail::ggx_distribution(n_dot_h, alpha)/4.0f;
+                        const float sample_solid_angle = 1.0f/(settings.specular_samples*pdf + 1e-4f);
+                        const float lod = std::max(0.5f*std::log2(sample_solid_angle/source_texel_solid_angle) + 1.0f, 0.0f);
+                        const size_t mip = std::min(size_t(lod + 0.5f), source_mips.size() - 1);
+                        float radiance[3];
+                        source_mips[mip].sample(l[0], l[1], l[2], radiance);
+                        for (int c = 0; c < 3; c++)
+                            sum[c] += radiance[c]*n_dot_l;
+                        weight += n_dot_l;
+                    }
+                    for (int c = 0; c < 3; c++)
+                        result[c] = sum[c]/std::max(weight, 1e-6f);
+                }
+        });
+        return levels;
+    }
+
+    //split sum environment BRDF, one job per roughness row
+    std::vector<float> integrate_brdf_lut(int size, int samples)
+    {
+        std::vector<float> lut(size_t(size)*size*2);
+        jobs::parallel_for(size, [&](size_t row)
+        {
+            const float roughness = (row + 0.5f)/size;
+            const float alpha = roughness*roughness;
+            const float k = alpha/2.0f;    //Schlick-GGX k for image based lighting
+            for (int column = 0; column < size; column++)
+            {
+                const float n_dot_v = (column + 0.5f)/size;
+                const float v[3] = {std::sqrt(1.0f - n_dot_v*n_dot_v), 0.0f, n_dot_v};
+                float scale = 0.0f, bias = 0.0f;
+                for (int s = 0; s < samples; s++)
+                {
+                    float h[3];
+                    detail::importance_sample_ggx(s, samples, alpha, h);
+                    const float v_dot_h = v[0]*h[0] + v[1]*h[1] + v[2]*h[2];
+                    const float l_z = 2.0f*v_dot_h*h[2] - v[2];
+                    const float n_dot_l = std::max(l_z, 0.0f);
+                    const float n_dot_h = std::max(h[2], 0.0f);
+                    if (n_dot_l <= 0.0f)
+                        continue;
+                    const float g = (n_dot_v/(n_dot_v*(1.0f - k) + k))*(n_dot_l/(n_dot_l*(1.0f - k) + k));
+                    const float g_visible = g*std::max(v_dot_h, 0.0f)/(n_dot_h*n_dot_v);
+                    const float fresnel = std::pow(1.0f - std::max(v_dot_h, 0.0f), 5.0f);
+                    scale += (1.0f - fresnel)*g_visible;
+                    bias += fresnel*g_visible;
+                }
+                lut[(row*size + column)*2 + 0] = scale/samples;
+                lut[(row*size + column)*2 + 1] = bias/samples;
+            }
+        });
+        return lut;
+    }
+
+    //runs the whole precompute for an environment. radiance is the full resolution environment.
+    ibl_data precompute(const cube_image &radiance, const ibl_settings &settings = ibl_settings())
+    {
+        std::vector<cube_image> source_mips{radiance};
+        while (source_mips.back().size > 1)
+            source_mips.push_back(source_mips.back().downsample());
+        ibl_data data;
+        //a 32px face already resolves every feature 9 SH coefficients can represent
+        size_t sh_mip = 0;
+        while (sh_mip + 1 < source_mips.size() && source_mips[sh_mip].size > 32)
+            sh_mip++;
+        project_irradiance_sh(source_mips[sh_mip], data.sh);
+        data.specular = prefilter_specular(source_mips, settings);
+        data.lut_size = settings.lut_size;
+        data.brdf_lut = integrate_brdf_lut(settings.lut_size, settings.lut_samples);
+        return data;
+    }
+
+    //decodes six LDR faces (ordered +X, -X, +Y, -Y, +Z, -Z) into linear radiance, in parallel.
+    bool load_faces(const std::vector<std::string> &file_paths, cube_image &radiance)
+    {
+        if (file_paths.size() != 6)
+            return false;
+        stbi_set_flip_vertically_on_load(false);
+        stbi_ldr_to_hdr_gamma(2.2f);
+        float* faces[6] = {};
+        int sizes[6][2] = {};
+        jobs::parallel_for(6, [&](size_t i)
+        {
+            int nr_channels;
+            faces[i] = stbi_loadf(file_paths[i].c_str(), &sizes[i][0], &sizes[i][1], &nr_channels, 3);
+        });
+        bool success = true;
+        for (int i = 0; i < 6; i++)
+            if (!faces[i] || sizes[i][0] != sizes[0][0] || sizes[i][1] != sizes[0][0])
+            {
+                std::cerr << "reading environment face failed : " << file_paths[i] << std::endl;
+                success = false;
+            }
+        if (success)
+        {
+            radiance.resize(sizes[0][0]);
+            for (int i = 0; i < 6; i++)
+                std::copy(faces[i], faces[i] + radiance.faces[i].size(), radiance.faces[i].begin());
+        }
+        for (float* face : faces)
+            stbi_image_free(face);
+        return success;
+    }
+    //resamples an equirectangular HDR image into a face_size cube.
+    bool load_equirect(const std::string &file_path, int face_size, cube_image &radiance)
+    {
+        stbi_set_flip_vertically_on_load(false);
+        int width, height, nr_channels;
+        float* image = stbi_loadf(file_path.c_str(), &width, &height, &nr_channels, 3);
+        if (!image)
+        {
+            std::cerr << "reading environment failed : " << file_path << std::endl;
+            return false;
+        }
+        radiance.size = face_size;
+        jobs::parallel_for(6, [&](size_t face)
+        {
+            cubemap::equirect_to_face(image, width, height, int(face), face_size, radiance.faces[face]);
+        });
+        stbi_image_free(image);
+        return true;
+    }
+
+    //on disk cache. the key covers the source file contents and every setting that changes the output.
+    namespace cache
+    {
+        constexpr uint32_t MAGIC = 0x314C4249;  //"IBL1"
+        constexpr uint32_t VERSION = 1;
+
+        uint64_t key(const std::vector<std::string> &source_paths, const ibl_settings &settings)
+        {
+            uint64_t h = resources::hash_bytes(&settings, sizeof(settings), VERSION);
+            for (const std::string &path : source_paths)
+            {
+                std::ifstream reader(path, std::ios::binary);
+                std::vector<char> bytes((std::istreambuf_iterator<char>(reader)), std::istreambuf_iterator<char>());
+                h = resources::hash_bytes(bytes.data(), bytes.size(), h);
+            }
+            return h;
+        }
+        std::string path(const std::string &cache_dir, uint64_t key)
+        {
+            char name[32];
+            snprintf(name, sizeof(name), "ibl_%016llx.bin", (unsigned long long)key);
+            return (std::filesystem::path(cache_dir)/name).string();
+        }
+        bool save(const std::string &file_path, const ibl_data &data)
+        {
+            std::error_code error;
+            std::filesystem::create_directories(std::filesystem::path(file_path).parent_path(), error);
+            std::ofstream writer(file_path, std::ios::binary);
+            if (!writer)
+                return false;
+            const uint32_t header[4] = {MAGIC, VERSION, uint32_t(data.specular.size()), uint32_t(data.lut_size)};
+            writer.write(reinterpret_cast<const char*>(header), sizeof(header));
+            writer.write(reinterpret_cast<const char*>(data.sh), sizeof(data.sh));
+            for (const cube_image &level : data.specular)
+            {
+                const int32_t size = level.size;
+                writer.write(reinterpret_cast<const char*>(&size), sizeof(size));
+                for (const auto &face : level.faces)
+                    writer.write(reinterpret_cast<const char*>(face.data()), face.size()*sizeof(float));
+            }
+            writer.write(reinterpret_cast<const char*>(data.brdf_lut.data()), data.brdf_lut.size()*sizeof(float));
+            return bool(writer);
+        }
+        //fails on a file that does not hold exactly what precompute(settings) makes, before sizing anything by it
+        bool load(const std::string &file_path, ibl_data &data, const ibl_settings &settings)
+        {
+            std::ifstream reader(file_path, std::ios::binary);
+            uint32_t header[4];
+            if (!reader || !reader.read(reinterpret_cast<char*>(header), sizeof(header)) || header[0] != MAGIC || header[1] != VERSION)
+                return false;
+            if (header[2] != uint32_t(settings.specular_levels) || header[3] != uint32_t(settings.lut_size))
+                return false;
+            reader.read(reinterpret_cast<char*>(data.sh), sizeof(data.sh));
+            data.specular.resize(header[2]);
+            for (size_t i = 0; i < data.specular.size(); i++)
+            {
+                cube_image &level = data.specular[i];
+                int32_t size = 0;
+                reader.read(reinterpret_cast<char*>(&size), sizeof(size));
+                if (!reader || size != std::max(1, settings.specular_size >> i))
+                    return false;
+                level.resize(size);
+                for (auto &face : level.faces)
+                    reader.read(reinterpret_cast<char*>(face.data()), face.size()*sizeof(float));
+            }
+            data.lut_size = int(header[3]);
+            data.brdf_lut.resize(size_t(data.lut_size)*data.lut_size*2);
+            reader.read(reinterpret_cast<char*>(data.brdf_lut.data()), data.brdf_lut.size()*sizeof(float));
+            return bool(reader);
+        }
+    }
+
+    //cached precompute from six environment faces. results are reused until a face file or a setting changes.
+    bool prepare(const std::vector<std::string> &face_paths, const std::string &cache_dir, ibl_data &data,
+    const ibl_settings &settings = ibl_settings())
+    {
+        const std::string cache_path = cache::path(cache_dir, cache::key(face_paths, settings));
+        if (cache::load(cache_path, data, settings))
+        {
+            std::cout << "Loaded image based lighting : " << cache_path << std::endl;
+            return true;
+        }
+        cube_image radiance;
+        if (!load_faces(face_paths, radiance))
+            return false;
+        data = precompute(radiance, settings);
+        if (!cache::save(cache_path, data))
+            std::cerr << "writing image based lighting cache failed : " << cache_path << std::endl;
+        return true;
+    }
+}
+#endif
@@ -0,0 +1,420 @@
+#ifndef JOB_SYSTEM
+#define JOB_SYSTEM
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+//work stealing job system, the engine's one pool of worker threads. every worker owns a Chase-Lev deque (Chase and Lev,
+//Dynamic Circular Work-Stealing Deque, 2005, with the memory orders of Le et al. 2013): it pushes and pops jobs at
+//the bottom, idle workers steal from the top of the others. the thread that first submits becomes worker 0, usually
+//the main thread; it only runs jobs while it waits on a counter, so waiting never blocks on work it could do itself.
+//it can hand that place to another thread with release() and adopt(). other threads may submit and wait too, their
+//jobs go through a shared queue. jobs must not call GL, any worker may
+//run them.
+namespace jobs
+{
+    //the number of unfinished jobs submitted against it. wait() until it is done.
+    class counter
+    {
+        friend class scheduler;
+        std::atomic<int> pending{0};
+    public:
+        bool done() const {return pending.load(std::memory_order_acquire) == 0;}
+    };
+
+    struct job
+    {
+        static constexpr size_t PAYLOAD_SIZE = 48;  //callables up to this size are stored inline, larger ones on the heap
+        void (*run)(job &self) = nullptr;           //calls the payload and destroys it
+        counter* done = nullptr;
+        std::atomic<bool> busy{false};              //a ring slot is only reused once its job finished
+        bool heap = false;
+        alignas(16) unsigned char payload[PAYLOAD_SIZE];
+
+        template <typename F>
+        void store(F &&fn)
+        {
+            typedef typename std::decay<F>::type function;
+            if constexpr (sizeof(function) <= PAYLOAD_SIZE && alignof(function) <= 16)
+            {
+                new (payload) function(std::forward<F>(fn));
+                run = [](job &self)
+                {
+                    function* stored = std::launder(reinterpret_cast<function*>(self.payload));
+                    (*stored)();
+                    stored->~function();
+                };
+            }
+            else
+            {
+                function* stored = new function(std::forward<F>(fn));
+                std::memcpy(payload, &stored, sizeof(stored));
+                run = [](job &self)
+                {
+                    function* stored;
+                    std::memcpy(&stored, self.payload, sizeof(stored));
+                    (*stored)();
+                    delete stored;
+                };
+            }
+        }
+    };
+
+    //fixed capacity Chase-Lev deque of job pointers. push() and pop() only from the owning worker, steal() from any thread.
+    class work_deque
+    {
+    public:
+        static constexpr int64_t CAPACITY = 4096;
+    private:
+        alignas(64) std::atomic<int64_t> top{0};
+        alignas(64) std::atomic<int64_t> bottom{0};
+        std::unique_ptr<std::atomic<job*>[]> slots{new std::atomic<job*>[CAPACITY]};
+    public:
+        //false when full, the caller then runs the job itself
+        bool push(job* item)
+        {
+            const int64_t b = bottom.load(std::memory_order_relaxed), t = top.load(std::memory_order_acquire);
+            if (b - t >= CAPACITY)
+                return false;
+            slots[b & (CAPACITY - 1)].store(item, std::memory_order_relaxed);
+            bottom.store(b + 1, std::memory_order_release);     //publishes the job to thieves
+            return true;
+        }
+        //the newest job, nullptr when empty
+        job* pop()
+        {
+            const int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+            bottom.store(b, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t t = top.load(std::memory_order_relaxed);
+            if (t > b)
+            {
+                bottom.store(b + 1, std::memory_order_relaxed);
+                return nullptr;
+            }
+            job* item = slots[b & (CAPACITY - 1)].load(std::memory_order_relaxed);
+            if (t == b)
+            {   //the last job, a thief may be taking it at the same time
+                if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                    item = nullptr;
+                bottom.store(b + 1, std::memory_order_relaxed);
+            }
+            return item;
+        }
+        //the oldest job, nullptr when empty or lost to another thief
+        job* steal()
+        {
+            int64_t t = top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            const int64_t b = bottom.load(std::memory_order_acquire);
+            if (t >= b)
+                return nullptr;
+            job* item = slots[t & (CAPACITY - 1)].load(std::memory_order_relaxed);
+            if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                return nullptr;
+            return item;
+        }
+        bool empty() const {return bottom.load(std::memory_order_relaxed) <= top.load(std::memory_order_relaxed);}
+    };
+
+    class scheduler
+    {
+    public:
+        struct statistics
+        {
+            size_t executed = 0;    //jobs run, by any thread
+            size_t stolen = 0;      //of them taken from another worker's deque
+            size_t inline_runs = 0; //run at submission because the deque or the job ring was full
+        };
+        static constexpr size_t RING_SIZE = 4096;   //jobs a worker can have in flight before it runs new ones inline
+        static constexpr int SPIN_ROUNDS = 64;      //failed searches for work before a worker sleeps
+    private:
+        struct worker
+        {
+            work_deque queue;
+            std::unique_ptr<job[]> ring{new job[RING_SIZE]};
+            size_t next_job = 0;
+            std::atomic<size_t> executed{0}, stolen{0}, inline_runs{0};
+        };
+        std::vector<std::unique_ptr<worker>> workers;
+        std::vector<std::thread> threads;
+        std::mutex shared_lock;
+        std::deque<job*> shared_queue;      //jobs of threads that are not workers
+        std::atomic<size_t> shared_count{0};
+        std::mutex sleep_lock;
+        std::condition_variable wake;
+        std::atomic<int> sleepers{0};
+        std::atomic<uint64_t> epoch{0};     //advanced by every submission, so a worker going to sleep notices new jobs
+        std::atomic<bool> running{false};
+        std::once_flag started;
+        std::atomic<bool> vacant{false};    //worker 0's place was released and no thread holds it
+        size_t requested_threads = 0;
+
+        struct thread_identity
+        {
+            const scheduler* owner = nullptr;
+            int index = -1;
+            uint32_t random = 0;    //victim choice, every thread its own
+        };
+        static thread_identity& identity()
+        {
+            static thread_local thread_identity current;
+            return current;
+        }
+        int worker_index() const {return identity().owner == this ? identity().index : -1;}
+
+        void execute(job &item)
+        {
+            counter* done = item.done;
+            item.run(item);
+            if (item.heap)
+                delete &item;
+            else
+                item.busy.store(false, std::memory_order_release);
+            if (done)
+                done->pending.fetch_sub(1, std::memory_order_acq_rel);
+        }
+        job* steal(int self)
+        {
+            const int count = int(workers.size());
+            uint32_t &random = identity().random;
+            if (random == 0)    //xorshift never leaves 0, seed it from the thread
+                random = uint32_t(std::hash<std::thread::id>()(std::this_thread::get_id())) | 1u;
+            random ^= random << 13;
+            random ^= random >> 17;
+            random ^= random << 5;
+            for (int k = 0; k < count; k++)
+            {
+                const int victim = int((random + k)%count);
+                if (victim == self)
+                    continue;
+                if (job* item = workers[victim]->queue.steal())
+                {
+                    if (self >= 0)
+                        workers[self]->stolen.fetch_add(1, std::memory_order_relaxed);
+                    return item;
+                }
+            }
+            return nullptr;
+        }
+        job* take_shared()
+        {
+            if (shared_count.load(std::memory_order_acquire) == 0)
+                return nullptr;
+            std::lock_guard<std::mutex> guard(shared_lock);
+            if (shared_queue.empty())
+                return nullptr;
+            job* item = shared_queue.front();
+            shared_queue.pop_front();
+            shared_count.fetch_sub(1, std::memory_order_release);
+            return item;
+        }
+        //runs one job from the own deque, another worker's or the shared queue. false if there was none.
+        bool run_one(int self)
+        {
+            job* item = self >= 0 ? workers[self]->queue.pop() : nullptr;
+            if (!item)
+                item = steal(self);
+            if (!item)
+                item = take_shared();
+            if (!item)
+                return false;
+            execute(*item);
+            workers[std::max(self, 0)]->executed.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+        void notify()
+        {
+            epoch.fetch_add(1, std::memory_order_seq_cst);
+            if (sleepers.load(std::memory_order_seq_cst) > 0)
+            {
+                std::lock_guard<std::mutex> guard(sleep_lock);
+                wake.notify_one();
+            }
+        }
+        void work(int index)
+        {
+            identity() = {this, index};
+            while (running.load(std::memory_order_acquire))
+            {
+                const uint64_t seen = epoch.load(std::memory_order_seq_cst);
+                bool found = false;
+                for (int round = 0; round < SPIN_ROUNDS && !found; round++)
+                    if (!(found = run_one(index)))
+                        std::this_thread::yield();
+                if (found)
+                    continue;
+                std::unique_lock<std::mutex> lock(sleep_lock);
+                sleepers.fetch_add(1, std::memory_order_seq_cst);
+                wake.wait(lock, [&]() {return epoch.load(std::memory_order_seq_cst) != seen || !running.load(std::memory_order_acquire);});
+                sleepers.fetch_sub(1, std::memory_order_seq_cst);
+            }
+        }
+        void start()
+        {
+            std::call_once(started, [this]()
+            {
+                const size_t count = requested_threads ? requested_threads : std::max(1u, std::thread::hardware_concurrency());
+                for (size_t i = 0; i < count; i++)
+                    workers.emplace_back(new worker);
+                identity().owner = this;
+                identity().index = 0;     //the starting thread is worker 0 and runs jobs while it waits
+                running.store(true, std::memory_order_release);
+                for (size_t i = 1; i < count; i++)
+                    threads.emplace_back(&scheduler::work, this, int(i));
+            });
+        }
+    public:
+        //threads = 0 uses every hardware thread. the workers start with the first submission.
+        explicit scheduler(size_t threads = 0) : requested_threads(threads) {}
+        ~scheduler()
+        {
+            running.store(false, std::memory_order_release);
+            {
+                std::lock_guard<std::mutex> guard(sleep_lock);
+                wake.notify_all();
+            }
+            for (std::thread &thread : threads)
+                thread.join();
+        }
+        scheduler(const scheduler&) = delete;
+        scheduler& operator=(const scheduler&) = delete;
+
+        //queues fn() to run on any worker. done, if given, counts it until it finished.
+        template <typename F>
+        void submit(F &&fn, counter* done = nullptr)
+        {
+            start();
+            if (done)
+                done->pending.fetch_add(1, std::memory_order_relaxed);
+            const int self = worker_index();
+            if (self < 0)
+            {
+                job* item = new job;
+                item->heap = true;
+                item->done = done;
+                item->store(std::forward<F>(fn));
+                {
+                    std::lock_guard<std::mutex> guard(shared_lock);
+                    shared_queue.push_back(item);
+                    shared_count.fetch_add(1, std::memory_order_release);
+                }
+                notify();
+                return;
+            }
+            worker &own = *workers[self];
+            job &item = own.ring[own.next_job++ & (RING_SIZE - 1)];
+            if (item.busy.load(std::memory_order_acquire))
+            {   //the ring wrapped onto a job still running or queued, this one runs now instead
+                own.inline_runs.fetch_add(1, std::memory_order_relaxed);
+                own.next_job--;
+                fn();
+                if (done)
+                    done->pending.fetch_sub(1, std::memory_order_acq_rel);
+                return;
+            }
+            item.busy.store(true, std::memory_order_relaxed);
+            item.done = done;
+            item.store(std::forward<F>(fn));
+            if (!own.queue.push(&item))
+            {
+                own.inline_runs.fetch_add(1, std::memory_order_relaxed);
+                execute(item);
+                return;
+            }
+            notify();
+        }
+        //returns once every job counted by done has finished, running queued jobs meanwhile
+        void wait(const counter &done)
+        {
+            const int self = worker_index();
+            while (!done.done())
+                if (!run_one(self))
+                    std::this_thread::yield();
+        }
+        //runs fn(i) for every i in [0, count) across the workers, grain indices at a time, and returns when all ran.
+        //the indices are handed out from a shared position, so iterations of uneven cost still balance.
+        template <typename F>
+        void parallel_for(size_t count, F fn, size_t grain = 1)
+        {
+            if (count == 0)
+                return;
+            start();
+            grain = std::max<size_t>(grain, 1);
+            const size_t helpers = std::min(workers.size(), (count + grain - 1)/grain) - 1;
+            if (helpers == 0)
+            {
+                for (size_t i = 0; i < count; i++)
+                    fn(i);
+                return;
+            }
+            std::atomic<size_t> next(0);
+            auto batch = [&]()
+            {
+                for (size_t first; (first = next.fetch_add(grain, std::memory_order_relaxed)) < count;)
+                    for (size_t i = first, last = std::min(first + grain, count); i < last; i++)
+                        fn(i);
+            };
+            counter done;
+            for (size_t h = 0; h < helpers; h++)
+                submit([&batch]() {batch();}, &done);
+            batch();
+            wait(done);
+        }
+        //gives up the calling thread's place as worker 0, for the next thread calling adopt(). every job it submitted
+        //must have been waited for.
+        void release()
+        {
+            if (worker_index() != 0)
+                return;
+            identity().owner = nullptr;
+            identity().index = -1;
+            vacant.store(true, std::memory_order_release);
+        }
+        //makes the calling thread worker 0 if that place was released, or starts the workers with it. true if it is
+        //worker 0 afterwards, its jobs then skip the shared queue.
+        bool adopt()
+        {
+            start();
+            bool released = true;
+            if (worker_index() != 0 && vacant.compare_exchange_strong(released, false, std::memory_order_acq_rel))
+            {
+                identity().owner = this;
+                identity().index = 0;
+            }
+            return worker_index() == 0;
+        }
+        size_t thread_count() const {return workers.size();}
+        statistics stats() const
+        {
+            statistics total;
+            for (const std::unique_ptr<worker> &each : workers)
+            {
+                total.executed += each->executed.load(std::memory_order_relaxed);
+                total.stolen += each->stolen.load(std::memory_order_relaxed);
+                total.inline_runs += each->inline_runs.load(std::memory_order_relaxed);
+            }
+            return total;
+        }
+    };
+
+    scheduler pool;
+
+    template <typename F>
+    void submit(F &&fn, counter* done = nullptr) {pool.submit(std::forward<F>(fn), done);}
+    inline void wait(const counter &done) {pool.wait(done);}
+    template <typename F>
+    void parallel_for(size_t count, F fn, size_t grain = 1) {pool.parallel_for(count, std::move(fn), grain);}
+}
+#endif
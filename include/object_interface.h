@@ -2,19 +2,27 @@
 #define OBJECT_INTERFACE
 
 #define VS_TRNSFRM_MDL_NAME "model_transform"
+#define VS_PREVIOUS_TRNSFRM_MDL_NAME "previous_model_transform"  //last frame's, for motion vectors
 
 #define TINYOBJLOADER_IMPLEMENTATION ;
 #include "tiny_obj_loader.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
+#undef STB_IMAGE_IMPLEMENTATION //later includes of stb_image.h only need the declarations
 
 #include "glad/glad.h"
+#include "resource_registry.h"
+#include "texture_streaming.h"
+#include "cubemap_utils.h"
+#include "ibl_precompute.h"
+#include "command_buffer.h"
 
 #include "glm/glm.hpp"
 #include "glm/gtc/matrix_transform.hpp"
 #include "glm/gtc/type_ptr.hpp"
 
+#include <cmath>
 #include <iostream>
 #include <string>
 
@@ -49,7 +57,18 @@ namespace object_3D
             send_model_transform(program_id);
             set_samplers(program_id);
         }
+        //position only counterparts of bind_VAO() and gl_draw(), for drawables without a position stream these
+        //fall back to the full vertex layout
+        virtual void bind_position_VAO() const {bind_VAO();}
+        virtual void gl_draw_positions(const unsigned int &program_id) const {gl_draw(program_id);}
+        //command buffer counterparts of send_model_transform() with set_samplers(), and of bind_VAO() with gl_draw()
+        //for parts [first, last). they only append to out, so any thread can record them.
+        virtual void record_uniforms(commands::command_buffer &out) const = 0;
+        virtual void record_parts(commands::command_buffer &out, size_t first, size_t last) const = 0;
     public:
+        //set before send_data() to also upload a tightly packed copy of the positions into a buffer of its own
+        bool position_stream = false;
+
         //generates VAO(s) and/or sends buffer data.
         virtual void send_data() = 0;
 
@@ -61,12 +80,59 @@ namespace object_3D
             gl_draw(program_id);
             glBindVertexArray(0);
         }
+        //draws with only the positions at attribute 0, for depth only passes. no samplers are set.
+        virtual void draw_positions(const unsigned int &program_id) const final
+        {
+            glUseProgram(program_id);
+            send_model_transform(program_id);
+            bind_position_VAO();
+            gl_draw_positions(program_id);
+            glBindVertexArray(0);
+        }
+        //the draw calls draw() makes. record() can record any range of them, so the parts of one drawable can be
+        //recorded by several threads.
+        virtual size_t parts() const {return 1;}
+        //records what draw() does for parts [first_part, last_part) into out, for commands::replay() on the GL thread
+        virtual void record(commands::command_buffer &out, unsigned int program_id, size_t first_part = 0, size_t last_part = SIZE_MAX) const final
+        {
+            out.use_program(program_id);
+            record_uniforms(out);
+            record_parts(out, first_part, std::min(last_part, parts()));
+        }
     };
+    //the uniforms drawables set, interned once for the command buffers
+    struct uniform_ids
+    {
+        commands::uniform_name model_transform, previous_model_transform;
+        commands::uniform_name diffuse_maps[commands::MAX_TEXTURE_UNITS], spec_maps[commands::MAX_TEXTURE_UNITS];
+        commands::uniform_name valid_diffuse_maps, valid_spec_maps, normal_map, cubemap;
+    };
+    inline const uniform_ids& uniform_names()
+    {
+        static const uniform_ids ids = []()
+        {
+            uniform_ids names;
+            names.model_transform = commands::intern(VS_TRNSFRM_MDL_NAME);
+            names.previous_model_transform = commands::intern(VS_PREVIOUS_TRNSFRM_MDL_NAME);
+            for (int i = 0; i < commands::MAX_TEXTURE_UNITS; i++)
+            {
+                names.diffuse_maps[i] = commands::intern("diffuse_maps[" + std::to_string(i) + "]");
+                names.spec_maps[i] = commands::intern("spec_maps[" + std::to_string(i) + "]");
+            }
+            names.valid_diffuse_maps = commands::intern("nr_valid_diffuse_maps");
+            names.valid_spec_maps = commands::intern("nr_valid_spec_maps");
+            names.normal_map = commands::intern("normal_map");
+            names.cubemap = commands::intern("cubemap");
+            return names;
+        }();
+        return ids;
+    }
 
     enum texture_type_option
     {
         DIFFUSE,
         SPECULAR,
+        NORMAL,
         CUBEMAP
     };
     struct texture
@@ -78,14 +144,21 @@ namespace object_3D
     {
         texture diffuse_map;
         texture spec_map;
+        texture normal_map;     //tangent space, linear
         texture cube_map;
-        material() {spec_map.type=SPECULAR, diffuse_map.type=DIFFUSE, cube_map.type=CUBEMAP;}
+        bool emissive = false;  //emissive materials skip lighting and show their diffuse map as is
+        float opacity = 1.0f;   //below 1 the material is drawn in the transparent pass, see transparency.h
+        float uv_density = 1.0f;    //texture repeats per model space unit across its faces, for texture streaming
+        material() {spec_map.type=SPECULAR, diffuse_map.type=DIFFUSE, normal_map.type=NORMAL, cube_map.type=CUBEMAP;}
     };
     
     class mesh : public drawable
     {
         unsigned int VAO_id;
+        unsigned int position_VAO_id = 0;
+        unsigned int EBO_id = 0;
         virtual void bind_VAO() const override { glBindVertexArray(VAO_id);}
+        virtual void bind_position_VAO() const override {glBindVertexArray(position_VAO_id ? position_VAO_id : VAO_id);}
         virtual void set_samplers(const unsigned int &program_id) const override{} //a mesh has no texture IDs
         virtual void send_model_transform(const unsigned int &program_id) const override
         {
@@ -94,10 +167,19 @@ namespace object_3D
         {
             glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
         }
+        virtual void record_uniforms(commands::command_buffer &out) const override {}
     public :
         vector<unsigned int> indices;
 
         mesh(){}
+        //public so the object owning the mesh can record it as one of its parts
+        virtual void record_parts(commands::command_buffer &out, size_t first, size_t last) const override
+        {
+            if (first >= last)
+                return;
+            out.bind_vertex_array(VAO_id);
+            out.draw_elements(GL_TRIANGLES, int(indices.size()));
+        }
 
         virtual void send_data()
         {   //glVertexAttribPointer will only have effect on the data sent by the last call to glBufferData
@@ -112,13 +194,31 @@ namespace object_3D
             glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(vertex), (void*)offsetof(vertex, tex_coords));
             glEnableVertexAttribArray(2);         
 
-            unsigned int EBO_id;
-            glGenBuffers(1, &EBO_id);
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO_id);
-            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+            //meshes with identical indices (e.g. the same model loaded twice) share one element buffer
+            EBO_id = resources::shared.acquire_buffer(GL_ELEMENT_ARRAY_BUFFER, &indices[0], indices.size() * sizeof(unsigned int));
 
             glBindVertexArray(0);
         }
+        //a second VAO reading only the object's packed positions, sharing the element buffer. call after send_data().
+        void send_position_data(unsigned int position_VBO_id)
+        {
+            glGenVertexArrays(1, &position_VAO_id);
+            glBindVertexArray(position_VAO_id);
+            glBindBuffer(GL_ARRAY_BUFFER, position_VBO_id);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vec3), (void*)0);
+            glEnableVertexAttribArray(0);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO_id);
+            glBindVertexArray(0);
+        }
+        //deletes the VAOs and hands the element buffer back to the registry
+        void release()
+        {
+            glDeleteVertexArrays(1, &VAO_id);
+            if (position_VAO_id)
+                glDeleteVertexArrays(1, &position_VAO_id);
+            resources::shared.release_buffer(EBO_id);
+            VAO_id = position_VAO_id = EBO_id = 0;
+        }
     };
     //holds an array of drawable meshes. Initialize with read_obj()
     class object : public drawable
@@ -127,44 +227,43 @@ namespace object_3D
         virtual void send_model_transform(const unsigned int &program_id) const override
         {
             glUniformMatrix4fv(glGetUniformLocation(program_id, VS_TRNSFRM_MDL_NAME), 1, GL_FALSE, value_ptr(model_transform));
+            glUniformMatrix4fv(glGetUniformLocation(program_id, VS_PREVIOUS_TRNSFRM_MDL_NAME), 1, GL_FALSE, value_ptr(previous_model_transform));
         }
+        //shaders only sample diffuse_maps[0], spec_maps[0] and normal_map, so only the first material's maps are bound,
+        //on units 0 to 2, well below commands::FIRST_RESERVED_UNIT.
         virtual void set_samplers(const unsigned int &program_id) const override
         {
-            int nr_diffuse = 0, nr_spec = 0;
-            int texture_unit_limit;
-            glGetIntegerv(GL_MAX_TEXTURE_IMAGE_UNITS, &texture_unit_limit);
-            for (size_t i = 0; i < materials.size(); i++)
+            if (materials.empty())
+                return;
+            const material &first = materials[0];
+            int unit = 0;
+            if (first.diffuse_map.id > 0)
             {
-                if (nr_diffuse + nr_spec > texture_unit_limit)
-                {
-                    break;
-                }
-                if (materials[i].diffuse_map.id > 0)
-                {
-                    string type = "diffuse_maps";
-                    string index = "["+std::to_string(nr_diffuse)+"]";
-                    glActiveTexture(GL_TEXTURE0 + nr_diffuse + nr_spec);
-                    glBindTexture(GL_TEXTURE_2D, materials[i].diffuse_map.id);
-                    glUniform1i(glGetUniformLocation(program_id, (type+index).c_str()), nr_diffuse + nr_spec);
-                    glUniform1i(glGetUniformLocation(program_id, "nr_valid_diffuse_maps"), ++nr_diffuse);
-                }
-                if (materials[i].spec_map.id > 0)
-                {
-                    string type = "spec_maps";
-                    string index = "["+std::to_string(nr_spec)+"]";
-                    glActiveTexture(GL_TEXTURE0 + nr_diffuse + nr_spec);
-                    glBindTexture(GL_TEXTURE_2D, materials[i].spec_map.id);
-                    glUniform1i(glGetUniformLocation(program_id, (type+index).c_str()), nr_diffuse + nr_spec);
-                    glUniform1i(glGetUniformLocation(program_id, "nr_valid_diffuse_maps"), ++nr_spec);
-                }
+                glActiveTexture(GL_TEXTURE0 + unit);
+                glBindTexture(GL_TEXTURE_2D, first.diffuse_map.id);
+                glUniform1i(glGetUniformLocation(program_id, "diffuse_maps[0]"), unit++);
+                glUniform1i(glGetUniformLocation(program_id, "nr_valid_diffuse_maps"), 1);
+            }
+            if (first.spec_map.id > 0)
+            {
+                glActiveTexture(GL_TEXTURE0 + unit);
+                glBindTexture(GL_TEXTURE_2D, first.spec_map.id);
+                glUniform1i(glGetUniformLocation(program_id, "spec_maps[0]"), unit++);
+                glUniform1i(glGetUniformLocation(program_id, "nr_valid_spec_maps"), 1);
+            }
+            if (first.normal_map.id > 0)
+            {
+                glActiveTexture(GL_TEXTURE0 + unit);
+                glBindTexture(GL_TEXTURE_2D, first.normal_map.id);
+                glUniform1i(glGetUniformLocation(program_id, "normal_map"), unit);
             }
         }
-        void send_vertex_data() const 
+        unsigned int VBO_id = 0;
+        unsigned int position_VBO_id = 0;
+        //leaves the vertex buffer bound so the meshes' VAOs pick it up
+        void send_vertex_data()
         {
-            unsigned int VBO_id;
-            glGenBuffers(1, &VBO_id);
-            glBindBuffer(GL_ARRAY_BUFFER, VBO_id);
-            glBufferData(GL_ARRAY_BUFFER, vertices.size()*sizeof(vertex), &vertices[0], GL_STATIC_DRAW);
+            VBO_id = resources::shared.acquire_buffer(GL_ARRAY_BUFFER, &vertices[0], vertices.size()*sizeof(vertex));
         }
         virtual void gl_draw(const unsigned int &program_id) const override
         {
@@ -173,12 +272,53 @@ namespace object_3D
                 mesh.draw(program_id);
             }
         }
+        virtual void gl_draw_positions(const unsigned int &program_id) const override
+        {
+            for (const mesh &part : meshes)
+                part.draw_positions(program_id);
+        }
+        virtual void record_uniforms(commands::command_buffer &out) const override
+        {
+            const uniform_ids &names = uniform_names();
+            out.uniform(names.model_transform, model_transform);
+            out.uniform(names.previous_model_transform, previous_model_transform);
+            if (materials.empty())
+                return;
+            //the same three units as set_samplers()
+            static_assert(3 <= commands::FIRST_RESERVED_UNIT);
+            const material &first = materials[0];
+            int unit = 0;
+            if (first.diffuse_map.id > 0)
+            {
+                out.bind_texture(unit, first.diffuse_map.id);
+                out.uniform(names.diffuse_maps[0], unit++);
+                out.uniform(names.valid_diffuse_maps, 1);
+            }
+            if (first.spec_map.id > 0)
+            {
+                out.bind_texture(unit, first.spec_map.id);
+                out.uniform(names.spec_maps[0], unit++);
+                out.uniform(names.valid_spec_maps, 1);
+            }
+            if (first.normal_map.id > 0)
+            {
+                out.bind_texture(unit, first.normal_map.id);
+                out.uniform(names.normal_map, unit);
+            }
+        }
+        virtual void record_parts(commands::command_buffer &out, size_t first, size_t last) const override
+        {
+            for (size_t i = first; i < last; i++)
+                meshes[i].record_parts(out, 0, 1);
+        }
     public:
-        object(){model_transform = mat4(1.0);}
+        object(){model_transform = previous_model_transform = mat4(1.0);}
+        virtual size_t parts() const override {return meshes.size();}
         vector<vertex> vertices;
         vector<mesh> meshes;
         vector<material> materials;
         mat4 model_transform;
+        mat4 previous_model_transform;  //copy model_transform here once a frame is drawn
 
         virtual void send_data() override
         {
@@ -187,6 +327,29 @@ namespace object_3D
             {
                 meshes[i].send_data();       
             }
+            if (!position_stream)
+                return;
+            vector<vec3> positions(vertices.size());
+            for (size_t i = 0; i < vertices.size(); i++)
+                positions[i] = vertices[i].pos_coords;
+            position_VBO_id = resources::shared.acquire_buffer(GL_ARRAY_BUFFER, &positions[0], positions.size()*sizeof(vec3));
+            for (mesh &part : meshes)
+                part.send_position_data(position_VBO_id);
+        }
+        //drops everything send_data() and read_obj() took from the registry, streamed textures included
+        void release()
+        {
+            for (mesh &part : meshes)
+                part.release();
+            resources::shared.release_buffer(VBO_id);
+            resources::shared.release_buffer(position_VBO_id);
+            VBO_id = position_VBO_id = 0;
+            for (material &mat : materials)
+                for (texture *map : {&mat.diffuse_map, &mat.spec_map, &mat.normal_map})
+                {
+                    resources::shared.release_texture(map->id);
+                    map->id = 0;
+                }
         }
     };
     
@@ -195,9 +358,11 @@ namespace object_3D
     {
         const float* const vertices;
         unsigned int VAO_id;
+        unsigned int position_VAO_id = 0;
         const size_t array_size;
         bool texture, normals;
         virtual void bind_VAO() const override {glBindVertexArray(VAO_id);}
+        virtual void bind_position_VAO() const override {glBindVertexArray(position_VAO_id ? position_VAO_id : VAO_id);}
         virtual void gl_draw(const unsigned int &program_id) const override
         {
             const size_t nr_floats = size_t(array_size/sizeof(float));
@@ -230,17 +395,64 @@ namespace object_3D
             {
                 glUniform1i(glGetUniformLocation(program_id, "spec_maps[0]"), 0);   //specular map points to diffuse map as fallback 
             }
+            if (textures.normal_map.id > 0)
+            {
+                glActiveTexture(GL_TEXTURE2);
+                glBindTexture(GL_TEXTURE_2D, textures.normal_map.id);
+                glUniform1i(glGetUniformLocation(program_id, "normal_map"), 2);
+            }
         }
         virtual void send_model_transform(const unsigned int &program_id) const
         {
             glUniformMatrix4fv(glGetUniformLocation(program_id, VS_TRNSFRM_MDL_NAME), 1, GL_FALSE, value_ptr(model_transform));
+            glUniformMatrix4fv(glGetUniformLocation(program_id, VS_PREVIOUS_TRNSFRM_MDL_NAME), 1, GL_FALSE, value_ptr(previous_model_transform));
+        }
+        virtual void record_uniforms(commands::command_buffer &out) const override
+        {
+            const uniform_ids &names = uniform_names();
+            out.uniform(names.model_transform, model_transform);
+            out.uniform(names.previous_model_transform, previous_model_transform);
+            if (cubemap)
+            {
+                out.bind_texture(0, textures.cube_map.id);
+                out.uniform(names.cubemap, 0);
+                return;
+            }
+            if (textures.diffuse_map.id > 0)
+            {
+                out.bind_texture(0, textures.diffuse_map.id);
+                out.uniform(names.diffuse_maps[0], 0);
+            }
+            if (textures.spec_map.id > 0)
+            {
+                const int texture_unit = textures.diffuse_map.id > 0;
+                out.bind_texture(texture_unit, textures.spec_map.id);
+                out.uniform(names.spec_maps[0], texture_unit);
+            }
+            else if (textures.diffuse_map.id > 0)
+                out.uniform(names.spec_maps[0], 0);     //specular map points to diffuse map as fallback
+            if (textures.normal_map.id > 0)
+            {
+                out.bind_texture(2, textures.normal_map.id);
+                out.uniform(names.normal_map, 2);
+            }
+        }
+        virtual void record_parts(commands::command_buffer &out, size_t first, size_t last) const override
+        {
+            if (first >= last)
+                return;
+            const size_t nr_floats = size_t(array_size/sizeof(float));
+            const unsigned int nr_floats_per_vertex = pos_dimension + (tex_dimension*texture) + (normals_dimension*normals);
+            out.bind_vertex_array(VAO_id);
+            out.draw_arrays(GL_TRIANGLES, 0, int(nr_floats/nr_floats_per_vertex));
         }
         public :
         array_drawable(const float* const vertices, const size_t array_byte_size, bool has_normal_coords = true, 
         bool has_texture_coords = true): vertices(vertices), array_size(array_byte_size), texture(has_texture_coords), 
-        normals(has_normal_coords), model_transform(mat4(1.0)) {}
+        normals(has_normal_coords), model_transform(mat4(1.0)), previous_model_transform(mat4(1.0)) {}
 
         mat4 model_transform;
+        mat4 previous_model_transform;  //copy model_transform here once a frame is drawn
         material textures;
         unsigned int pos_dimension = 3;
         unsigned int normals_dimension = 3;
@@ -265,12 +477,29 @@ namespace object_3D
             glEnableVertexAttribArray(2*texture);
         
             glBindVertexArray(0);
+            if (!position_stream)
+                return;
+            const size_t nr_vertices = array_size/(nr_floats_per_vertex*sizeof(float));
+            std::vector<float> positions(nr_vertices*pos_dimension);
+            for (size_t i = 0; i < nr_vertices; i++)
+                for (unsigned int j = 0; j < pos_dimension; j++)
+                    positions[i*pos_dimension + j] = vertices[i*nr_floats_per_vertex + j];
+            unsigned int position_VBO;
+            glGenBuffers(1, &position_VBO);
+            glBindBuffer(GL_ARRAY_BUFFER, position_VBO);
+            glBufferData(GL_ARRAY_BUFFER, positions.size()*sizeof(float), positions.data(), GL_STATIC_DRAW);
+            glGenVertexArrays(1, &position_VAO_id);
+            glBindVertexArray(position_VAO_id);
+            glVertexAttribPointer(0, pos_dimension, GL_FLOAT, GL_FALSE, pos_dimension*sizeof(float), (void*)0);
+            glEnableVertexAttribArray(0);
+            glBindVertexArray(0);
         }
     };
 }
 
 tinyobj::ObjReader obj_parser;
-bool read_obj(std::string path, object_3D::object &obj)
+//stream_textures loads the materials' textures through streaming::streamer instead of uploading every mip up front.
+bool read_obj(std::string path, object_3D::object &obj, bool stream_textures = false)
 {
     if (!obj_parser.ParseFromFile(path, tinyobj::ObjReaderConfig()))
     {
@@ -291,25 +520,17 @@ bool read_obj(std::string path, object_3D::object &obj)
     //build object vertex array
     std::vector<object_3D::vertex> &vertices = obj.vertices;
     vertices = std::vector<object_3D::vertex>(vertex_attribs.vertices.size()/3);
+    //the shape that last recorded each vertex, plus one. shapes sharing a vertex write it in turn, so this stays serial.
+    std::vector<size_t> recorded_by(vertices.size(), 0);
     for(size_t i = 0; i < shapes.size(); i++)
     {   
-        std::vector<unsigned int> recorded_indices;
         const std::vector<tinyobj::index_t> &raw_indices = shapes[i].mesh.indices;
         for (size_t j = 0; j < raw_indices.size(); j++)
         {
             const unsigned int vertex_index = raw_indices[j].vertex_index;
-            bool new_vertex = true;
-            for (size_t k = 0; k < recorded_indices.size(); k++) //is this vertex index recorded?
+            if (recorded_by[vertex_index] != i + 1)  //construct and record the vertex
             {
-                if(recorded_indices[k] == vertex_index) //vertex index is recorded
-                {
-                    new_vertex = false;
-                    break;
-                }
-            }
-            if (new_vertex)  //construct and record the vertex
-            {
-                recorded_indices.push_back(vertex_index);
+                recorded_by[vertex_index] = i + 1;
                 object_3D::vertex temp_vert;
 
                 temp_vert.pos_coords.x = vertex_attribs.vertices[3*vertex_index + 0];
@@ -335,40 +556,84 @@ bool read_obj(std::string path, object_3D::object &obj)
         }
     }
     
-    //get mesh indices
+    //get mesh indices, every shape's as a job
     std::vector<object_3D::mesh> &meshes = obj.meshes;
     meshes = std::vector<object_3D::mesh>(shapes.size());
-    for (size_t i = 0; i < shapes.size(); i++)
+    jobs::parallel_for(shapes.size(), [&](size_t i)
     {
         const std::vector<tinyobj::index_t> &indices = shapes[i].mesh.indices;
-        object_3D::mesh temp_mesh;
-        temp_mesh.indices = std::vector<unsigned int>(indices.size());
+        std::vector<unsigned int> &mesh_indices = meshes[i].indices;
+        mesh_indices = std::vector<unsigned int>(indices.size());
         for (size_t j = 0; j < indices.size(); j++)
         {
             //note that tinyobject.h takes care of offsetting the obj indices by 1 so we don't have to do it.
-            temp_mesh.indices[j] = indices[j].vertex_index;
+            mesh_indices[j] = indices[j].vertex_index;
         }
-        meshes[i] = temp_mesh;
-    }
+    });
 
     //get textures 
     std::vector<object_3D::material> &obj_materials = obj.materials;
     obj_materials = std::vector<object_3D::material>(materials.size());
+    //within this directory, we will search for the texture names
+    const std::string directory = path.substr(0, path.find_last_of("/\\")+1);
+    //decode every texture the registry will upload as jobs first, the loop below then only uploads
+    std::vector<std::string> texture_files;
+    for (const tinyobj::material_t &material : materials)
+    {
+        for (const std::string *file_name : {&material.diffuse_texname, &material.specular_texname})
+            if (!file_name->empty())
+                texture_files.push_back(directory+*file_name);
+        const std::string &normal_texname = material.normal_texname.empty() ? material.bump_texname : material.normal_texname;
+        if (!normal_texname.empty())
+            texture_files.push_back(directory+normal_texname);
+    }
+    resources::shared.decode_ahead(texture_files);
+    //every material's UV density : the square root of its faces' texture coordinate area over their model space area
+    std::vector<double> uv_area(materials.size(), 0.0), model_area(materials.size(), 0.0);
+    for (const tinyobj::shape_t &shape : shapes)
+        for (size_t face = 0; face < shape.mesh.material_ids.size() && 3*face + 2 < shape.mesh.indices.size(); face++)
+        {
+            const int material_id = shape.mesh.material_ids[face];
+            const tinyobj::index_t* corners = &shape.mesh.indices[3*face];
+            if (material_id < 0 || material_id >= int(materials.size()) || corners[0].texcoord_index < 0 || corners[1].texcoord_index < 0 || corners[2].texcoord_index < 0)
+                continue;
+            glm::vec3 positions[3];
+            glm::vec2 uvs[3];
+            for (int c = 0; c < 3; c++)
+            {
+                positions[c] = glm::make_vec3(&vertex_attribs.vertices[3*corners[c].vertex_index]);
+                uvs[c] = glm::make_vec2(&vertex_attribs.texcoords[2*corners[c].texcoord_index]);
+            }
+            const glm::vec2 uv_u = uvs[1] - uvs[0], uv_v = uvs[2] - uvs[0];
+            uv_area[material_id] += 0.5*std::abs(uv_u.x*uv_v.y - uv_u.y*uv_v.x);
+            model_area[material_id] += 0.5*glm::length(glm::cross(positions[1] - positions[0], positions[2] - positions[0]));
+        }
     for (size_t i = 0; i < materials.size(); i++)
     {
-        //within this directory, we will search for the texture names
-        const std::string directory = path.substr(0, path.find_last_of("/\\")+1);
-
-        std::string file_name = materials[i].diffuse_texname;
-        gen_texture((directory+file_name).c_str(), obj_materials[i].diffuse_map.id);
-        
-        file_name = materials[i].specular_texname;
-        gen_texture((directory+file_name).c_str(), obj_materials[i].spec_map.id);
+        //materials referencing the same file, or objects loaded more than once, share a single texture
+        auto load = [&](const std::string &file_name, unsigned int &tex_id)
+        {
+            if (file_name.empty())
+                return;
+            if (stream_textures)
+                streaming::streamer.load(directory+file_name, tex_id);
+            else
+                resources::shared.acquire_texture(directory+file_name, tex_id);
+        };
+        if (uv_area[i] > 0.0 && model_area[i] > 0.0)
+            obj_materials[i].uv_density = float(std::sqrt(uv_area[i]/model_area[i]));
+        load(materials[i].diffuse_texname, obj_materials[i].diffuse_map.id);
+        load(materials[i].specular_texname, obj_materials[i].spec_map.id);
+        //normal maps hold vectors, not colors : never sRGB, never streamed
+        const std::string &normal_texname = materials[i].normal_texname.empty() ? materials[i].bump_texname : materials[i].normal_texname;
+        if (!normal_texname.empty())
+            resources::shared.acquire_texture(directory+normal_texname, obj_materials[i].normal_map.id, false);
     }
     return true;
 }
 
 //reads texture from file and assigns it to the GL_TEXTURE_2D target with tex_id.
+//the texture is private to the caller; use resources::shared.acquire_texture() for textures that may be reused.
 //be warned that this functions expects images with 3 or 4 color channels,
 //otherwise, undefined behaviour will occur.
 bool gen_texture(const char* file_path, unsigned int &tex_id)
@@ -382,43 +647,133 @@ bool gen_texture(const char* file_path, unsigned int &tex_id)
         return false;
     }
 
-    glGenTextures(1, &tex_id);
-    glBindTexture(GL_TEXTURE_2D, tex_id);
-
-    glTexImage2D(GL_TEXTURE_2D, 0, img_nrChannels == 3 ? GL_SRGB : GL_SRGB_ALPHA, img_width, img_height, 0, img_nrChannels == 3 ? GL_RGB : GL_RGBA, GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
-
-    glBindTexture(GL_TEXTURE_2D, 0);
+    resources::upload_texture_2D(data, img_width, img_height, img_nrChannels, tex_id);
 
     stbi_image_free(data);
     
     std::cout << "Loaded texture : " << file_path <<std::endl;
     return true;
 }
+//filtering and edge handling shared by all cube maps. expects the cube map to be bound, and generates its mips.
+void set_cubemap_parameters()
+{
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+}
+//decodes the six faces (ordered +X, -X, +Y, -Y, +Z, -Z) as jobs, then allocates the cube map once
+//with immutable storage, uploads every face and builds the mip chain a single time.
 bool gen_cubemap(const std::vector<std::string> &file_paths, unsigned int &cubemap_tex_id)
 {
+    if (file_paths.size() != 6)
+    {
+        std::cerr << "a cube map needs 6 faces, got " << file_paths.size() << std::endl;
+        return false;
+    }
+    struct decoded_face
+    {
+        int width = 0, height = 0, nr_channels = 0;
+        unsigned char* data = nullptr;
+    };
     stbi_set_flip_vertically_on_load(false);
-    glGenTextures(0, &cubemap_tex_id);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, cubemap_tex_id);
-    for (size_t i = 0; i < file_paths.size(); i++)
+    decoded_face faces[6];
+    jobs::parallel_for(6, [&](size_t i)
     {
-        int img_width, img_height, img_nrChannels;
-        unsigned char* data = stbi_load(file_paths[i].c_str(), &img_width, &img_height,
-        &img_nrChannels,0);
-        if(!data)
+        faces[i].data = stbi_load(file_paths[i].c_str(), &faces[i].width, &faces[i].height, &faces[i].nr_channels, 4);
+    });
+    bool success = true;
+    for (size_t i = 0; i < 6; i++)
+    {
+        if (!faces[i].data)
         {
             std::cerr << "reading texture file failed : " << file_paths[i] << std::endl;
-            stbi_image_free(data);
-            return false;
-        }
-        std::cout << "Loaded texture : " << file_paths[i] <<std::endl;
-        GLenum format = img_nrChannels == 3 ? GL_RGB : GL_RGBA;
-        GLenum internal_format = img_nrChannels == 3 ? GL_SRGB : GL_SRGB_ALPHA;
-        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X+i, 0, internal_format, img_width, img_height, 0, format,
-        GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
-        stbi_image_free(data);
+            success = false;
+        }
+        else if (faces[i].width != faces[0].width || faces[i].height != faces[0].height || faces[i].width != faces[i].height)
+        {
+            std::cerr << "cube map faces must be square and equally sized : " << file_paths[i] << std::endl;
+            success = false;
+        }
+    }
+    if (success)
+    {
+        const int size = faces[0].width;
+        glGenTextures(1, &cubemap_tex_id);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemap_tex_id);
+        glTexStorage2D(GL_TEXTURE_CUBE_MAP, int(std::log2(size)) + 1, GL_SRGB8_ALPHA8, size, size);
+        for (size_t i = 0; i < 6; i++)
+        {
+            glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X+i, 0, 0, 0, size, size, GL_RGBA, GL_UNSIGNED_BYTE, faces[i].data);
+            std::cout << "Loaded texture : " << file_paths[i] <<std::endl;
+        }
+        set_cubemap_parameters();
     }
+    for (decoded_face &face : faces)
+        stbi_image_free(face.data);
+    return success;
+}
+//builds a face_size cube map from a single equirectangular (latitude-longitude) HDR image.
+//faces are resampled on the CPU in parallel and stored as RGB16F. face_size <= 0 picks a quarter of the image width.
+bool gen_cubemap_equirect(const std::string &file_path, unsigned int &cubemap_tex_id, int face_size = 0)
+{
+    stbi_set_flip_vertically_on_load(false);
+    int img_width, img_height, img_nrChannels;
+    float* data = stbi_loadf(file_path.c_str(), &img_width, &img_height, &img_nrChannels, 3);
+    if (!data)
+    {
+        std::cerr << "reading texture file failed : " << file_path << std::endl;
+        return false;
+    }
+    if (face_size <= 0)
+        face_size = std::max(1, img_width/4);
+    std::vector<float> faces[6];
+    jobs::parallel_for(6, [&](size_t i)
+    {
+        cubemap::equirect_to_face(data, img_width, img_height, int(i), face_size, faces[i]);
+    });
+    stbi_image_free(data);
+
+    glGenTextures(1, &cubemap_tex_id);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, cubemap_tex_id);
+    glTexStorage2D(GL_TEXTURE_CUBE_MAP, int(std::log2(face_size)) + 1, GL_RGB16F, face_size, face_size);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);  //float RGB rows are always 4 byte aligned
+    for (int i = 0; i < 6; i++)
+        glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X+i, 0, 0, 0, face_size, face_size, GL_RGB, GL_FLOAT, faces[i].data());
+    set_cubemap_parameters();
+    std::cout << "Loaded texture : " << file_path << " (equirectangular, " << face_size << "px faces)" << std::endl;
     return true;
 }
+//uploads precomputed image based lighting : the prefiltered specular chain as an RGB16F cube map with one
+//roughness per mip, and the BRDF lookup table as an RG16F texture.
+void gen_ibl_textures(const ibl::ibl_data &data, unsigned int &specular_tex_id, unsigned int &brdf_lut_tex_id)
+{
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glGenTextures(1, &specular_tex_id);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, specular_tex_id);
+    glTexStorage2D(GL_TEXTURE_CUBE_MAP, data.specular.size(), GL_RGB16F, data.specular[0].size, data.specular[0].size);
+    for (size_t level = 0; level < data.specular.size(); level++)
+        for (int face = 0; face < 6; face++)
+            glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X+face, level, 0, 0, data.specular[level].size, data.specular[level].size,
+            GL_RGB, GL_FLOAT, data.specular[level].faces[face].data());
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+    glGenTextures(1, &brdf_lut_tex_id);
+    glBindTexture(GL_TEXTURE_2D, brdf_lut_tex_id);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RG16F, data.lut_size, data.lut_size);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, data.lut_size, data.lut_size, GL_RG, GL_FLOAT, data.brdf_lut.data());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
 #endif
\ No newline at end of file
@@ -0,0 +1,487 @@
+#ifndef POST_PROCESSING
+#define POST_PROCESSING
+
+#include "glad/glad.h"
+#include "glm/glm.hpp"
+#include "shader_manager.h"
+#include "render_graph.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+//post processing. the scene is shaded in linear light into an offscreen RGBA16F target, then a chain of compute passes
+//turns it into the image shown. the separable kernels load their tile plus the kernel's reach into shared memory once,
+//so a texel is fetched once per work group instead of once per tap, and neighbouring passes are fused into one
+//dispatch where the second only needs the first's result at the same texel. bloom runs down and back up a chain of
+//half sized levels, so its cost shrinks with every level. every pass is timed on the GPU. the scene may be drawn into
+//only part of the target, at a lower resolution picked by resolution_controller, and is then upscaled and sharpened
+//on its way to the display. temporal anti-aliasing runs first, on the HDR scene, so every later pass sees the
+//accumulated image.
+namespace post
+{
+    constexpr int TILE_SIZE = 16;               //TILE_SIZE in post_kernel.glsl
+    constexpr int MAX_KERNEL_RADIUS = 16;       //MAX_KERNEL_RADIUS in post_kernel.glsl
+    constexpr float REFERENCE_HEIGHT = 1080.0f; //kernel sizes are given in pixels at this height
+    constexpr int MAX_BLOOM_LEVELS = 6;
+    constexpr int MIN_BLOOM_SIZE = 8;           //the chain stops before a level gets smaller than this
+    constexpr int BLOOM_GROUP_SIZE = 8;         //local size of bloom_downsample.comp and bloom_upsample.comp
+    constexpr int UPSCALE_GROUP_SIZE = 8;       //local size of post_upscale.comp
+    constexpr int JITTER_SAMPLES = 8;           //positions in the temporal anti-aliasing jitter cycle
+
+    //element index of the Halton low discrepancy sequence in base, in [0, 1)
+    inline float halton(int index, int base)
+    {
+        float result = 0.0f, fraction = 1.0f;
+        for (; index > 0; index /= base)
+        {
+            fraction /= base;
+            result += fraction*(index%base);
+        }
+        return result;
+    }
+
+    //the size a side of the output is drawn at with a resolution scale
+    inline int scaled_size(int size, float scale) {return std::max(int(size*scale + 0.5f), 1);}
+
+    //pairs of GL_TIMESTAMP queries in a ring, so a result is read a few frames after it was issued and never stalls.
+    //timestamps, unlike GL_TIME_ELAPSED, let timers nest, so a pass can be timed inside the whole frame.
+    class gpu_timer
+    {
+        static constexpr int LATENCY = 4;
+        unsigned int queries[2*LATENCY] = {};   //start and end of each frame in flight
+        bool issued[LATENCY] = {false, false, false, false};
+        int next = 0;
+        double smoothed_ms = 0.0;
+    public:
+        void begin()
+        {
+            if (!queries[0])
+                glGenQueries(2*LATENCY, queries);
+            //the oldest pair is reused now, fold its result in if it arrived
+            if (issued[next])
+            {
+                int available = 0;
+                glGetQueryObjectiv(queries[2*next + 1], GL_QUERY_RESULT_AVAILABLE, &available);
+                if (available)
+                {
+                    GLuint64 start = 0, end = 0;
+                    glGetQueryObjectui64v(queries[2*next], GL_QUERY_RESULT, &start);
+                    glGetQueryObjectui64v(queries[2*next + 1], GL_QUERY_RESULT, &end);
+                    const double ms = (end - start)*1e-6;
+                    smoothed_ms = smoothed_ms == 0.0 ? ms : 0.9*smoothed_ms + 0.1*ms;
+                }
+                issued[next] = false;
+            }
+            glQueryCounter(queries[2*next], GL_TIMESTAMP);
+        }
+        void end()
+        {
+            glQueryCounter(queries[2*next + 1], GL_TIMESTAMP);
+            issued[next] = true;
+            next = (next + 1)%LATENCY;
+        }
+        //smoothed over the last frames, 0 until the first result arrived
+        double milliseconds() const {return smoothed_ms;}
+        //forgets the measurements, for passes that stop running. queries still in flight are dropped.
+        void reset()
+        {
+            smoothed_ms = 0.0;
+            for (bool &pending : issued)
+                pending = false;
+        }
+    };
+
+    //picks the share of the output resolution the scene is drawn at, so the smoothed GPU frame time stays within
+    //budget_ms. most of the frame's cost is per pixel, so the scale follows the square root of the time ratio. it steps
+    //down at once when over budget, up only in small steps with some headroom, and after every change waits for the
+    //timers to catch up, so it does not oscillate around the budget.
+    class resolution_controller
+    {
+        float current = 1.0f;
+        int settling = 0;
+    public:
+        static constexpr int SETTLE_FRAMES = 12;    //timer latency plus most of the smoothing
+        float budget_ms = 1000.0f/60.0f;
+        float min_scale = 0.5f, max_scale = 1.0f;
+        float headroom = 0.85f;                     //the scale only grows while the frame is below this share of the budget
+
+        //call once per frame with the GPU frame time, returns the scale to draw the frame at
+        float update(double gpu_ms)
+        {
+            if (settling > 0)
+                settling--;
+            else if (gpu_ms > 0.0)
+            {
+                float target = current;
+                if (gpu_ms > budget_ms)
+                    target = current*std::sqrt(float(0.95*budget_ms/gpu_ms));
+                else if (gpu_ms < headroom*budget_ms)
+                    target = std::min(current*std::sqrt(float(headroom*budget_ms/gpu_ms)), current + 0.05f);
+                target = std::min(std::max(target, min_scale), max_scale);
+                if (std::fabs(target - current) > 0.005f)
+                {
+                    current = target;
+                    settling = SETTLE_FRAMES;
+                }
+            }
+            return current;
+        }
+        float scale() const {return current;}
+    };
+
+    //the offscreen targets the scene is drawn into this frame: linear HDR color, the motion vectors of
+    //src/motion_vectors.glsl and depth/stencil, transient textures of the frame's render graph. they have the output's
+    //size, the scene covers their lower left render_width x render_height texels, so changing the resolution scale
+    //never reallocates them.
+    class hdr_target
+    {
+    public:
+        graph::resource color = graph::NONE, motion = graph::NONE, depth_stencil = graph::NONE;
+        int width = 0, height = 0;
+        int render_width = 0, render_height = 0;
+
+        //declares this frame's targets for an output of the given size, drawn at scale of it on each side
+        void create(graph::render_graph &frame, int output_width, int output_height, float scale = 1.0f)
+        {
+            width = output_width;
+            height = output_height;
+            render_width = std::min(scaled_size(width, scale), width);
+            render_height = std::min(scaled_size(height, scale), height);
+            color = frame.create_texture("scene color", {width, height, 1, GL_RGBA16F});
+            motion = frame.create_texture("scene motion", {width, height, 1, GL_RG16F, GL_NEAREST, GL_NEAREST});
+            depth_stencil = frame.create_texture("scene depth", {width, height, 1, GL_DEPTH24_STENCIL8, GL_NEAREST, GL_NEAREST});
+        }
+        //binds the targets, while the graph executes, with a viewport covering the drawn part
+        void bind(graph::render_graph &frame) const
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffer(frame));
+            glViewport(0, 0, render_width, render_height);
+        }
+        unsigned int framebuffer(graph::render_graph &frame) const {return frame.framebuffer({color, motion}, depth_stencil);}
+        //clears the bound target, color to background, motion to none
+        void clear(const glm::vec4 &background) const
+        {
+            const glm::vec4 no_motion(0.0f);
+            glClearBufferfv(GL_COLOR, 0, &background[0]);
+            glClearBufferfv(GL_COLOR, 1, &no_motion[0]);
+            glClearBufferfi(GL_DEPTH_STENCIL, 0, 1.0f, 0);
+        }
+    };
+
+    //blurs the scene's rows and builds the bloom chain, then resolves everything into the display image in one pass:
+    //the column blur, an unsharp mask, the bloom, tone mapping, gamma and dithering. a scene drawn below the output
+    //resolution is resolved at its own resolution and the last pass upscales it, sharpening what the filter softened.
+    //sharpen_amount 0 leaves the image as is, negative amounts soften it down to the plain blur at -1. every pass is a
+    //pass of the frame's render graph, the intermediate images are its transients, so the blur and the bloom are
+    //culled when their strength is 0.
+    class post_chain
+    {
+    public:
+        enum pass {TEMPORAL_AA, BLUR_ROWS, BLOOM_DOWNSAMPLE, BLOOM_UPSAMPLE, RESOLVE, UPSCALE, PASS_COUNT};
+    private:
+        static constexpr const char* pass_names[PASS_COUNT] = {"temporal aa", "blur rows", "bloom down", "bloom up", "resolve", "upscale"};
+        shader_manager* manager = nullptr;
+        shader_manager::handle programs[PASS_COUNT] = {0, 0, 0, 0, 0, 0};
+        unsigned int program_ids[PASS_COUNT] = {0, 0, 0, 0, 0, 0};
+        gpu_timer timers[PASS_COUNT];
+        bool ran[PASS_COUNT] = {false, false, false, false, false, false};
+        unsigned int history[2] = {0, 0};           //temporal anti-aliasing results, written and read in turns
+        int width = 0, height = 0;                  //output size, every target is allocated for it
+        int render_width = 0, render_height = 0;    //the part of the targets the scene covers
+        int bloom_levels = 0;
+        int current_history = 0;
+        bool history_valid = false;
+        glm::ivec2 history_size = glm::ivec2(0);    //the part of the history the last frame covered
+        int jitter_index = 0;
+        int kernel_radius = 0;
+        float kernel_weights[MAX_KERNEL_RADIUS + 1] = {};
+        float weights_sigma = -1.0f;        //the pixel sigma kernel_weights were built for
+
+        //the history outlives the frame, so it is the only target the chain allocates itself
+        void resize(int new_width, int new_height)
+        {
+            if (history[0] && new_width == width && new_height == height)
+                return;
+            if (history[0])
+                glDeleteTextures(2, history);
+            width = new_width;
+            height = new_height;
+            history_valid = false;
+            for (unsigned int &target : history)
+            {
+                glGenTextures(1, &target);
+                glBindTexture(GL_TEXTURE_2D, target);
+                glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA16F, width, height);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            }
+            glBindTexture(GL_TEXTURE_2D, 0);
+            bloom_levels = 1;
+            while (bloom_levels < MAX_BLOOM_LEVELS && std::min(width, height) >> (bloom_levels + 1) >= MIN_BLOOM_SIZE)
+                bloom_levels++;
+        }
+        //normalised gaussian weights for blur_sigma scaled from REFERENCE_HEIGHT to the height the scene is drawn at,
+        //so the filter covers the same part of the screen at any resolution
+        void build_kernel()
+        {
+            const float sigma = std::max(blur_sigma*render_height/REFERENCE_HEIGHT, 0.1f);
+            if (sigma == weights_sigma)
+                return;
+            weights_sigma = sigma;
+            kernel_radius = std::min(int(std::ceil(3.0f*sigma)), MAX_KERNEL_RADIUS);
+            float sum = 0.0f;
+            for (int i = 0; i <= kernel_radius; i++)
+            {
+                kernel_weights[i] = std::exp(-0.5f*i*i/(sigma*sigma));
+                sum += i == 0 ? kernel_weights[i] : 2.0f*kernel_weights[i];
+            }
+            for (int i = 0; i <= kernel_radius; i++)
+                kernel_weights[i] /= sum;
+        }
+        void send_kernel(unsigned int program_id) const
+        {
+            glUniform1i(glGetUniformLocation(program_id, "kernel_radius"), kernel_radius);
+            glUniform1fv(glGetUniformLocation(program_id, "kernel_weights"), kernel_radius + 1, kernel_weights);
+        }
+        static unsigned int groups(int size, int group_size) {return (size + group_size - 1)/group_size;}
+        //allocated and drawn size of a bloom level
+        glm::ivec2 level_size(int level) const {return glm::max(glm::ivec2(width/2, height/2) >> level, 1);}
+        glm::ivec2 level_render_size(int level) const {return glm::max(glm::ivec2(render_width/2, render_height/2) >> level, 1);}
+        //the part of a texture's uv range the scene covers
+        static void send_uv_scale(unsigned int program_id, const char* name, glm::ivec2 drawn, glm::ivec2 allocated)
+        {
+            glUniform2f(glGetUniformLocation(program_id, name), float(drawn.x)/allocated.x, float(drawn.y)/allocated.y);
+        }
+        //the pass's timer runs around execute, its time counts towards the chain's
+        template <typename pass_function>
+        std::function<void()> timed(int pass, pass_function execute)
+        {
+            return [this, pass, execute]()
+            {
+                timers[pass].begin();
+                execute();
+                timers[pass].end();
+                ran[pass] = true;
+            };
+        }
+        void resolve_temporal(unsigned int color, unsigned int motion, unsigned int depth)
+        {
+            const unsigned int taa_id = program_ids[TEMPORAL_AA];
+            glUseProgram(taa_id);
+            glUniform2i(glGetUniformLocation(taa_id, "render_size"), render_width, render_height);
+            send_uv_scale(taa_id, "history_uv_scale", history_size, glm::ivec2(width, height));
+            glUniform1i(glGetUniformLocation(taa_id, "history_valid"), history_valid);
+            glUniform1f(glGetUniformLocation(taa_id, "current_weight"), temporal_weight);
+            glBindTextureUnit(0, color);
+            glBindTextureUnit(1, motion);
+            glBindTextureUnit(2, depth);
+            glBindTextureUnit(3, history[1 - current_history]);
+            glBindImageTexture(0, history[current_history], 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+            glDispatchCompute(groups(render_width, TILE_SIZE), groups(render_height, TILE_SIZE), 1);
+            current_history = 1 - current_history;
+            history_valid = true;
+            history_size = glm::ivec2(render_width, render_height);
+        }
+        void blur_rows(unsigned int color, unsigned int blurred_rows)
+        {
+            const unsigned int rows_id = program_ids[BLUR_ROWS];
+            glUseProgram(rows_id);
+            send_kernel(rows_id);
+            glUniform2i(glGetUniformLocation(rows_id, "render_size"), render_width, render_height);
+            glBindTextureUnit(0, color);
+            glBindImageTexture(0, blurred_rows, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+            glDispatchCompute(groups(render_width, TILE_SIZE), groups(render_height, TILE_SIZE), 1);
+        }
+        //the 13 tap filter from the scene into level 0, then from every level into the next
+        void downsample_bloom(unsigned int color, unsigned int bloom)
+        {
+            const unsigned int program_id = program_ids[BLOOM_DOWNSAMPLE];
+            glUseProgram(program_id);
+            for (int level = 0; level < bloom_levels; level++)
+            {
+                const glm::ivec2 destination = level_render_size(level);
+                glBindTextureUnit(0, level == 0 ? color : bloom);
+                glUniform1f(glGetUniformLocation(program_id, "source_lod"), level == 0 ? 0.0f : float(level - 1));
+                if (level == 0)
+                    send_uv_scale(program_id, "source_uv_scale", glm::ivec2(render_width, render_height), glm::ivec2(width, height));
+                else
+                    send_uv_scale(program_id, "source_uv_scale", level_render_size(level - 1), level_size(level - 1));
+                glUniform2i(glGetUniformLocation(program_id, "destination_size"), destination.x, destination.y);
+                glUniform1i(glGetUniformLocation(program_id, "karis_average"), level == 0);
+                glBindImageTexture(0, bloom, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R11F_G11F_B10F);
+                glDispatchCompute(groups(destination.x, BLOOM_GROUP_SIZE), groups(destination.y, BLOOM_GROUP_SIZE), 1);
+                if (level + 1 < bloom_levels)   //the graph places the barrier after the last level
+                    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+            }
+        }
+        //tents every level onto the one above, from the smallest up to level 0
+        void upsample_bloom(unsigned int bloom)
+        {
+            const unsigned int program_id = program_ids[BLOOM_UPSAMPLE];
+            glUseProgram(program_id);
+            glUniform1f(glGetUniformLocation(program_id, "filter_radius"), bloom_radius);
+            glBindTextureUnit(0, bloom);
+            for (int level = bloom_levels - 2; level >= 0; level--)
+            {
+                const glm::ivec2 destination = level_render_size(level);
+                glUniform1f(glGetUniformLocation(program_id, "source_lod"), float(level + 1));
+                send_uv_scale(program_id, "source_uv_scale", level_render_size(level + 1), level_size(level + 1));
+                glUniform2i(glGetUniformLocation(program_id, "destination_size"), destination.x, destination.y);
+                glBindImageTexture(0, bloom, level, GL_FALSE, 0, GL_READ_WRITE, GL_R11F_G11F_B10F);
+                glDispatchCompute(groups(destination.x, BLOOM_GROUP_SIZE), groups(destination.y, BLOOM_GROUP_SIZE), 1);
+                if (level > 0)
+                    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+            }
+        }
+        void resolve(unsigned int color, unsigned int blurred_rows, unsigned int bloom, unsigned int target, bool dither)
+        {
+            const unsigned int resolve_id = program_ids[RESOLVE];
+            glUseProgram(resolve_id);
+            send_kernel(resolve_id);
+            glUniform2i(glGetUniformLocation(resolve_id, "render_size"), render_width, render_height);
+            glUniform1f(glGetUniformLocation(resolve_id, "sharpen_amount"), sharpen_amount);
+            //level 0 holds the sum of every level
+            glUniform1f(glGetUniformLocation(resolve_id, "bloom_strength"), bloom_strength/bloom_levels);
+            send_uv_scale(resolve_id, "bloom_uv_scale", level_render_size(0), level_size(0));
+            glUniform1f(glGetUniformLocation(resolve_id, "exposure"), exposure);
+            glUniform1i(glGetUniformLocation(resolve_id, "dither"), dither);
+            glBindTextureUnit(0, color);
+            glBindTextureUnit(1, blurred_rows);
+            glBindTextureUnit(2, bloom);
+            glBindImageTexture(0, target, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+            glDispatchCompute(groups(render_width, TILE_SIZE), groups(render_height, TILE_SIZE), 1);
+        }
+        void upscale(unsigned int resolved, unsigned int display)
+        {
+            const unsigned int upscale_id = program_ids[UPSCALE];
+            glUseProgram(upscale_id);
+            send_uv_scale(upscale_id, "source_uv_scale", glm::ivec2(render_width, render_height), glm::ivec2(width, height));
+            glUniform2i(glGetUniformLocation(upscale_id, "output_size"), width, height);
+            //full strength from 75% down, so crossing into full resolution does not visibly pop
+            const float scale = float(render_height)/height;
+            glUniform1f(glGetUniformLocation(upscale_id, "sharpness"), upscale_sharpness*std::min(4.0f*(1.0f - scale), 1.0f));
+            glBindTextureUnit(0, resolved);
+            glBindImageTexture(0, display, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+            glDispatchCompute(groups(width, UPSCALE_GROUP_SIZE), groups(height, UPSCALE_GROUP_SIZE), 1);
+        }
+    public:
+        float blur_sigma = 1.5f;        //in pixels at REFERENCE_HEIGHT
+        float sharpen_amount = 0.4f;
+        float bloom_strength = 0.04f;   //share of the bloom in the final image
+        float bloom_radius = 1.0f;      //tent reach of the upsample in texels of the smaller level
+        float exposure = 1.0f;
+        float upscale_sharpness = 0.5f; //sharpening of the upscale, faded out between 75% and full resolution
+        bool temporal_aa = true;
+        float temporal_weight = 0.1f;   //share of the current frame in the accumulated image
+
+        //submits the compute programs. call once GL is loaded.
+        void init(shader_manager &shaders)
+        {
+            manager = &shaders;
+            programs[TEMPORAL_AA] = shaders.submit_compute("src/taa_resolve.comp");
+            programs[BLUR_ROWS] = shaders.submit_compute("src/post_blur_rows.comp");
+            programs[BLOOM_DOWNSAMPLE] = shaders.submit_compute("src/bloom_downsample.comp");
+            programs[BLOOM_UPSAMPLE] = shaders.submit_compute("src/bloom_upsample.comp");
+            programs[RESOLVE] = shaders.submit_compute("src/post_resolve.comp");
+            programs[UPSCALE] = shaders.submit_compute("src/post_upscale.comp");
+        }
+        //offsets projection by this frame's sub-pixel jitter for a scene drawn at draw_width x draw_height.
+        //call once per frame; projection is returned as is while temporal anti-aliasing is off.
+        glm::mat4 jitter(glm::mat4 projection, int draw_width, int draw_height)
+        {
+            if (!temporal_aa)
+                return projection;
+            jitter_index = jitter_index%JITTER_SAMPLES + 1;     //index 0 of the sequence is the pixel corner
+            projection[2][0] += (2.0f*halton(jitter_index, 2) - 1.0f)/draw_width;
+            projection[2][1] += (2.0f*halton(jitter_index, 3) - 1.0f)/draw_height;
+            return projection;
+        }
+        //adds the passes filtering the scene in source, upscaling it if it was drawn at a lower resolution and
+        //copying the result into the default framebuffer.
+        //returns false, adding nothing, while the programs are still compiling.
+        bool add_passes(graph::render_graph &frame, const hdr_target &source)
+        {
+            for (int i = 0; i < PASS_COUNT; i++)
+                if (!(program_ids[i] = manager->program(programs[i])))
+                    return false;
+            //passes culled or left out last frame stop counting towards the chain's time
+            for (int i = 0; i < PASS_COUNT; i++)
+            {
+                if (!ran[i])
+                    timers[i].reset();
+                ran[i] = false;
+            }
+            resize(source.width, source.height);
+            render_width = source.render_width;
+            render_height = source.render_height;
+            const bool upscaled = render_width != width || render_height != height;
+            build_kernel();
+            const graph::resource blurred_rows = frame.create_texture("blurred rows", {width, height, 1, GL_RGBA16F});
+            //the bloom levels are mips of one texture starting at half resolution. bloom carries no alpha and
+            //tolerates the lower precision, so 4 bytes a texel halve its bandwidth against RGBA16F.
+            //GL_LINEAR_MIPMAP_NEAREST filters bilinearly within the level asked for.
+            const graph::resource bloom = frame.create_texture("bloom", {std::max(width/2, 1), std::max(height/2, 1), bloom_levels,
+            GL_R11F_G11F_B10F, GL_LINEAR_MIPMAP_NEAREST, GL_LINEAR});
+            const graph::resource display = frame.create_texture("display", {width, height, 1, GL_RGBA8});
+            //the display encoded image before upscaling, filtered in display space like the final image
+            const graph::resource resolved = upscaled ? frame.create_texture("resolved", {width, height, 1, GL_RGBA8}) : display;
+
+            graph::resource color = source.color;
+            if (temporal_aa)
+            {
+                const graph::resource previous = frame.import_texture("previous history", history[1 - current_history]);
+                color = frame.import_texture("history", history[current_history], true);
+                const graph::resource scene_color = source.color, motion = source.motion, depth = source.depth_stencil;
+                frame.add_pass(pass_names[TEMPORAL_AA], timed(TEMPORAL_AA, [this, &frame, scene_color, motion, depth]()
+                {resolve_temporal(frame.id(scene_color), frame.id(motion), frame.id(depth));}))
+                .read(scene_color, graph::SAMPLED).read(motion, graph::SAMPLED).read(depth, graph::SAMPLED)
+                .read(previous, graph::SAMPLED).write(color, graph::IMAGE);
+            }
+            else
+                history_valid = false;
+            frame.add_pass(pass_names[BLUR_ROWS], timed(BLUR_ROWS, [this, &frame, color, blurred_rows]()
+            {blur_rows(frame.id(color), frame.id(blurred_rows));}))
+            .read(color, graph::SAMPLED).write(blurred_rows, graph::IMAGE);
+            frame.add_pass(pass_names[BLOOM_DOWNSAMPLE], timed(BLOOM_DOWNSAMPLE, [this, &frame, color, bloom]()
+            {downsample_bloom(frame.id(color), frame.id(bloom));}))
+            .read(color, graph::SAMPLED).write(bloom, graph::IMAGE);
+            frame.add_pass(pass_names[BLOOM_UPSAMPLE], timed(BLOOM_UPSAMPLE, [this, &frame, bloom]()
+            {upsample_bloom(frame.id(bloom));}))
+            .read(bloom, graph::SAMPLED).write(bloom, graph::IMAGE);
+            //the resolve only reads the blur and the bloom while they show, otherwise their passes are culled
+            const bool blurred = sharpen_amount != 0.0f, glowing = bloom_strength > 0.0f;
+            graph::pass_builder resolve_pass = frame.add_pass(pass_names[RESOLVE], timed(RESOLVE,
+            [this, &frame, color, blurred_rows, bloom, resolved, blurred, glowing, upscaled]()
+            {resolve(frame.id(color), blurred ? frame.id(blurred_rows) : 0, glowing ? frame.id(bloom) : 0, frame.id(resolved), !upscaled);}))
+            .read(color, graph::SAMPLED).write(resolved, graph::IMAGE);     //noise goes on last, after any upscale
+            if (blurred)
+                resolve_pass.read(blurred_rows, graph::SAMPLED);
+            if (glowing)
+                resolve_pass.read(bloom, graph::SAMPLED);
+            if (upscaled)
+                frame.add_pass(pass_names[UPSCALE], timed(UPSCALE, [this, &frame, resolved, display]()
+                {upscale(frame.id(resolved), frame.id(display));}))
+                .read(resolved, graph::SAMPLED).write(display, graph::IMAGE);
+            frame.add_pass("present", [this, &frame, display]()
+            {
+                glBlitNamedFramebuffer(frame.framebuffer({display}), 0, 0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+            }, true).read(display, graph::TRANSFER);
+            return true;
+        }
+        const char* pass_name(int pass) const {return pass_names[pass];}
+        double pass_milliseconds(int pass) const {return timers[pass].milliseconds();}
+        double bloom_milliseconds() const {return timers[BLOOM_DOWNSAMPLE].milliseconds() + timers[BLOOM_UPSAMPLE].milliseconds();}
+        int bloom_level_count() const {return bloom_levels;}
+        double total_milliseconds() const
+        {
+            double total = 0.0;
+            for (int i = 0; i < PASS_COUNT; i++)
+                total += timers[i].milliseconds();
+            return total;
+        }
+    };
+}
+#endif
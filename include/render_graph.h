@@ -0,0 +1,501 @@
+#ifndef RENDER_GRAPH
+#define RENDER_GRAPH
+
+#include "glad/glad.h"
+
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+//frame graph. every frame the renderer adds its passes with the textures and buffers each of them reads and writes,
+//then compiles and executes the graph once:
+//- passes run in dependency order. the writers of a resource run in the order they were added, its readers after
+//  all of them, passes that do not depend on each other keep the order they were added in.
+//- passes nothing reads from are culled, unless they have side effects or write a retained resource.
+//- glMemoryBarrier is only issued before a pass that accesses what an earlier pass wrote through an image or a
+//  storage buffer, with the bits of the accesses that need it. GL keeps every other access in order by itself.
+//- transient textures exist from the first to the last pass using them. they are views of pooled textures, so
+//  transients of the same size and texel size whose lifetimes do not overlap share memory, also across formats.
+namespace graph
+{
+    typedef int resource;
+    constexpr resource NONE = -1;
+
+    //how a pass uses a resource
+    enum access
+    {
+        SAMPLED,        //texture fetches
+        IMAGE,          //image loads and stores
+        STORAGE,        //shader storage buffer
+        UNIFORM,        //uniform buffer
+        ATTACHMENT,     //framebuffer attachment, including depth and stencil tests
+        TRANSFER,       //copies, blits, clears and buffer uploads
+        VERTEX,         //vertex or index buffer
+        INDIRECT        //indirect draw or dispatch arguments
+    };
+    //the barrier bits that make earlier image and storage buffer writes visible to an access
+    inline GLbitfield barrier_bits(access how, bool buffer)
+    {
+        switch (how)
+        {
+        case SAMPLED: return GL_TEXTURE_FETCH_BARRIER_BIT;
+        case IMAGE: return GL_SHADER_IMAGE_ACCESS_BARRIER_BIT;
+        case STORAGE: return GL_SHADER_STORAGE_BARRIER_BIT;
+        case UNIFORM: return GL_UNIFORM_BARRIER_BIT;
+        case ATTACHMENT: return GL_FRAMEBUFFER_BARRIER_BIT;
+        case TRANSFER: return buffer ? GL_BUFFER_UPDATE_BARRIER_BIT : GL_TEXTURE_UPDATE_BARRIER_BIT | GL_FRAMEBUFFER_BARRIER_BIT;
+        case VERTEX: return GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_ELEMENT_ARRAY_BARRIER_BIT;
+        case INDIRECT: return GL_COMMAND_BARRIER_BIT;
+        }
+        return GL_ALL_BARRIER_BITS;
+    }
+    inline bool incoherent(access how) {return how == IMAGE || how == STORAGE;}
+    //bits per texel of a color format's view class (OpenGL 4.6 table 8.22). textures of one class can be viewed as
+    //any format of it. every other format is a class of its own.
+    inline unsigned int view_class(GLenum format)
+    {
+        switch (format)
+        {
+        case GL_RGBA32F: case GL_RGBA32UI: case GL_RGBA32I:
+            return 128;
+        case GL_RGB32F: case GL_RGB32UI: case GL_RGB32I:
+            return 96;
+        case GL_RGBA16F: case GL_RG32F: case GL_RGBA16UI: case GL_RG32UI: case GL_RGBA16I: case GL_RG32I:
+        case GL_RGBA16: case GL_RGBA16_SNORM:
+            return 64;
+        case GL_RG16F: case GL_R11F_G11F_B10F: case GL_R32F: case GL_RGB10_A2UI: case GL_RGBA8UI: case GL_RG16UI:
+        case GL_R32UI: case GL_RGBA8I: case GL_RG16I: case GL_R32I: case GL_RGB10_A2: case GL_RGBA8: case GL_RG16:
+        case GL_RGBA8_SNORM: case GL_RG16_SNORM: case GL_SRGB8_ALPHA8: case GL_RGB9_E5:
+            return 32;
+        case GL_R16F: case GL_RG8UI: case GL_R16UI: case GL_RG8I: case GL_R16I: case GL_RG8: case GL_R16:
+        case GL_RG8_SNORM: case GL_R16_SNORM:
+            return 16;
+        case GL_R8UI: case GL_R8I: case GL_R8: case GL_R8_SNORM:
+            return 8;
+        }
+        return format;
+    }
+    inline size_t texel_bytes(GLenum format)
+    {
+        const unsigned int bits = view_class(format);
+        if (bits <= 128)
+            return bits/8;
+        return format == GL_DEPTH32F_STENCIL8 ? 8 : (format == GL_DEPTH_COMPONENT16 ? 2 : 4);
+    }
+
+    struct texture_desc
+    {
+        int width = 1, height = 1;
+        int levels = 1;
+        GLenum format = GL_RGBA8;
+        GLenum min_filter = GL_LINEAR, mag_filter = GL_LINEAR;  //both axes clamp to the edge
+
+        size_t byte_size() const
+        {
+            size_t bytes = 0;
+            for (int level = 0; level < levels; level++)
+                bytes += size_t(std::max(width >> level, 1))*std::max(height >> level, 1)*texel_bytes(format);
+            return bytes;
+        }
+    };
+
+    class render_graph;
+    //declares the accesses of a pass, see render_graph::add_pass()
+    class pass_builder
+    {
+        render_graph &graph;
+        int index;
+    public:
+        pass_builder(render_graph &graph, int index) : graph(graph), index(index) {}
+        pass_builder& read(resource target, access how);
+        pass_builder& write(resource target, access how);
+    };
+
+    class render_graph
+    {
+    public:
+        struct statistics
+        {
+            int passes = 0, culled = 0;
+            int barriers = 0;
+            size_t transient_bytes = 0;     //the frame's transients, each in memory of its own
+            size_t aliased_bytes = 0;       //the pooled memory they took instead
+            size_t pool_bytes = 0;          //all pooled memory, including textures idle this frame
+        };
+        static constexpr int IDLE_FRAMES = 16;  //pooled textures unused for this many frames are released
+    private:
+        friend class pass_builder;
+        struct use
+        {
+            resource target;
+            access how;
+            bool write;
+        };
+        struct pass_node
+        {
+            std::string name;
+            std::function<void()> execute;
+            std::vector<use> uses;
+            bool side_effect = false;
+            GLbitfield barrier = 0;         //issued right before the pass
+        };
+        struct resource_node
+        {
+            std::string name;
+            unsigned int id = 0;            //for transients the view given to them by compile()
+            bool transient = false, buffer = false, retained = false;
+            texture_desc desc;
+            int pooled = -1;
+            int first_use = -1, last_use = -1;  //positions in the execution order
+        };
+        //immutable storage the transients are views of, kept across frames
+        struct pooled_texture
+        {
+            unsigned int texture = 0;
+            texture_desc desc;              //format is the storage format, views take any other of its class
+            std::vector<std::pair<GLenum, unsigned int>> views;
+            int busy_until = -1;            //last position in this frame's order it is used at
+            int idle_frames = 0;
+            GLbitfield pending = 0;         //barrier bits its last image writes still need
+        };
+        std::vector<pass_node> passes;
+        std::vector<resource_node> resources;
+        std::vector<int> order;
+        std::vector<pooled_texture> pool;
+        std::map<std::pair<bool, unsigned int>, GLbitfield> imported_pending;   //per buffer flag and name, across frames
+        std::map<std::vector<unsigned int>, unsigned int> framebuffers;
+        statistics stats;
+
+        bool compatible(const texture_desc &a, const texture_desc &b) const
+        {
+            return a.width == b.width && a.height == b.height && a.levels == b.levels && view_class(a.format) == view_class(b.format);
+        }
+        unsigned int view(pooled_texture &storage, GLenum format)
+        {
+            if (format == storage.desc.format)
+                return storage.texture;
+            for (const std::pair<GLenum, unsigned int> &existing : storage.views)
+                if (existing.first == format)
+                    return existing.second;
+            unsigned int id = 0;
+            glGenTextures(1, &id);
+            glTextureView(id, GL_TEXTURE_2D, storage.texture, format, 0, storage.desc.levels, 0, 1);
+            storage.views.push_back({format, id});
+            return id;
+        }
+        void release(pooled_texture &storage)
+        {
+            for (const std::pair<GLenum, unsigned int> &existing : storage.views)
+                glDeleteTextures(1, &existing.second);
+            glDeleteTextures(1, &storage.texture);
+        }
+        void release_framebuffers()
+        {
+            for (const std::pair<const std::vector<unsigned int>, unsigned int> &cached : framebuffers)
+                glDeleteFramebuffers(1, &cached.second);
+            framebuffers.clear();
+        }
+        GLbitfield& pending(const resource_node &node)
+        {
+            return node.transient ? pool[node.pooled].pending : imported_pending[{node.buffer, node.id}];
+        }
+        //the passes each pass has to run after. writers follow the writers added before them, readers every writer.
+        std::vector<std::vector<int>> dependencies() const
+        {
+            std::vector<std::vector<int>> writers(resources.size()), readers(resources.size());
+            for (int p = 0; p < int(passes.size()); p++)
+                for (const use &u : passes[p].uses)
+                {
+                    std::vector<int> &list = u.write ? writers[u.target] : readers[u.target];
+                    if (list.empty() || list.back() != p)
+                        list.push_back(p);
+                }
+            std::vector<std::vector<int>> after(passes.size());
+            for (size_t r = 0; r < resources.size(); r++)
+            {
+                for (size_t i = 1; i < writers[r].size(); i++)
+                    after[writers[r][i]].push_back(writers[r][i - 1]);
+                for (int reader : readers[r])
+                    for (int writer : writers[r])
+                        if (writer != reader)
+                            after[reader].push_back(writer);
+            }
+            for (std::vector<int> &list : after)
+            {
+                std::sort(list.begin(), list.end());
+                list.erase(std::unique(list.begin(), list.end()), list.end());
+            }
+            return after;
+        }
+        void allocate_transients()
+        {
+            for (size_t i = 0; i < pool.size();)
+                if (pool[i].idle_frames >= IDLE_FRAMES)
+                {
+                    release(pool[i]);
+                    pool.erase(pool.begin() + i);
+                    release_framebuffers();     //cached ones may hold its views
+                }
+                else
+                    pool[i++].busy_until = -1;
+            std::vector<int> transients;
+            for (int r = 0; r < int(resources.size()); r++)
+                if (resources[r].transient && resources[r].first_use >= 0)
+                    transients.push_back(r);
+            std::sort(transients.begin(), transients.end(), [this](int a, int b) {return resources[a].first_use < resources[b].first_use;});
+            std::vector<bool> used(pool.size(), false);
+            for (int r : transients)
+            {
+                resource_node &node = resources[r];
+                node.pooled = -1;
+                for (int i = 0; i < int(pool.size()) && node.pooled < 0; i++)
+                    if (pool[i].busy_until < node.first_use && compatible(pool[i].desc, node.desc))
+                        node.pooled = i;
+                if (node.pooled < 0)
+                {
+                    pooled_texture storage;
+                    storage.desc = node.desc;
+                    glGenTextures(1, &storage.texture);
+                    glBindTexture(GL_TEXTURE_2D, storage.texture);
+                    glTexStorage2D(GL_TEXTURE_2D, node.desc.levels, node.desc.format, node.desc.width, node.desc.height);
+                    glBindTexture(GL_TEXTURE_2D, 0);
+                    node.pooled = int(pool.size());
+                    pool.push_back(storage);
+                    used.push_back(false);
+                }
+                pooled_texture &storage = pool[node.pooled];
+                storage.busy_until = node.last_use;
+                if (!used[node.pooled])
+                    stats.aliased_bytes += storage.desc.byte_size();
+                used[node.pooled] = true;
+                stats.transient_bytes += node.desc.byte_size();
+                //sampler state belongs to the view, every transient sets its own
+                node.id = view(storage, node.desc.format);
+                glTextureParameteri(node.id, GL_TEXTURE_MIN_FILTER, node.desc.min_filter);
+                glTextureParameteri(node.id, GL_TEXTURE_MAG_FILTER, node.desc.mag_filter);
+                glTextureParameteri(node.id, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+                glTextureParameteri(node.id, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            }
+            for (size_t i = 0; i < pool.size(); i++)
+            {
+                pool[i].idle_frames = used[i] ? 0 : pool[i].idle_frames + 1;
+                stats.pool_bytes += pool[i].desc.byte_size();
+            }
+        }
+        void plan_barriers()
+        {
+            for (int p : order)
+            {
+                pass_node &pass = passes[p];
+                pass.barrier = 0;
+                for (const use &u : pass.uses)
+                    pass.barrier |= pending(resources[u.target]) & barrier_bits(u.how, resources[u.target].buffer);
+                if (pass.barrier)
+                {
+                    stats.barriers++;
+                    //a barrier covers every write issued before it
+                    for (pooled_texture &storage : pool)
+                        storage.pending &= ~pass.barrier;
+                    for (std::pair<const std::pair<bool, unsigned int>, GLbitfield> &imported : imported_pending)
+                        imported.second &= ~pass.barrier;
+                }
+                //a transient's contents are whatever its last write left, earlier writes no longer need barriers
+                for (const use &u : pass.uses)
+                    if (u.write && (incoherent(u.how) || resources[u.target].transient))
+                        pending(resources[u.target]) = incoherent(u.how) ? GL_ALL_BARRIER_BITS : 0;
+            }
+        }
+    public:
+        //a texture that only lives during this frame's passes. its contents are undefined until a pass writes it.
+        resource create_texture(const std::string &name, const texture_desc &desc)
+        {
+            resource_node node;
+            node.name = name;
+            node.transient = true;
+            node.desc = desc;
+            resources.push_back(node);
+            return resource(resources.size() - 1);
+        }
+        //a texture owned elsewhere. retained ones are used after the frame, the passes writing them are never culled.
+        resource import_texture(const std::string &name, unsigned int id, bool retained = false)
+        {
+            resource_node node;
+            node.name = name;
+            node.id = id;
+            node.retained = retained;
+            resources.push_back(node);
+            return resource(resources.size() - 1);
+        }
+        resource import_buffer(const std::string &name, unsigned int id, bool retained = false)
+        {
+            const resource r = import_texture(name, id, retained);
+            resources[r].buffer = true;
+            return r;
+        }
+        //adds a pass, its accesses are declared on the returned builder. execute runs when the graph executes,
+        //passes with side effects (presenting, reading back) always run.
+        pass_builder add_pass(const std::string &name, std::function<void()> execute, bool side_effect = false)
+        {
+            pass_node pass;
+            pass.name = name;
+            pass.execute = std::move(execute);
+            pass.side_effect = side_effect;
+            passes.push_back(std::move(pass));
+            return pass_builder(*this, int(passes.size()) - 1);
+        }
+        //orders and culls the passes, places the transients and plans the barriers. returns false, and executes
+        //nothing, if the passes depend on each other in a cycle.
+        bool compile()
+        {
+            stats = statistics();
+            stats.passes = int(passes.size());
+            order.clear();
+            const std::vector<std::vector<int>> after = dependencies();
+            //culling, from the passes whose results leave the frame back through everything they depend on
+            std::vector<bool> needed(passes.size(), false);
+            std::vector<int> stack;
+            for (int p = 0; p < int(passes.size()); p++)
+            {
+                bool retained = passes[p].side_effect;
+                for (const use &u : passes[p].uses)
+                    retained = retained || (u.write && resources[u.target].retained);
+                if (retained)
+                {
+                    needed[p] = true;
+                    stack.push_back(p);
+                }
+            }
+            while (!stack.empty())
+            {
+                const int p = stack.back();
+                stack.pop_back();
+                for (int dependency : after[p])
+                    if (!needed[dependency])
+                    {
+                        needed[dependency] = true;
+                        stack.push_back(dependency);
+                    }
+            }
+            //the earliest added pass whose dependencies all ran goes next
+            std::vector<bool> placed(passes.size(), false);
+            int remaining = 0;
+            for (int p = 0; p < int(passes.size()); p++)
+                remaining += needed[p];
+            stats.culled = stats.passes - remaining;
+            while (remaining > 0)
+            {
+                int next = -1;
+                for (int p = 0; p < int(passes.size()) && next < 0; p++)
+                {
+                    if (!needed[p] || placed[p])
+                        continue;
+                    bool ready = true;
+                    for (int dependency : after[p])
+                        ready = ready && placed[dependency];
+                    if (ready)
+                        next = p;
+                }
+                if (next < 0)
+                {
+                    std::cout << "render graph has a dependency cycle, nothing is executed" << std::endl;
+                    order.clear();
+                    return false;
+                }
+                placed[next] = true;
+                order.push_back(next);
+                remaining--;
+            }
+            for (resource_node &node : resources)
+                node.first_use = node.last_use = -1;
+            for (int position = 0; position < int(order.size()); position++)
+                for (const use &u : passes[order[position]].uses)
+                {
+                    resource_node &node = resources[u.target];
+                    if (node.first_use < 0)
+                        node.first_use = position;
+                    node.last_use = position;
+                }
+            allocate_transients();
+            plan_barriers();
+            return true;
+        }
+        //runs the compiled passes, then forgets them and their resources for the next frame
+        void execute()
+        {
+            for (int p : order)
+            {
+                if (passes[p].barrier)
+                    glMemoryBarrier(passes[p].barrier);
+                passes[p].execute();
+            }
+            passes.clear();
+            resources.clear();
+            order.clear();
+        }
+        //the GL name of a resource. for transients only valid from compile() on, while the graph executes.
+        unsigned int id(resource r) const {return resources[r].id;}
+        //a framebuffer with transient textures as color attachments 0, 1, ... and optionally depth or depth/stencil.
+        //framebuffers are cached, the same attachments return the same one in later frames.
+        unsigned int framebuffer(const std::vector<resource> &colors, resource depth = NONE)
+        {
+            std::vector<unsigned int> key;
+            for (resource r : colors)
+                key.push_back(resources[r].id);
+            key.push_back(depth == NONE ? 0 : resources[depth].id);
+            auto found = framebuffers.find(key);
+            if (found != framebuffers.end())
+                return found->second;
+            unsigned int framebuffer = 0;
+            glCreateFramebuffers(1, &framebuffer);
+            std::vector<GLenum> draw_buffers;
+            for (size_t i = 0; i < colors.size(); i++)
+            {
+                glNamedFramebufferTexture(framebuffer, GL_COLOR_ATTACHMENT0 + GLenum(i), key[i], 0);
+                draw_buffers.push_back(GL_COLOR_ATTACHMENT0 + GLenum(i));
+            }
+            glNamedFramebufferDrawBuffers(framebuffer, GLsizei(draw_buffers.size()), draw_buffers.data());
+            if (depth != NONE)
+            {
+                int stencil_bits = 0;
+                glGetTextureLevelParameteriv(key.back(), 0, GL_TEXTURE_STENCIL_SIZE, &stencil_bits);
+                glNamedFramebufferTexture(framebuffer, stencil_bits ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT, key.back(), 0);
+            }
+            if (glCheckNamedFramebufferStatus(framebuffer, GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+                std::cout << "render graph framebuffer incomplete" << std::endl;
+            framebuffers.emplace(key, framebuffer);
+            return framebuffer;
+        }
+        //writes the compiled order, with the barrier before each pass and the pooled texture each transient lives in
+        void print() const
+        {
+            std::cout << "render graph : " << order.size() << " of " << passes.size() << " passes" << std::endl;
+            for (int p : order)
+            {
+                std::cout << "  " << passes[p].name;
+                if (passes[p].barrier)
+                    std::cout << " (barrier 0x" << std::hex << passes[p].barrier << std::dec << ")";
+                std::cout << std::endl;
+            }
+            for (const resource_node &node : resources)
+                if (node.transient && node.first_use >= 0)
+                    std::cout << "  " << node.name << " : passes " << node.first_use << "-" << node.last_use << ", pooled texture " << node.pooled << std::endl;
+        }
+        const statistics& statistics_last_frame() const {return stats;}
+    };
+
+    inline pass_builder& pass_builder::read(resource target, access how)
+    {
+        graph.passes[index].uses.push_back({target, how, false});
+        return *this;
+    }
+    inline pass_builder& pass_builder::write(resource target, access how)
+    {
+        graph.passes[index].uses.push_back({target, how, true});
+        return *this;
+    }
+}
+#endif
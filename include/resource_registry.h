@@ -0,0 +1,311 @@
+#ifndef RESOURCE_REGISTRY
+#define RESOURCE_REGISTRY
+
+#include "glad/glad.h"
+#include "stb_image.h"
+#include "hash.h"
+#include "job_system.h"
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//shares GL textures and buffers between everything that loads the same data.
+//textures are looked up by canonical path first, then by a hash of the file bytes,
+//so the same image under two names is still uploaded once. buffers are keyed by a hash of their contents.
+//a matching hash is only a candidate : buffers and image files are compared byte for byte, and contents that merely
+//collide are given the next free key instead of sharing.
+//handles are reference counted : every acquire_*() must be matched by a release_*().
+namespace resources
+{
+    struct registry_stats
+    {
+        size_t texture_requests = 0, texture_hits = 0;
+        size_t buffer_requests = 0, buffer_hits = 0;
+        size_t bytes_uploaded = 0;  //GPU bytes actually allocated
+        size_t bytes_saved = 0;     //GPU bytes that would have been allocated without sharing
+    };
+    struct entry
+    {
+        unsigned int id = 0;
+        size_t byte_size = 0;
+        size_t content_size = 0;    //bytes hashed : the buffer's data, or the image file
+        int width = 0, height = 0, nr_channels = 0;     //textures only
+        std::string source;     //canonical path of the file a texture was decoded from
+        void (*forget)(unsigned int id) = nullptr;      //told when the texture is deleted, for textures made elsewhere
+        unsigned int ref_count = 0;
+        uint64_t hash = 0;
+    };
+
+    //uploads decoded pixels to a new GL_TEXTURE_2D with a full mip chain. color textures are sRGB,
+    //data textures such as normal maps should pass srgb = false.
+    //be warned that this functions expects 3 or 4 color channels.
+    size_t upload_texture_2D(const unsigned char* pixels, int width, int height, int nr_channels, unsigned int &tex_id, bool srgb = true)
+    {
+        glGenTextures(1, &tex_id);
+        glBindTexture(GL_TEXTURE_2D, tex_id);
+        const GLenum internal_format = srgb ? (nr_channels == 3 ? GL_SRGB : GL_SRGB_ALPHA) : (nr_channels == 3 ? GL_RGB8 : GL_RGBA8);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);  //RGB rows need not be 4 byte aligned
+        glTexImage2D(GL_TEXTURE_2D, 0, internal_format, width, height, 0,
+        nr_channels == 3 ? GL_RGB : GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+        glGenerateMipmap(GL_TEXTURE_2D);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return size_t(width)*height*4*4/3;  //drivers pad RGB to RGBA, mips add a third
+    }
+
+    class registry
+    {
+        std::unordered_map<std::string, uint64_t> texture_paths; //canonical path --> content hash
+        std::unordered_map<uint64_t, entry> textures;            //content hash --> texture
+        std::unordered_map<unsigned int, uint64_t> texture_ids;  //GL id --> content hash
+        std::unordered_map<uint64_t, entry> buffers;
+        std::unordered_map<unsigned int, uint64_t> buffer_ids;
+        registry_stats counters;
+        struct decoded_image
+        {
+            bool read = false;
+            std::vector<unsigned char> file_bytes;
+            unsigned char* pixels = nullptr;    //freed by acquire_texture()
+            int width = 0, height = 0, nr_channels = 0;
+        };
+        std::unordered_map<std::string, decoded_image> decoded_ahead;  //canonical path --> image from decode_ahead()
+
+        static std::string canonical(const std::string &path)
+        {
+            std::error_code error;
+            std::filesystem::path canon = std::filesystem::weakly_canonical(path, error);
+            return error ? path : canon.string();
+        }
+        static bool read_file(const std::string &path, std::vector<unsigned char> &bytes)
+        {
+            std::ifstream reader(path, std::ios::binary | std::ios::ate);
+            if (!reader)
+                return false;
+            bytes.resize(size_t(reader.tellg()));
+            reader.seekg(0);
+            return bool(reader.read(reinterpret_cast<char*>(bytes.data()), bytes.size()));
+        }
+        static void decode(decoded_image &image)
+        {
+            image.pixels = stbi_load_from_memory(image.file_bytes.data(), int(image.file_bytes.size()), &image.width, &image.height, &image.nr_channels, 0);
+        }
+        //the key of the resident texture made from the same file bytes, or the first free one from hash on. candidates
+        //with the same size and dimensions are confirmed against their source file, which is only read on a hit.
+        uint64_t texture_key(uint64_t hash, const decoded_image &image) const
+        {
+            std::vector<unsigned char> resident;
+            for (auto found = textures.find(hash); found != textures.end(); found = textures.find(++hash))
+            {
+                const entry &tex = found->second;
+                if (tex.content_size == image.file_bytes.size() && tex.width == image.width && tex.height == image.height
+                && tex.nr_channels == image.nr_channels && read_file(tex.source, resident) && resident == image.file_bytes)
+                    break;
+            }
+            return hash;
+        }
+        //the key of the resident buffer holding the same bytes, or the first free one from hash on
+        uint64_t buffer_key(uint64_t hash, const void* data, size_t byte_size)
+        {
+            std::vector<unsigned char> resident;
+            for (auto found = buffers.find(hash); found != buffers.end(); found = buffers.find(++hash))
+            {
+                if (found->second.content_size != byte_size)
+                    continue;
+                resident.resize(byte_size);
+                glGetNamedBufferSubData(found->second.id, 0, byte_size, resident.data());
+                if (memcmp(resident.data(), data, byte_size) == 0)
+                    break;
+            }
+            return hash;
+        }
+        bool share_texture(uint64_t key, unsigned int &tex_id)
+        {
+            auto found = textures.find(key);
+            if (found == textures.end())
+                return false;
+            found->second.ref_count++;
+            counters.texture_hits++;
+            counters.bytes_saved += found->second.byte_size;
+            tex_id = found->second.id;
+            return true;
+        }
+    public:
+        ~registry()
+        {
+            for (auto &image : decoded_ahead)
+                stbi_image_free(image.second.pixels);
+        }
+        //assigns tex_id a shared texture for the image at file_path, decoding and uploading it only if
+        //no texture with the same path or contents is resident. srgb = false keeps the texels linear (e.g. normal maps).
+        bool acquire_texture(const std::string &file_path, unsigned int &tex_id, bool srgb = true)
+        {
+            return acquire_texture(file_path, tex_id, srgb ? "" : "#linear",
+            [&](const unsigned char* pixels, int width, int height, int nr_channels, unsigned int &id)
+            {
+                const size_t byte_size = upload_texture_2D(pixels, width, height, nr_channels, id, srgb);
+                std::cout << "Loaded texture : " << file_path << std::endl;
+                return byte_size;
+            });
+        }
+        //the same sharing for textures another module makes : upload(pixels, width, height, nr_channels, tex_id) creates
+        //the texture and returns its GPU bytes. textures of one variant are only shared with each other, and forget,
+        //if given, is called with the id once the last reference is released, just before the texture is deleted.
+        template <typename U>
+        bool acquire_texture(const std::string &file_path, unsigned int &tex_id, const std::string &variant, U upload,
+        void (*forget)(unsigned int) = nullptr)
+        {
+            counters.texture_requests++;
+            const std::string key = canonical(file_path) + variant;
+            auto known_path = texture_paths.find(key);
+            if (known_path != texture_paths.end() && share_texture(known_path->second, tex_id))
+                return true;
+
+            decoded_image image;
+            auto ahead = decoded_ahead.find(canonical(file_path));
+            if (ahead != decoded_ahead.end())
+            {
+                image = std::move(ahead->second);
+                decoded_ahead.erase(ahead);
+            }
+            else
+                image.read = read_file(canonical(file_path), image.file_bytes);
+            if (!image.read)
+            {
+                std::cout << "reading texture file failed : " << file_path << std::endl;
+                return false;
+            }
+            //the header gives the dimensions to confirm a hash match with, without decoding
+            if (!image.pixels && !stbi_info_from_memory(image.file_bytes.data(), int(image.file_bytes.size()), &image.width, &image.height, &image.nr_channels))
+            {
+                std::cout << "decoding texture file failed : " << file_path << std::endl;
+                return false;
+            }
+            const uint64_t seed = hash_bytes(variant.data(), variant.size());
+            const uint64_t hash = texture_key(hash_bytes(image.file_bytes.data(), image.file_bytes.size(), seed), image);
+            texture_paths[key] = hash;
+            if (share_texture(hash, tex_id))
+            {
+                stbi_image_free(image.pixels);
+                return true;
+            }
+
+            if (!image.pixels)
+            {
+                stbi_set_flip_vertically_on_load(false);
+                decode(image);
+            }
+            if (!image.pixels)
+            {
+                std::cout << "decoding texture file failed : " << file_path << std::endl;
+                return false;
+            }
+            entry &tex = textures[hash];
+            tex.byte_size = upload(image.pixels, image.width, image.height, image.nr_channels, tex.id);
+            tex.content_size = image.file_bytes.size();
+            tex.width = image.width, tex.height = image.height, tex.nr_channels = image.nr_channels;
+            tex.source = canonical(file_path);
+            tex.forget = forget;
+            tex.ref_count = 1;
+            tex.hash = hash;
+            texture_ids[tex.id] = hash;
+            counters.bytes_uploaded += tex.byte_size;
+            stbi_image_free(image.pixels);
+            tex_id = tex.id;
+            return true;
+        }
+        //reads and decodes the images at file_paths as jobs, so the acquire_texture() calls that follow only hash and
+        //upload. paths already resident are skipped; every other one should be acquired afterwards, which frees its pixels.
+        void decode_ahead(const std::vector<std::string> &file_paths)
+        {
+            std::vector<std::string> paths;
+            for (const std::string &file_path : file_paths)
+            {
+                const std::string path = canonical(file_path);
+                if (texture_paths.count(path) || texture_paths.count(path + "#linear") || texture_paths.count(path + "#streamed")
+                || decoded_ahead.count(path))
+                    continue;
+                decoded_ahead[path];
+                paths.push_back(path);
+            }
+            std::vector<decoded_image*> images;
+            for (const std::string &path : paths)
+                images.push_back(&decoded_ahead[path]);
+            stbi_set_flip_vertically_on_load(false);
+            jobs::parallel_for(paths.size(), [&](size_t i)
+            {
+                images[i]->read = read_file(paths[i], images[i]->file_bytes);
+                if (images[i]->read)
+                    decode(*images[i]);
+            });
+        }
+        //drops one reference to tex_id, deleting the texture when none remain. unknown ids are ignored.
+        void release_texture(unsigned int tex_id)
+        {
+            auto id = texture_ids.find(tex_id);
+            if (id == texture_ids.end())
+                return;
+            entry &tex = textures[id->second];
+            if (--tex.ref_count > 0)
+                return;
+            if (tex.forget)
+                tex.forget(tex.id);
+            glDeleteTextures(1, &tex.id);
+            for (auto path = texture_paths.begin(); path != texture_paths.end();)
+                path = path->second == id->second ? texture_paths.erase(path) : std::next(path);
+            textures.erase(id->second);
+            texture_ids.erase(id);
+        }
+        //returns a buffer holding data, bound to target. identical contents share one buffer.
+        unsigned int acquire_buffer(GLenum target, const void* data, size_t byte_size)
+        {
+            counters.buffer_requests++;
+            //the target is part of the key so index and vertex data never alias
+            const uint64_t hash = buffer_key(hash_bytes(data, byte_size, target), data, byte_size);
+            entry &buf = buffers[hash];
+            if (buf.ref_count > 0)
+            {
+                buf.ref_count++;
+                counters.buffer_hits++;
+                counters.bytes_saved += byte_size;
+                glBindBuffer(target, buf.id);
+                return buf.id;
+            }
+            glGenBuffers(1, &buf.id);
+            glBindBuffer(target, buf.id);
+            glBufferData(target, byte_size, data, GL_STATIC_DRAW);
+            buf.byte_size = buf.content_size = byte_size;
+            buf.ref_count = 1;
+            buf.hash = hash;
+            buffer_ids[buf.id] = hash;
+            counters.bytes_uploaded += byte_size;
+            return buf.id;
+        }
+        void release_buffer(unsigned int buffer_id)
+        {
+            auto id = buffer_ids.find(buffer_id);
+            if (id == buffer_ids.end())
+                return;
+            entry &buf = buffers[id->second];
+            if (--buf.ref_count > 0)
+                return;
+            glDeleteBuffers(1, &buf.id);
+            buffers.erase(id->second);
+            buffer_ids.erase(id);
+        }
+        const registry_stats& stats() const {return counters;}
+        void print_stats() const
+        {
+            std::cout << "resources : " << textures.size() << " textures (" << counters.texture_hits << '/'
+            << counters.texture_requests << " shared), " << buffers.size() << " buffers (" << counters.buffer_hits << '/'
+            << counters.buffer_requests << " shared), " << counters.bytes_uploaded/1024 << " KiB uploaded, "
+            << counters.bytes_saved/1024 << " KiB saved" << std::endl;
+        }
+    };
+    registry shared;
+}
+#endif
@@ -0,0 +1,303 @@
+#ifndef SHADER_MANAGER
+#define SHADER_MANAGER
+
+#include "glad/glad.h"
+#include "shader_utils.h"
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+//KHR_parallel_shader_compile is not part of the generated glad loader
+#ifndef GL_MAX_SHADER_COMPILER_THREADS_KHR
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+//compiles every program up front and links them as their shaders finish, without ever blocking on the driver.
+//with KHR/ARB_parallel_shader_compile the driver compiles on its own threads and poll() only checks
+//GL_COMPLETION_STATUS_KHR, so a program becomes usable as soon as it is done instead of after all of them.
+//without the extension poll() falls back to finishing each program synchronously.
+//reload() recompiles a program from its current sources while the last good program keeps being served; the new
+//one replaces it inside poll() once it links, so a swap only ever happens between frames and a broken edit changes nothing.
+//sources go through a shader_source_library, so #includes are expanded and an edited header reloads exactly its users.
+class shader_manager
+{
+    typedef void (*max_compiler_threads_proc)(GLuint count);
+    enum program_state {COMPILING, LINKING, READY, FAILED};
+public:
+    typedef size_t handle;
+private:
+    struct shader_stage
+    {
+        GLenum type;
+        std::string path;
+        unsigned int id = 0;
+    };
+    struct program_request
+    {
+        std::vector<shader_stage> stages;   //vertex (+ geometry) + fragment, or a single compute stage
+        std::string defines;
+        uint64_t cache_key = 0;
+        unsigned int program_id = 0;        //the build in flight
+        unsigned int live_id = 0;           //last program that linked, what program() serves
+        program_state state = COMPILING;
+        std::chrono::steady_clock::time_point submitted;
+        std::string name() const
+        {
+            std::string joined;
+            for (const shader_stage &stage : stages)
+                joined += (joined.empty() ? "" : " + ") + stage.path;
+            return joined;
+        }
+    };
+    std::vector<program_request> requests;
+    shader_source_library library;
+    bool parallel = false;
+    bool use_cache = false;
+    bool blocking = false;  //set while waiting, status queries may stall then
+
+    bool complete(unsigned int object, bool is_program) const
+    {
+        if (!parallel || blocking)
+            return true;
+        int done = 0;
+        if (is_program)
+            glGetProgramiv(object, GL_COMPLETION_STATUS_KHR, &done);
+        else
+            glGetShaderiv(object, GL_COMPLETION_STATUS_KHR, &done);
+        return done;
+    }
+    bool compiled(const shader_stage &stage)
+    {
+        int success_status;
+        glGetShaderiv(stage.id, GL_COMPILE_STATUS, &success_status);
+        if (success_status)
+            return true;
+        char infoLog[512];
+        glGetShaderInfoLog(stage.id, 512, NULL, infoLog);
+        const char* type = stage.type == GL_VERTEX_SHADER ? "vertex shader" : stage.type == GL_GEOMETRY_SHADER ? "geometry shader" :
+        stage.type == GL_FRAGMENT_SHADER ? "fragment shader" : "compute shader";
+        std::cout << "compilation failed : " << type << " " << stage.path << "\n" << infoLog << "source strings : " << library.legend() << std::endl;
+        return false;
+    }
+    void delete_shaders(program_request &request)
+    {
+        for (shader_stage &stage : request.stages)
+        {
+            if (stage.id)
+                glDeleteShader(stage.id);
+            stage.id = 0;
+        }
+    }
+    //drops the build in flight. a reloaded program falls back to its last good version.
+    void fail(program_request &request)
+    {
+        delete_shaders(request);
+        if (request.program_id && request.program_id != request.live_id)
+            glDeleteProgram(request.program_id);
+        request.program_id = 0;
+        request.state = request.live_id ? READY : FAILED;
+        if (request.live_id)
+            std::cout << "keeping the last good program for " << request.name() << std::endl;
+    }
+    //makes the finished build the program served from now on
+    void publish(program_request &request)
+    {
+        if (request.live_id && request.live_id != request.program_id)
+            glDeleteProgram(request.live_id);
+        request.live_id = request.program_id;
+        request.state = READY;
+    }
+    //reads, specialises and starts compiling the request's sources. cached binaries are published immediately.
+    void start(program_request &request)
+    {
+        request.submitted = std::chrono::steady_clock::now();
+        std::vector<std::string> sources(request.stages.size());
+        for (size_t i = 0; i < sources.size(); i++)
+        {
+            if (!library.expand(request.stages[i].path, sources[i]))
+                return fail(request);
+            sources[i] = injectDefines(sources[i], request.defines);
+        }
+        float cached_compile_ms;
+        if (use_cache)
+        {
+            std::string later_stages;   //a vertex + fragment pair keys as program_cache::key(vertex, fragment, defines)
+            for (size_t i = 1; i < sources.size(); i++)
+                later_stages += sources[i];
+            request.cache_key = program_cache::key(sources[0], later_stages, request.defines);
+            if (program_cache::load(request.cache_key, request.program_id, cached_compile_ms))
+            {
+                program_cache::stats.hits++;
+                program_cache::stats.cached_compile_ms += cached_compile_ms;
+                program_cache::stats.load_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - request.submitted).count();
+                return publish(request);
+            }
+        }
+        for (size_t i = 0; i < sources.size(); i++)
+        {
+            const char* c_str = sources[i].c_str();
+            request.stages[i].id = glCreateShader(request.stages[i].type);
+            glShaderSource(request.stages[i].id, 1, &c_str, NULL);
+            glCompileShader(request.stages[i].id);
+        }
+        request.state = COMPILING;
+    }
+    void advance(program_request &request)
+    {
+        if (request.state == COMPILING)
+        {
+            for (const shader_stage &stage : request.stages)
+                if (!complete(stage.id, false))
+                    return;
+            for (const shader_stage &stage : request.stages)
+                if (!compiled(stage))
+                    return fail(request);
+            request.program_id = glCreateProgram();
+            glProgramParameteri(request.program_id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+            for (const shader_stage &stage : request.stages)
+                glAttachShader(request.program_id, stage.id);
+            glLinkProgram(request.program_id);
+            request.state = LINKING;
+        }
+        if (request.state == LINKING && complete(request.program_id, true))
+        {
+            int success_status;
+            glGetProgramiv(request.program_id, GL_LINK_STATUS, &success_status);
+            if (!success_status)
+            {
+                char infoLog[512];
+                glGetProgramInfoLog(request.program_id, 512, NULL, infoLog);
+                std::cout << "Linking failed : " << request.name() << "\n" << infoLog << std::endl;
+                return fail(request);
+            }
+            delete_shaders(request);
+            publish(request);
+            const float compile_ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - request.submitted).count();
+            program_cache::stats.misses++;
+            program_cache::stats.compile_ms += compile_ms;
+            if (use_cache)
+                program_cache::save(request.cache_key, request.program_id, compile_ms);
+        }
+    }
+    handle add(std::vector<shader_stage> stages, const std::string &defines)
+    {
+        program_request request;
+        request.stages = std::move(stages);
+        request.defines = defines;
+        requests.push_back(request);
+        start(requests.back());
+        return requests.size() - 1;
+    }
+public:
+
+    //call once after GL is loaded. load_proc resolves the extension entry point (e.g. glfwGetProcAddress).
+    void init(GLADloadproc load_proc)
+    {
+        use_cache = program_cache::supported();
+        int nr_extensions = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &nr_extensions);
+        const char* entry_point = nullptr;
+        for (int i = 0; i < nr_extensions && !entry_point; i++)
+        {
+            const char* extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+            if (strcmp(extension, "GL_KHR_parallel_shader_compile") == 0)
+                entry_point = "glMaxShaderCompilerThreadsKHR";
+            else if (strcmp(extension, "GL_ARB_parallel_shader_compile") == 0)
+                entry_point = "glMaxShaderCompilerThreadsARB";
+        }
+        max_compiler_threads_proc max_compiler_threads = entry_point ? (max_compiler_threads_proc)load_proc(entry_point) : nullptr;
+        parallel = max_compiler_threads != nullptr;
+        if (parallel)
+            max_compiler_threads(0xFFFFFFFFu);  //let the driver pick its thread count
+    }
+    //queues a program. cached binaries are ready immediately, everything else starts compiling without waiting.
+    handle submit(const char* vertex_shader_path, const char* fragment_shader_path, const std::string &defines = "")
+    {
+        return add({{GL_VERTEX_SHADER, vertex_shader_path}, {GL_FRAGMENT_SHADER, fragment_shader_path}}, defines);
+    }
+    //same as submit() with a geometry shader between the two stages
+    handle submit_geometry(const char* vertex_shader_path, const char* geometry_shader_path, const char* fragment_shader_path, const std::string &defines = "")
+    {
+        return add({{GL_VERTEX_SHADER, vertex_shader_path}, {GL_GEOMETRY_SHADER, geometry_shader_path}, {GL_FRAGMENT_SHADER, fragment_shader_path}}, defines);
+    }
+    //same as submit() for a compute program
+    handle submit_compute(const char* compute_shader_path, const std::string &defines = "")
+    {
+        return add({{GL_COMPUTE_SHADER, compute_shader_path}}, defines);
+    }
+    //recompiles every program built from file_path or including it, e.g. after it was edited. the current programs
+    //stay in use until their replacements link. returns the number of programs restarted.
+    size_t reload(const std::string &file_path)
+    {
+        const std::unordered_set<std::string> affected = library.invalidate(file_path);
+        size_t restarted = 0;
+        for (program_request &request : requests)
+        {
+            bool uses_file = false;
+            for (const shader_stage &stage : request.stages)
+                uses_file = uses_file || affected.count(library.canonical(stage.path));
+            if (!uses_file)
+                continue;
+            //an older reload still in flight is superseded
+            if (request.state == COMPILING || request.state == LINKING)
+            {
+                delete_shaders(request);
+                if (request.program_id != request.live_id)
+                    glDeleteProgram(request.program_id);
+            }
+            request.program_id = 0;
+            start(request);
+            restarted++;
+        }
+        return restarted;
+    }
+    //moves every program along as far as the driver allows. cheap enough to call every frame.
+    void poll()
+    {
+        for (program_request &request : requests)
+            if (request.state == COMPILING || request.state == LINKING)
+                advance(request);
+    }
+    //finishes every pending program, blocking on the driver. returns false if any program failed.
+    bool wait_all()
+    {
+        bool success = true;
+        blocking = true;
+        for (program_request &request : requests)
+        {
+            while (request.state == COMPILING || request.state == LINKING)
+                advance(request);
+            success = success && request.state == READY;
+        }
+        blocking = false;
+        return success;
+    }
+    //true once any version of the program linked, even while a reload is still compiling
+    bool ready(handle id) const {return requests[id].live_id != 0;}
+    bool failed(handle id) const {return requests[id].state == FAILED;}
+    //0 until the program is ready
+    unsigned int program(handle id) const {return requests[id].live_id;}
+    size_t failures() const
+    {
+        size_t count = 0;
+        for (const program_request &request : requests)
+            count += request.state == FAILED;
+        return count;
+    }
+    size_t pending() const
+    {
+        size_t count = 0;
+        for (const program_request &request : requests)
+            count += request.state == COMPILING || request.state == LINKING;
+        return count;
+    }
+    bool parallel_compile() const {return parallel;}
+    //every shader file and header read so far
+    std::vector<std::string> source_files() const {return library.paths();}
+};
+#endif
@@ -0,0 +1,86 @@
+#ifndef SHADER_PERMUTATIONS
+#define SHADER_PERMUTATIONS
+
+#include "shader_manager.h"
+#include "object_interface.h"
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+//compile time specialisation of a shader pair. every distinct feature set becomes its own program with the
+//matching #defines, so a draw only pays for the lights and texture fetches its material actually uses.
+//variants compile on demand through the shader_manager and are cached by a packed key of their features.
+struct shader_features
+{
+    int point_lights = 1;
+    int directional_lights = 0;
+    int spot_lights = 1;
+    bool ambient_light = false;
+    bool spec_map = true;
+    bool normal_map = false;
+    bool emissive = false;
+    bool ibl = false;
+    bool clustered_lights = false;  //point lights from the light clusters, see clustered_lighting.h
+    bool sun_shadows = false;       //directional light 0 is shadowed by the sun's cascades, see cascaded_shadows.h
+    bool local_shadows = false;     //point and spot lights can be shadowed from the shadow atlas, see shadow_atlas.h
+    bool transparent = false;       //writes into the transparency targets instead of color and motion, see transparency.h
+
+    //light counts are clamped to 255 per type
+    uint64_t key() const
+    {
+        auto count = [](int n) {return uint64_t(n < 0 ? 0 : (n > 255 ? 255 : n));};
+        return count(point_lights) | count(directional_lights) << 8 | count(spot_lights) << 16 |
+        uint64_t(ambient_light) << 24 | uint64_t(spec_map) << 25 | uint64_t(normal_map) << 26 |
+        uint64_t(emissive) << 27 | uint64_t(ibl) << 28 | uint64_t(clustered_lights) << 29 | uint64_t(sun_shadows) << 30 | uint64_t(local_shadows) << 31 | uint64_t(transparent) << 32;
+    }
+    std::string defines() const
+    {
+        return "#define NR_POINT_LIGHTS " + std::to_string(point_lights) + "\n"
+        "#define NR_DIRECTIONAL_LIGHTS " + std::to_string(directional_lights) + "\n"
+        "#define NR_SPOT_LIGHTS " + std::to_string(spot_lights) + "\n"
+        "#define HAS_AMBIENT_LIGHT " + std::to_string(int(ambient_light)) + "\n"
+        "#define HAS_SPEC_MAP " + std::to_string(int(spec_map)) + "\n"
+        "#define HAS_NORMAL_MAP " + std::to_string(int(normal_map)) + "\n"
+        "#define EMISSIVE " + std::to_string(int(emissive)) + "\n"
+        "#define USE_IBL " + std::to_string(int(ibl)) + "\n"
+        "#define CLUSTERED_LIGHTS " + std::to_string(int(clustered_lights)) + "\n"
+        "#define SUN_SHADOWS " + std::to_string(int(sun_shadows)) + "\n"
+        "#define LOCAL_SHADOWS " + std::to_string(int(local_shadows)) + "\n"
+        "#define TRANSPARENT " + std::to_string(int(transparent)) + "\n";
+    }
+};
+//the scene's lighting with the texture features of mat
+shader_features material_features(const object_3D::material &mat, shader_features lighting)
+{
+    lighting.spec_map = mat.spec_map.id > 0;
+    lighting.normal_map = mat.normal_map.id > 0;
+    lighting.emissive = mat.emissive;
+    lighting.transparent = mat.opacity < 1.0f;
+    return lighting;
+}
+
+class shader_permutations
+{
+    shader_manager &manager;
+    const std::string vertex_path, fragment_path;
+    std::unordered_map<uint64_t, shader_manager::handle> variants;
+public:
+    shader_permutations(shader_manager &manager, const char* vertex_shader_path, const char* fragment_shader_path) :
+    manager(manager), vertex_path(vertex_shader_path), fragment_path(fragment_shader_path) {}
+
+    //submits the variant for features unless it already exists
+    shader_manager::handle request(const shader_features &features)
+    {
+        auto found = variants.find(features.key());
+        if (found != variants.end())
+            return found->second;
+        const shader_manager::handle variant = manager.submit(vertex_path.c_str(), fragment_path.c_str(), features.defines());
+        variants.emplace(features.key(), variant);
+        return variant;
+    }
+    //the program for features, or 0 while it is still compiling (or failed)
+    unsigned int program(const shader_features &features) {return manager.program(request(features));}
+    size_t size() const {return variants.size();}
+};
+#endif
\ No newline at end of file
@@ -0,0 +1,264 @@
+#ifndef SHADER_SOURCES
+#define SHADER_SOURCES
+
+#include "hash.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+//read-only view of a whole file. the file is mapped where mmap is available, otherwise read into memory once.
+class mapped_file
+{
+    const char* data = nullptr;
+    size_t size = 0;
+#if defined(__unix__) || defined(__APPLE__)
+    void* mapping = nullptr;
+#else
+    std::string contents;
+#endif
+public:
+    mapped_file(const std::string &path)
+    {
+#if defined(__unix__) || defined(__APPLE__)
+        const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return;
+        struct stat info;
+        if (fstat(fd, &info) == 0 && info.st_size > 0)
+        {
+            mapping = mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping == MAP_FAILED)
+                mapping = nullptr;
+            else
+            {
+                data = static_cast<const char*>(mapping);
+                size = size_t(info.st_size);
+            }
+        }
+        else if (fstat(fd, &info) == 0)
+            data = "";  //an empty file opens fine but cannot be mapped
+        close(fd);
+#else
+        std::ifstream reader(path, std::ios::binary);
+        if (!reader)
+            return;
+        contents.assign(std::istreambuf_iterator<char>(reader), std::istreambuf_iterator<char>());
+        data = contents.data();
+        size = contents.size();
+#endif
+    }
+    ~mapped_file()
+    {
+#if defined(__unix__) || defined(__APPLE__)
+        if (mapping)
+            munmap(mapping, size);
+#endif
+    }
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    bool is_open() const {return data != nullptr;}
+    std::string_view view() const {return std::string_view(data ? data : "", size);}
+};
+
+//loads shader sources and expands their #include "file" directives, resolved relative to the including file.
+//every file is read once and kept until invalidate()d, and the include edges form a dependency graph, so an edited
+//header tells exactly which top level shaders have to be rebuilt. every top level file keeps its last expansion with
+//a hash of all the files it was built from, so an edit replaces the entry instead of adding one. each file is
+//included at most once per expansion, which also breaks include cycles.
+//#line directives keep compiler messages pointing at the right file : source string 0 is the top level file,
+//an included file reports as source string id(path).
+class shader_source_library
+{
+    struct source_file
+    {
+        std::string text;
+        uint64_t hash = 0;
+        std::vector<std::string> includes;  //canonical paths in the order they appear
+        std::vector<size_t> include_lines;  //line of each #include, counted from 1
+        int id = 0;
+        bool loaded = false;
+    };
+    std::unordered_map<std::string, source_file> files;   //canonical path --> file
+    struct expansion
+    {
+        uint64_t hash = 0;      //of the file and its includes when it was expanded
+        std::string source;
+    };
+    std::unordered_map<std::string, expansion> expanded;  //canonical top level path --> its latest expansion
+    std::vector<std::string> names;                       //id - 1 --> path, for compiler messages
+
+    //the quoted name of an #include line, empty for every other line
+    static std::string_view include_name(std::string_view line)
+    {
+        const size_t hash = line.find_first_not_of(" \t");
+        if (hash == std::string_view::npos || line.compare(hash, 8, "#include") != 0)
+            return {};
+        const size_t open = line.find_first_of("\"<", hash + 8);
+        const size_t close = open == std::string_view::npos ? open : line.find_first_of("\">", open + 1);
+        return close == std::string_view::npos ? std::string_view() : line.substr(open + 1, close - open - 1);
+    }
+    source_file* load(const std::string &path)
+    {
+        source_file &file = files[path];
+        if (file.loaded)
+            return &file;
+        if (!file.id)
+        {
+            names.push_back(path);
+            file.id = int(names.size());
+        }
+        //the mapping only lives for the load, so an editor truncating the file later can not fault a reader
+        const mapped_file mapped(path);
+        if (!mapped.is_open())
+        {
+            std::cout << "failed to open shader file : " << path << std::endl;
+            return nullptr;
+        }
+        const std::string_view text = mapped.view();
+        file.includes.clear();
+        file.include_lines.clear();
+        const std::filesystem::path directory = std::filesystem::path(path).parent_path();
+        size_t line_number = 1;
+        for (size_t start = 0; start < text.size(); line_number++)
+        {
+            const size_t end = std::min(text.find('\n', start), text.size());
+            const std::string_view name = include_name(text.substr(start, end - start));
+            if (!name.empty())
+            {
+                file.includes.push_back(canonical((directory/std::string(name)).string()));
+                file.include_lines.push_back(line_number);
+            }
+            start = end + 1;
+        }
+        file.text.assign(text);
+        file.hash = resources::hash_bytes(text.data(), text.size());
+        file.loaded = true;
+        return &file;
+    }
+    //loads path and everything it includes, folding their contents into hash
+    bool gather(const std::string &path, uint64_t &hash, std::unordered_set<std::string> &visited)
+    {
+        if (!visited.insert(path).second)
+            return true;
+        const source_file* file = load(path);
+        if (!file)
+            return false;
+        hash = resources::hash_bytes(&file->hash, sizeof(file->hash), hash);
+        for (const std::string &include : file->includes)
+            if (!gather(include, hash, visited))
+                return false;
+        return true;
+    }
+    void emit(const std::string &path, int source_string, std::string &out, std::unordered_set<std::string> &emitted) const
+    {
+        emitted.insert(path);
+        const source_file &file = files.at(path);
+        const std::string_view text = file.text;
+        size_t line_number = 1, next_include = 0;
+        for (size_t start = 0; start < text.size(); line_number++)
+        {
+            const size_t end = std::min(text.find('\n', start), text.size());
+            if (next_include < file.includes.size() && file.include_lines[next_include] == line_number)
+            {
+                const std::string &include = file.includes[next_include++];
+                if (!emitted.count(include))
+                {
+                    out += "#line 1 " + std::to_string(files.at(include).id) + "\n";
+                    emit(include, files.at(include).id, out, emitted);
+                    out += "#line " + std::to_string(line_number + 1) + " " + std::to_string(source_string) + "\n";
+                }
+                else
+                    out += "\n";   //keeps the line count
+            }
+            else
+            {
+                out.append(text.substr(start, end - start));
+                out += '\n';
+            }
+            start = end + 1;
+        }
+    }
+public:
+    static std::string canonical(const std::string &path)
+    {
+        std::error_code error;
+        std::filesystem::path canon = std::filesystem::weakly_canonical(path, error);
+        return error ? path : canon.string();
+    }
+    //path with its #includes expanded into source. only files that changed since their last load are read again.
+    bool expand(const std::string &path, std::string &source)
+    {
+        const std::string top = canonical(path);
+        uint64_t hash = 0;
+        std::unordered_set<std::string> visited;
+        if (!gather(top, hash, visited))
+            return false;
+        expansion &cached = expanded[top];
+        if (cached.hash != hash || cached.source.empty())
+        {
+            cached.source.clear();
+            std::unordered_set<std::string> emitted;
+            emit(top, 0, cached.source, emitted);
+            cached.hash = hash;
+        }
+        source = cached.source;
+        return true;
+    }
+    //forgets the contents of path, e.g. after it was edited. returns path and every file that includes it,
+    //directly or through other headers.
+    std::unordered_set<std::string> invalidate(const std::string &path)
+    {
+        const std::string changed = canonical(path);
+        std::unordered_set<std::string> affected = {changed};
+        auto file = files.find(changed);
+        if (file != files.end())
+            file->second.loaded = false;
+        for (bool grew = true; grew;)
+        {
+            grew = false;
+            for (const auto &candidate : files)
+                if (!affected.count(candidate.first))
+                    for (const std::string &include : candidate.second.includes)
+                        if (affected.count(include))
+                        {
+                            affected.insert(candidate.first);
+                            grew = true;
+                            break;
+                        }
+        }
+        return affected;
+    }
+    //every file read so far, so callers can watch headers too
+    std::vector<std::string> paths() const
+    {
+        std::vector<std::string> known;
+        for (const auto &file : files)
+            known.push_back(file.first);
+        return known;
+    }
+    //which file each source string number in a compiler message refers to
+    std::string legend() const
+    {
+        std::string text = "0 : the shader itself";
+        for (size_t i = 0; i < names.size(); i++)
+            text += ", " + std::to_string(i + 1) + " : " + names[i];
+        return text;
+    }
+};
+#endif
@@ -2,36 +2,37 @@
 #define SHADER_UTIL
 
 #include "glad/glad.h"
+#include "hash.h"
+#include "shader_sources.h"
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
-#include <sstream>
+#include <iterator>
+#include <string>
 #include <cstring>
+#include <vector>
 
 enum shader_type_option
 {
     VERTEX_SHADER,
     FRAGMENT_SHADER
 };
-//reads file into file_contents_holder
+//reads file into file_contents_holder, null terminated
 //WARNING : caller must ensure that file_contents_holder is properly delete[]`d.
 bool readShaderFile(const char* file_path, char* &file_contents_holder)
 {
-    std::ifstream reader;
-    reader.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-    try
-    {
-        reader.open(file_path);
-        std::stringstream file_stream;
-        file_stream << reader.rdbuf();
-        reader.close();
-        file_contents_holder = new char[strlen(file_stream.str().c_str())];
-        strcpy(file_contents_holder, file_stream.str().c_str());
-    }
-    catch (std::ifstream::failure e)
+    const mapped_file file(file_path);
+    if (!file.is_open())
     {
         std::cout << "failed to open shader file : " << file_path << std::endl;
         return false;
     }
+    const std::string_view contents = file.view();
+    file_contents_holder = new char[contents.size() + 1];
+    memcpy(file_contents_holder, contents.data(), contents.size());
+    file_contents_holder[contents.size()] = '\0';
     return true;
 }
 bool compileShader(shader_type_option shader, unsigned int &shader_id, const char* const &shader_source)
@@ -64,10 +65,9 @@ bool compileShaderFromPath(shader_type_option shader, unsigned int &shader_id, c
     char* shader_source;
     if (!readShaderFile(file_path, shader_source))
         return false;
-    if (!compileShader(shader, shader_id, shader_source))
-        return false;
+    const bool compiled = compileShader(shader, shader_id, shader_source);
     delete[]shader_source;
-    return true;
+    return compiled;
 }
 bool linkShaders(unsigned int &program_id, const unsigned int& vertex_shader_id, const unsigned int& fragment_shader_id)
 {
@@ -113,4 +113,109 @@ bool makeShaderProgram(const char* vertex_shader_path, const char* fragment_shad
     return true;
 }
 
+//inserts defines (e.g. "#define NR_LIGHTS 4\n") right after the #version line.
+//a #line directive after them keeps compiler messages on the original line numbers.
+std::string injectDefines(const std::string &source, const std::string &defines)
+{
+    if (defines.empty())
+        return source;
+    const size_t version = source.find("#version");
+    const size_t line_end = version == std::string::npos ? std::string::npos : source.find('\n', version);
+    if (line_end == std::string::npos)
+        return defines + source;
+    const long next_line = std::count(source.begin(), source.begin() + line_end, '\n') + 2;
+    return source.substr(0, line_end + 1) + defines + "#line " + std::to_string(next_line) + "\n" + source.substr(line_end + 1);
+}
+//on disk cache of linked program binaries. entries are keyed by the shader sources, the defines and the
+//driver (GL_RENDERER, GL_VERSION), so a driver update or a shader edit simply misses the cache.
+namespace program_cache
+{
+    constexpr uint32_t MAGIC = 0x50524731; //"PRG1"
+    struct file_header
+    {
+        uint32_t magic;
+        uint32_t binary_format;
+        uint32_t binary_length;
+        float compile_ms;   //what a cache miss cost, for startup reports
+    };
+    struct cache_stats
+    {
+        unsigned int hits = 0, misses = 0, rejected = 0; //rejected : a cached binary the driver refused
+        double load_ms = 0.0, compile_ms = 0.0;
+        double cached_compile_ms = 0.0;  //compile time the hits would have cost without the cache
+    };
+    cache_stats stats;
+    std::string directory = "cache/programs";
+
+    bool supported()
+    {
+        int nr_formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &nr_formats);
+        return nr_formats > 0;
+    }
+    uint64_t key(const std::string &vertex_source, const std::string &fragment_source, const std::string &defines)
+    {
+        const char* renderer = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+        const char* version = reinterpret_cast<const char*>(glGetString(GL_VERSION));
+        const std::string driver = std::string(renderer ? renderer : "") + '\n' + (version ? version : "");
+        uint64_t h = resources::hash_bytes(driver.data(), driver.size());
+        h = resources::hash_bytes(defines.data(), defines.size(), h);
+        h = resources::hash_bytes(vertex_source.data(), vertex_source.size(), h);
+        return resources::hash_bytes(fragment_source.data(), fragment_source.size(), h);
+    }
+    std::string path(uint64_t key)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+        return (std::filesystem::path(directory)/name).string();
+    }
+    //creates program_id from a cached binary. fails on a missing entry or a binary the driver no longer accepts.
+    bool load(uint64_t key, unsigned int &program_id, float &compile_ms)
+    {
+        std::ifstream reader(path(key), std::ios::binary);
+        file_header header;
+        if (!reader || !reader.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.magic != MAGIC)
+            return false;
+        std::vector<char> binary(header.binary_length);
+        if (!reader.read(binary.data(), binary.size()))
+            return false;
+        program_id = glCreateProgram();
+        glProgramBinary(program_id, header.binary_format, binary.data(), header.binary_length);
+        int success_status;
+        glGetProgramiv(program_id, GL_LINK_STATUS, &success_status);
+        if (!success_status)
+        {
+            glDeleteProgram(program_id);
+            stats.rejected++;
+            return false;
+        }
+        compile_ms = header.compile_ms;
+        return true;
+    }
+    void save(uint64_t key, unsigned int program_id, float compile_ms)
+    {
+        int length = 0;
+        glGetProgramiv(program_id, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return;
+        std::vector<char> binary(length);
+        GLenum format;
+        glGetProgramBinary(program_id, length, NULL, &format, binary.data());
+        std::error_code error;
+        std::filesystem::create_directories(directory, error);
+        std::ofstream writer(path(key), std::ios::binary);
+        const file_header header{MAGIC, format, uint32_t(length), compile_ms};
+        writer.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        writer.write(binary.data(), binary.size());
+    }
+    void print_stats()
+    {
+        std::cout << "shader programs : " << stats.hits << " from cache in " << stats.load_ms << "ms (" << stats.cached_compile_ms
+        << "ms to compile without the cache), " << stats.misses << " compiled in " << stats.compile_ms << "ms";
+        if (stats.rejected)
+            std::cout << ", " << stats.rejected << " stale binaries recompiled";
+        std::cout << std::endl;
+    }
+}
+
 #endif
\ No newline at end of file
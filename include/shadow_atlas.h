@@ -0,0 +1,349 @@
+#ifndef SHADOW_ATLAS
+#define SHADOW_ATLAS
+
+#include "glad/glad.h"
+#include "glm/glm.hpp"
+#include "glm/gtc/matrix_transform.hpp"
+#include "shader_manager.h"
+#include "cascaded_shadows.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+//shadows for point and spot lights, all in one depth texture. every light gets square tiles of the atlas sized by how
+//much of the screen its light can reach : one tile for a spot light, one per cube face for a point light. the six
+//faces of a point light are drawn in a single pass, a geometry shader (src/shadow_cube.geom) sends every triangle to
+//the viewport of each face. lights only redraw after they moved, most important first, within a per frame budget of
+//views, so a frame never pays for every light. static lights are drawn once. src/shadow_atlas.glsl samples the tiles.
+namespace shadows
+{
+    constexpr int ATLAS_UNIT = 12;              //binding of shadow_atlas
+    constexpr int SHADOW_VIEW_BINDING = 4;      //storage buffer binding of shadow_views
+    constexpr int MIN_TILE = 64, MAX_TILE = 1024;
+
+    //std430 layout of shadow_view
+    struct shadow_view
+    {
+        glm::mat4 view_projection;
+        glm::vec4 atlas_rect;       //offset and size of the tile in atlas uv
+        glm::vec4 position_texel;   //light position, world space size of a texel one unit away from the light in w
+    };
+
+    //hands out power of two square tiles of a square area. a tile is split in four to make smaller ones, and four
+    //free quarters are merged back, so the atlas does not fragment as lights come and go.
+    class tile_allocator
+    {
+        int size = 0;
+        std::vector<std::vector<glm::ivec2>> free_tiles;   //per level, level 0 is the whole area
+
+        int level(int tile) const
+        {
+            int l = 0;
+            while ((size >> l) > tile)
+                l++;
+            return l;
+        }
+    public:
+        void reset(int area_size, int min_tile)
+        {
+            size = area_size;
+            free_tiles.assign(level(min_tile) + 1, {});
+            free_tiles[0].push_back(glm::ivec2(0));
+        }
+        bool allocate(int tile, glm::ivec2 &origin)
+        {
+            const int target = level(tile);
+            int from = target;
+            while (from >= 0 && free_tiles[from].empty())
+                from--;
+            if (from < 0)
+                return false;
+            for (; from < target; from++)
+            {
+                const glm::ivec2 parent = free_tiles[from].back();
+                free_tiles[from].pop_back();
+                const int half = size >> (from + 1);
+                for (glm::ivec2 quarter : {glm::ivec2(half, half), glm::ivec2(0, half), glm::ivec2(half, 0), glm::ivec2(0)})
+                    free_tiles[from + 1].push_back(parent + quarter);
+            }
+            origin = free_tiles[target].back();
+            free_tiles[target].pop_back();
+            return true;
+        }
+        void release(int tile, glm::ivec2 origin)
+        {
+            int l = level(tile);
+            for (; l > 0; l--)
+            {
+                //merge with the other three quarters of the parent if all of them are free
+                const int child = size >> l;
+                const glm::ivec2 parent = origin/(2*child)*(2*child);
+                std::vector<glm::ivec2> &tiles = free_tiles[l];
+                int siblings = 0;
+                for (const glm::ivec2 &free_tile : tiles)
+                    siblings += free_tile != origin && free_tile/(2*child)*(2*child) == parent;
+                if (siblings < 3)
+                    break;
+                tiles.erase(std::remove_if(tiles.begin(), tiles.end(), [&](const glm::ivec2 &free_tile)
+                {return free_tile/(2*child)*(2*child) == parent;}), tiles.end());
+                origin = parent;
+            }
+            free_tiles[l].push_back(origin);
+        }
+    };
+
+    class shadow_atlas
+    {
+    public:
+        typedef size_t handle;
+        struct statistics
+        {
+            size_t atlas_bytes = 0;
+            size_t allocated_bytes = 0;     //tiles currently held by lights
+            int lights_updated = 0;         //during the last update()
+            int views_rendered = 0;
+            int shadow_draws = 0;
+        };
+    private:
+        enum light_type {POINT, SPOT};
+        struct shadow_light
+        {
+            light_type type;
+            bool is_static;
+            glm::vec3 position = glm::vec3(0.0f), direction = glm::vec3(0.0f, 0.0f, -1.0f);
+            float range = 1.0f, cosine_angle = 0.0f;
+            size_t first_view = 0;              //6 consecutive views for a point light, 1 for a spot light
+            int tile = 0;                       //0 while the light holds no tiles
+            glm::ivec2 origins[6];
+            bool moved = true, rendered = false;
+            float coverage = 0.0f;              //fraction of the screen height its light can reach
+            int frames_waiting = 0;
+            int views() const {return type == POINT ? 6 : 1;}
+        };
+        std::vector<shadow_light> lights;
+        std::vector<shadow_view> views;
+        tile_allocator allocator;
+        unsigned int framebuffer = 0, atlas = 0, view_buffer = 0;
+        size_t view_capacity = 0;
+        int atlas_size = 0;
+        statistics stats;
+        shader_manager* manager = nullptr;
+        shader_manager::handle spot_program = 0, cube_program = 0;
+
+        void release_tiles(shadow_light &light)
+        {
+            for (int i = 0; light.tile && i < light.views(); i++)
+                allocator.release(light.tile, light.origins[i]);
+            stats.allocated_bytes -= light.tile ? size_t(light.views())*light.tile*light.tile*4 : 0;
+            light.tile = 0;
+            light.rendered = false;
+        }
+        //holds tiles of the wanted size, or the largest smaller size that still fits
+        void allocate_tiles(shadow_light &light, int wanted)
+        {
+            release_tiles(light);
+            for (int tile = wanted; tile >= MIN_TILE; tile /= 2)
+            {
+                int allocated = 0;
+                while (allocated < light.views() && allocator.allocate(tile, light.origins[allocated]))
+                    allocated++;
+                if (allocated == light.views())
+                {
+                    light.tile = tile;
+                    stats.allocated_bytes += size_t(light.views())*tile*tile*4;
+                    return;
+                }
+                while (allocated-- > 0)
+                    allocator.release(tile, light.origins[allocated]);
+            }
+        }
+        void fill_views(const shadow_light &light)
+        {
+            static const glm::vec3 face_directions[6] = {{1, 0, 0}, {-1, 0, 0}, {0, 1, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1}};
+            static const glm::vec3 face_ups[6] = {{0, -1, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1}, {0, -1, 0}, {0, -1, 0}};
+            const float near_plane = 0.05f;
+            //a 90 degree cube face, or the spot cone with a texel of margin for the filter
+            const float half_fov = light.type == POINT ? glm::radians(45.0f) : std::acos(light.cosine_angle) + 2.0f/light.tile;
+            const glm::mat4 projection = glm::perspective(2.0f*half_fov, 1.0f, near_plane, light.range);
+            for (int i = 0; i < light.views(); i++)
+            {
+                const glm::vec3 direction = light.type == POINT ? face_directions[i] : light.direction;
+                const glm::vec3 up = light.type == POINT ? face_ups[i] : (std::fabs(direction.y) > 0.99f ? glm::vec3(1, 0, 0) : glm::vec3(0, 1, 0));
+                shadow_view &view = views[light.first_view + i];
+                view.view_projection = projection*glm::lookAt(light.position, light.position + direction, up);
+                view.atlas_rect = glm::vec4(glm::vec2(light.origins[i]), glm::vec2(float(light.tile)))/float(atlas_size);
+                view.position_texel = glm::vec4(light.position, 2.0f*std::tan(half_fov)/light.tile);
+            }
+        }
+        int render(const shadow_light &light, draw_casters_proc draw_casters)
+        {
+            const unsigned int program_id = manager->program(light.type == POINT ? cube_program : spot_program);
+            glUseProgram(program_id);
+            glEnable(GL_SCISSOR_TEST);
+            for (int i = 0; i < light.views(); i++)
+            {
+                const glm::ivec2 &origin = light.origins[i];
+                glViewportIndexedf(i, float(origin.x), float(origin.y), float(light.tile), float(light.tile));
+                glScissor(origin.x, origin.y, light.tile, light.tile);
+                glClear(GL_DEPTH_BUFFER_BIT);
+            }
+            glDisable(GL_SCISSOR_TEST);
+            if (light.type == POINT)
+            {
+                glm::mat4 faces[6];
+                for (int i = 0; i < 6; i++)
+                    faces[i] = views[light.first_view + i].view_projection;
+                glUniformMatrix4fv(glGetUniformLocation(program_id, "face_view_projections"), 6, GL_FALSE, &faces[0][0][0]);
+            }
+            else
+                glUniformMatrix4fv(glGetUniformLocation(program_id, "light_view_projection"), 1, GL_FALSE, &views[light.first_view].view_projection[0][0]);
+            return draw_casters(program_id, false);
+        }
+        handle add(light_type type, bool is_static)
+        {
+            shadow_light light;
+            light.type = type;
+            light.is_static = is_static;
+            light.first_view = views.size();
+            views.resize(views.size() + light.views());
+            lights.push_back(light);
+            return lights.size() - 1;
+        }
+    public:
+        int max_views_per_frame = 12;   //update budget, a point light counts six. one light always updates.
+        float resolution_scale = 1.0f;  //tile texels per screen pixel the light reaches
+
+        //creates the atlas and submits both depth programs. call once GL is loaded.
+        void init(shader_manager &shaders, int size = 4096)
+        {
+            manager = &shaders;
+            atlas_size = size;
+            spot_program = shaders.submit("src/shadow_depth.vert", "src/shadow_depth.frag");
+            cube_program = shaders.submit_geometry("src/shadow_cube.vert", "src/shadow_cube.geom", "src/shadow_depth.frag");
+            allocator.reset(size, MIN_TILE);
+            glGenTextures(1, &atlas);
+            glBindTexture(GL_TEXTURE_2D, atlas);
+            glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT32F, size, size);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+            glBindTexture(GL_TEXTURE_2D, 0);
+            glGenFramebuffers(1, &framebuffer);
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, atlas, 0);
+            glDrawBuffer(GL_NONE);
+            glReadBuffer(GL_NONE);
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            glGenBuffers(1, &view_buffer);
+            stats.atlas_bytes = size_t(size)*size*4;
+        }
+        //static lights never move and are drawn once, after they get their tiles
+        handle add_point_light(bool is_static = false) {return add(POINT, is_static);}
+        handle add_spot_light(bool is_static = false) {return add(SPOT, is_static);}
+        //range is where the light's contribution ends, the far plane of its shadow views
+        void set_point_light(handle id, const glm::vec3 &position, float range)
+        {
+            shadow_light &light = lights[id];
+            light.moved = light.moved || light.position != position || light.range != range;
+            light.position = position;
+            light.range = range;
+        }
+        void set_spot_light(handle id, const glm::vec3 &position, const glm::vec3 &direction, float cosine_angle, float range)
+        {
+            shadow_light &light = lights[id];
+            const glm::vec3 unit_direction = glm::normalize(direction);
+            light.moved = light.moved || light.position != position || light.direction != unit_direction ||
+            light.cosine_angle != cosine_angle || light.range != range;
+            light.position = position;
+            light.direction = unit_direction;
+            light.cosine_angle = cosine_angle;
+            light.range = range;
+        }
+
+        //sizes every light's tiles for the camera (position and vertical field of view) and the screen height, then
+        //redraws the lights that need it, most important first, within the frame's budget. restores the framebuffer
+        //and viewport.
+        void update(const glm::vec3 &camera_position, float fov_y, int screen_height, draw_casters_proc draw_casters)
+        {
+            stats.lights_updated = stats.views_rendered = stats.shadow_draws = 0;
+            if (!manager->program(spot_program) || !manager->program(cube_program))
+                return;
+            std::vector<size_t> candidates;
+            for (size_t i = 0; i < lights.size(); i++)
+            {
+                shadow_light &light = lights[i];
+                //the light's sphere of influence on screen, a point light spreads it over its faces
+                const float distance = glm::length(light.position - camera_position);
+                light.coverage = distance > light.range ? std::min(light.range/(distance*std::tan(0.5f*fov_y)), 1.0f) : 1.0f;
+                const float texels = light.coverage*screen_height*resolution_scale*(light.type == POINT ? 0.5f : 1.0f);
+                int wanted = MIN_TILE;
+                while (wanted < texels && wanted < MAX_TILE)
+                    wanted *= 2;
+                //grow at once, shrink only when far too large, so lights near a size boundary keep their tiles
+                if (!light.tile || wanted > light.tile || wanted*4 <= light.tile)
+                    allocate_tiles(light, wanted);
+                if (light.tile && (!light.rendered || (light.moved && !light.is_static)))
+                    candidates.push_back(i);
+            }
+            //lights waiting longest and covering the most screen go first
+            for (size_t i : candidates)
+                lights[i].frames_waiting++;
+            std::sort(candidates.begin(), candidates.end(), [this](size_t a, size_t b)
+            {return lights[a].coverage*lights[a].frames_waiting > lights[b].coverage*lights[b].frames_waiting;});
+
+            int viewport[4];
+            glGetIntegerv(GL_VIEWPORT, viewport);
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+            glEnable(GL_POLYGON_OFFSET_FILL);
+            glPolygonOffset(1.5f, 2.0f);
+            for (size_t i : candidates)
+            {
+                shadow_light &light = lights[i];
+                if (stats.views_rendered > 0 && stats.views_rendered + light.views() > max_views_per_frame)
+                    continue;
+                fill_views(light);
+                stats.shadow_draws += render(light, draw_casters);
+                stats.views_rendered += light.views();
+                stats.lights_updated++;
+                light.rendered = true;
+                light.moved = false;
+                light.frames_waiting = 0;
+            }
+            glDisable(GL_POLYGON_OFFSET_FILL);
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+            if (stats.lights_updated)
+            {
+                glBindBuffer(GL_SHADER_STORAGE_BUFFER, view_buffer);
+                if (views.size() > view_capacity)
+                {
+                    view_capacity = views.size();
+                    glBufferData(GL_SHADER_STORAGE_BUFFER, view_capacity*sizeof(shadow_view), views.data(), GL_DYNAMIC_DRAW);
+                }
+                else
+                    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, views.size()*sizeof(shadow_view), views.data());
+                glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+            }
+        }
+        //what a shader needs to find the light's shadow : its first view + 1, or 0 while it has none
+        int shadow_index(handle id) const
+        {
+            const shadow_light &light = lights[id];
+            return light.tile && light.rendered ? int(light.first_view) + 1 : 0;
+        }
+        //binds the atlas and the views for programs built with LOCAL_SHADOWS
+        void bind() const
+        {
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SHADOW_VIEW_BINDING, view_buffer);
+            glBindTextureUnit(ATLAS_UNIT, atlas);
+        }
+        unsigned int texture() const {return atlas;}
+        unsigned int view_buffer_id() const {return view_buffer;}
+        const statistics& statistics_last_update() const {return stats;}
+    };
+}
+#endif
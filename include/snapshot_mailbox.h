@@ -0,0 +1,62 @@
+#ifndef SNAPSHOT_MAILBOX
+#define SNAPSHOT_MAILBOX
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+//hands whole snapshots of state from one producer thread to one consumer thread without either waiting on the other.
+//three slots: the producer fills its own, then swaps it with the shared middle one; the consumer swaps its own with
+//the middle one whenever that holds a newer snapshot. neither ever touches the slot the other owns, so a slow consumer
+//only skips snapshots and a slow producer only leaves the consumer on the last one.
+namespace snapshots
+{
+    struct mailbox_stats
+    {
+        size_t published = 0;
+        size_t skipped = 0;     //published, then replaced before the consumer took them
+    };
+
+    template <typename T>
+    class mailbox
+    {
+        static constexpr uint8_t INDEX = 3, FRESH = 4;
+        T slots[3];
+        uint8_t back_index = 0;                 //the producer's
+        std::atomic<uint8_t> middle_index{1};   //the shared slot, FRESH while the consumer has not taken it
+        uint8_t front_index = 2;                //the consumer's
+        std::atomic<size_t> published{0}, skipped{0};
+    public:
+        //the producer's slot, still holding whatever it held three snapshots ago. fill it, then publish().
+        T& back() {return slots[back_index];}
+        void publish()
+        {
+            const uint8_t replaced = middle_index.exchange(back_index | FRESH, std::memory_order_acq_rel);
+            back_index = replaced & INDEX;
+            published.fetch_add(1, std::memory_order_relaxed);
+            if (replaced & FRESH)
+                skipped.fetch_add(1, std::memory_order_relaxed);
+        }
+        //takes the newest snapshot into front(), true if there was one newer than the last taken
+        bool acquire()
+        {
+            if (!(middle_index.load(std::memory_order_relaxed) & FRESH))
+                return false;
+            front_index = middle_index.exchange(front_index, std::memory_order_acq_rel) & INDEX;
+            return true;
+        }
+        //the consumer's slot, unchanged until the next acquire()
+        const T& front() const {return slots[front_index];}
+        mailbox_stats stats() const {return {published.load(std::memory_order_relaxed), skipped.load(std::memory_order_relaxed)};}
+    };
+
+    //how far time lies from the snapshot taken at previous_time to the one at current_time, clamped to [0, 1]
+    inline float blend_factor(double time, double previous_time, double current_time)
+    {
+        if (current_time <= previous_time)
+            return 1.0f;
+        return float(std::clamp((time - previous_time)/(current_time - previous_time), 0.0, 1.0));
+    }
+}
+#endif
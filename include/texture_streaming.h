@@ -0,0 +1,299 @@
+#ifndef TEXTURE_STREAMING
+#define TEXTURE_STREAMING
+
+#include "glad/glad.h"
+#include "resource_registry.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//streams mip levels of large textures into VRAM on demand.
+//a texture starts with only its coarse mips resident; finer mips are uploaded as objects using it come close
+//enough to need them, and the least recently used fine mips are dropped when the memory budget is exceeded.
+//GL_TEXTURE_BASE_LEVEL always points at the finest resident level, so sampling never touches a missing one.
+//streamed textures are shared through resources::shared like every other texture, and release_texture() frees them.
+namespace streaming
+{
+    struct mip_level
+    {
+        int width, height;
+        std::vector<unsigned char> texels;  //RGBA8, sRGB encoded
+        size_t byte_size() const {return texels.size();}
+    };
+    struct streamed_texture
+    {
+        unsigned int id = 0;
+        std::vector<mip_level> levels;  //CPU copy of the full chain, finest first
+        int resident_base;              //finest level resident on the GPU
+        int initial_base;               //levels at or past this one are never evicted
+        int wanted_level;               //finest level requested this frame
+        unsigned long last_used = 0;    //frame of the last request
+        float fade = 0.0;               //GL_TEXTURE_MIN_LOD offset, eases newly streamed levels in
+        int coarsest() const {return int(levels.size()) - 1;}
+    };
+    struct streaming_stats
+    {
+        size_t resident_bytes = 0;
+        size_t pending_requests = 0;    //levels wanted but not yet resident, after this frame's uploads
+        size_t uploads = 0;             //levels uploaded this frame
+        size_t evictions = 0;           //levels dropped this frame
+    };
+
+    namespace detail
+    {
+        inline float srgb_to_linear(unsigned char c)
+        {
+            static float table[256];
+            static bool built = false;
+            if (!built)
+            {
+                for (int i = 0; i < 256; i++)
+                {
+                    const float x = i/255.0f;
+                    table[i] = x <= 0.04045f ? x/12.92f : std::pow((x + 0.055f)/1.055f, 2.4f);
+                }
+                built = true;
+            }
+            return table[c];
+        }
+        inline unsigned char linear_to_srgb(float x)
+        {
+            static unsigned char table[4096];
+            static bool built = false;
+            if (!built)
+            {
+                for (int i = 0; i < 4096; i++)
+                {
+                    const float l = i/4095.0f;
+                    const float s = l <= 0.0031308f ? l*12.92f : 1.055f*std::pow(l, 1/2.4f) - 0.055f;
+                    table[i] = (unsigned char)(s*255.0f + 0.5f);
+                }
+                built = true;
+            }
+            return table[int(std::min(std::max(x, 0.0f), 1.0f)*4095.0f + 0.5f)];
+        }
+        //2x2 box filter in linear space. odd edges reuse the last row/column.
+        mip_level downsample(const mip_level &src)
+        {
+            mip_level dst;
+            dst.width = std::max(1, src.width/2);
+            dst.height = std::max(1, src.height/2);
+            dst.texels.resize(size_t(dst.width)*dst.height*4);
+            for (int y = 0; y < dst.height; y++)
+            {
+                const int y0 = std::min(2*y, src.height - 1), y1 = std::min(2*y + 1, src.height - 1);
+                for (int x = 0; x < dst.width; x++)
+                {
+                    const int x0 = std::min(2*x, src.width - 1), x1 = std::min(2*x + 1, src.width - 1);
+                    const unsigned char* taps[4] = {
+                        &src.texels[(size_t(y0)*src.width + x0)*4], &src.texels[(size_t(y0)*src.width + x1)*4],
+                        &src.texels[(size_t(y1)*src.width + x0)*4], &src.texels[(size_t(y1)*src.width + x1)*4]};
+                    unsigned char* out = &dst.texels[(size_t(y)*dst.width + x)*4];
+                    for (int c = 0; c < 3; c++)
+                        out[c] = linear_to_srgb(0.25f*(srgb_to_linear(taps[0][c]) + srgb_to_linear(taps[1][c]) +
+                        srgb_to_linear(taps[2][c]) + srgb_to_linear(taps[3][c])));
+                    out[3] = (unsigned char)((taps[0][3] + taps[1][3] + taps[2][3] + taps[3][3] + 2)/4);  //alpha is linear
+                }
+            }
+            return dst;
+        }
+    }
+
+    class texture_streamer
+    {
+        std::vector<streamed_texture> textures;
+        std::unordered_map<unsigned int, size_t> texture_ids;  //GL id --> index
+        streaming_stats counters;
+        unsigned long frame = 1;
+        float view_height = 600.0f;
+        float tan_half_fov = std::tan(0.5f*0.785398f);
+
+        void upload_level(streamed_texture &tex, int level)
+        {
+            const mip_level &mip = tex.levels[level];
+            glBindTexture(GL_TEXTURE_2D, tex.id);
+            glTexImage2D(GL_TEXTURE_2D, level, GL_SRGB8_ALPHA8, mip.width, mip.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, mip.texels.data());
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+            tex.resident_base = level;
+            counters.resident_bytes += mip.byte_size();
+        }
+        //drops the finest resident level. BASE_LEVEL moves first so the freed level is never sampled.
+        void evict_level(streamed_texture &tex)
+        {
+            const int level = tex.resident_base;
+            glBindTexture(GL_TEXTURE_2D, tex.id);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level + 1);
+            glTexImage2D(GL_TEXTURE_2D, level, GL_SRGB8_ALPHA8, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+            tex.resident_base = level + 1;
+            tex.fade = 0.0;
+            glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_LOD, 0.0f);
+            counters.resident_bytes -= tex.levels[level].byte_size();
+            counters.evictions++;
+        }
+        //evicts least recently used levels that nobody currently needs until extra_bytes fit the budget.
+        bool make_room(size_t extra_bytes, const streamed_texture &keep)
+        {
+            while (counters.resident_bytes + extra_bytes > budget_bytes)
+            {
+                streamed_texture* victim = nullptr;
+                for (streamed_texture &tex : textures)
+                {
+                    if (&tex == &keep || tex.resident_base >= tex.initial_base || tex.resident_base >= tex.wanted_level)
+                        continue;
+                    if (!victim || tex.last_used < victim->last_used)
+                        victim = &tex;
+                }
+                if (!victim)
+                    return false;
+                evict_level(*victim);
+            }
+            return true;
+        }
+        //builds the full mip chain from decoded pixels (grey, grey and alpha, RGB or RGBA) and uploads only its coarse
+        //mips. returns the bytes of the whole chain, what the texture takes once fully streamed in.
+        size_t create(const unsigned char* pixels, int width, int height, int nr_channels, unsigned int &tex_id)
+        {
+            streamed_texture tex;
+            tex.levels.push_back({width, height, std::vector<unsigned char>(size_t(width)*height*4)});
+            std::vector<unsigned char> &texels = tex.levels[0].texels;
+            for (size_t i = 0; i < size_t(width)*height; i++)
+            {
+                const unsigned char* in = pixels + i*nr_channels;
+                unsigned char* out = &texels[i*4];
+                const bool grey = nr_channels < 3;
+                out[0] = in[0], out[1] = in[grey ? 0 : 1], out[2] = in[grey ? 0 : 2];
+                out[3] = nr_channels == 2 || nr_channels == 4 ? in[nr_channels - 1] : 255;
+            }
+            while (tex.levels.back().width > 1 || tex.levels.back().height > 1)
+                tex.levels.push_back(detail::downsample(tex.levels.back()));
+
+            tex.initial_base = tex.coarsest();
+            while (tex.initial_base > 0 && std::max(tex.levels[tex.initial_base - 1].width, tex.levels[tex.initial_base - 1].height) <= initial_size)
+                tex.initial_base--;
+            tex.wanted_level = tex.coarsest();
+
+            glGenTextures(1, &tex.id);
+            glBindTexture(GL_TEXTURE_2D, tex.id);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, tex.coarsest());
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            for (int level = tex.coarsest(); level >= tex.initial_base; level--)
+                upload_level(tex, level);
+            glBindTexture(GL_TEXTURE_2D, 0);
+
+            size_t byte_size = 0;
+            for (const mip_level &level : tex.levels)
+                byte_size += level.byte_size();
+            texture_ids[tex.id] = textures.size();
+            tex_id = tex.id;
+            textures.push_back(std::move(tex));
+            return byte_size;
+        }
+        //drops what the streamer keeps for tex_id. the registry deletes the GL texture itself.
+        void forget(unsigned int tex_id)
+        {
+            auto found = texture_ids.find(tex_id);
+            if (found == texture_ids.end())
+                return;
+            const size_t index = found->second;
+            const streamed_texture &tex = textures[index];
+            for (int level = tex.resident_base; level <= tex.coarsest(); level++)
+                counters.resident_bytes -= tex.levels[level].byte_size();
+            texture_ids.erase(found);
+            if (index + 1 < textures.size())
+            {
+                textures[index] = std::move(textures.back());
+                texture_ids[textures[index].id] = index;
+            }
+            textures.pop_back();
+        }
+    public:
+        size_t budget_bytes;
+        int initial_size = 64;              //levels no larger than this are uploaded at load time and always resident
+        unsigned int uploads_per_frame = 4; //caps the upload stall of a single frame
+        unsigned int fade_frames = 8;       //frames over which a newly streamed level blends in
+
+        texture_streamer(size_t budget_bytes) : budget_bytes(budget_bytes) {}
+
+        //used to turn object distance into on-screen texel density
+        void set_view(float viewport_height, float fov_y_radians)
+        {
+            view_height = viewport_height;
+            tan_half_fov = std::tan(0.5f*fov_y_radians);
+        }
+        //a texture for the image at file_path with only its coarse mips uploaded, shared with every other load of the
+        //same file or contents. tex_id stays valid as levels stream in and out; resources::shared.release_texture() frees it.
+        bool load(const std::string &file_path, unsigned int &tex_id);
+        //records this frame's demand for tex_id from a surface at distance, with uv_density texture repeats per world unit.
+        //ids not owned by the streamer are ignored.
+        void request(unsigned int tex_id, float distance, float uv_density = 1.0f)
+        {
+            auto found = texture_ids.find(tex_id);
+            if (found == texture_ids.end())
+                return;
+            streamed_texture &tex = textures[found->second];
+            const float pixels_per_unit = view_height/(2.0f*std::max(distance, 1e-3f)*tan_half_fov);
+            const float texels_per_unit = tex.levels[0].width*uv_density;
+            const int level = std::min(int(std::log2(std::max(texels_per_unit/pixels_per_unit, 1.0f))), tex.coarsest());
+            tex.wanted_level = std::min(tex.wanted_level, level);
+            tex.last_used = frame;
+        }
+        //call once per frame after all requests. streams in at most uploads_per_frame levels, nearest need first.
+        void update()
+        {
+            counters.uploads = counters.evictions = 0;
+            std::vector<streamed_texture*> pending;
+            for (streamed_texture &tex : textures)
+                if (tex.resident_base > tex.wanted_level)
+                    pending.push_back(&tex);
+            std::sort(pending.begin(), pending.end(), [](const streamed_texture* a, const streamed_texture* b)
+            {return a->resident_base - a->wanted_level > b->resident_base - b->wanted_level;});
+
+            size_t missing = 0;
+            for (streamed_texture* tex : pending)
+            {
+                //one level per texture per frame, coarse to fine, so every texture sharpens gradually
+                if (counters.uploads < uploads_per_frame && make_room(tex->levels[tex->resident_base - 1].byte_size(), *tex))
+                {
+                    upload_level(*tex, tex->resident_base - 1);
+                    tex->fade = 1.0;
+                    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_LOD, tex->fade);
+                    counters.uploads++;
+                }
+                missing += tex->resident_base - tex->wanted_level;
+            }
+            counters.pending_requests = missing;
+
+            for (streamed_texture &tex : textures)
+            {
+                if (tex.fade > 0.0f)
+                {
+                    tex.fade = std::max(0.0f, tex.fade - 1.0f/fade_frames);
+                    glBindTexture(GL_TEXTURE_2D, tex.id);
+                    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_LOD, tex.fade);
+                }
+                tex.wanted_level = tex.coarsest();
+            }
+            glBindTexture(GL_TEXTURE_2D, 0);
+            frame++;
+        }
+        const streaming_stats& stats() const {return counters;}
+    };
+    texture_streamer streamer(256u << 20);
+
+    bool texture_streamer::load(const std::string &file_path, unsigned int &tex_id)
+    {
+        return resources::shared.acquire_texture(file_path, tex_id, "#streamed",
+        [&](const unsigned char* pixels, int width, int height, int nr_channels, unsigned int &id)
+        {
+            const size_t byte_size = create(pixels, width, height, nr_channels, id);
+            std::cout << "Loaded texture : " << file_path << " (streamed)" << std::endl;
+            return byte_size;
+        },
+        [](unsigned int id) {streamer.forget(id);});
+    }
+}
+#endif
@@ -0,0 +1,287 @@
+#ifndef TILED_CULLING
+#define TILED_CULLING
+
+#include "glm/glm.hpp"
+#include "job_system.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define TILED_CULLING_AVX 1
+#endif
+
+//CPU tiled light culling, for the headless and software paths that have no compute shaders to bin lights with.
+//the screen is split into TILE_SIZE x TILE_SIZE pixel tiles; each tile gets a view space frustum from the projection
+//and the min/max of the depth it covers, and every light sphere is tested against it. the work is split across tile
+//rows : a row first keeps only the lights inside its top and bottom planes, then tests those against each tile.
+//with AVX the tests run on 8 lights at a time, chosen at run time so the binary still runs on older CPUs.
+//nothing here touches GL. the result is laid out the way a shader would read it from storage buffers.
+namespace tiled
+{
+    constexpr int TILE_SIZE = 16;
+
+    //light lists of every tile, tiles row major from the bottom left like gl_FragCoord.
+    //grid holds an (offset, count) pair into indices for each tile.
+    struct tile_lists
+    {
+        int tiles_x = 0, tiles_y = 0;
+        std::vector<uint32_t> grid;
+        std::vector<uint32_t> indices;
+
+        uint32_t offset(int tile_x, int tile_y) const {return grid[2*(tile_y*tiles_x + tile_x)];}
+        uint32_t count(int tile_x, int tile_y) const {return grid[2*(tile_y*tiles_x + tile_x) + 1];}
+    };
+
+    namespace detail
+    {
+        //view space spheres as separate arrays, padded to a multiple of 8 with spheres that fail every test.
+        //depth is the distance in front of the camera (-z).
+        struct sphere_set
+        {
+            std::vector<float> x, y, depth, radius;
+            std::vector<uint32_t> index;
+            size_t size = 0;
+
+            void clear() {size = 0;}
+            void push(float sx, float sy, float sdepth, float sradius, uint32_t light_index)
+            {
+                if (x.size() < size + 8)
+                {
+                    const size_t capacity = std::max<size_t>(64, 2*(size + 8));
+                    x.resize(capacity); y.resize(capacity); depth.resize(capacity); radius.resize(capacity); index.resize(capacity);
+                }
+                x[size] = sx; y[size] = sy; depth[size] = sdepth; radius[size] = sradius; index[size] = light_index;
+                size++;
+            }
+            void pad()
+            {
+                for (size_t i = size; i%8; i++)
+                {
+                    x[i] = y[i] = depth[i] = 0.0f;
+                    radius[i] = -FLT_MAX;
+                }
+            }
+        };
+        //a plane through the eye with no y (side planes) or no x (top and bottom) component,
+        //signed distance = a*x_or_y + b*depth, positive inside
+        struct side_plane {float a, b;};
+        //what a tile tests a sphere against. an empty tile has depth_min > depth_max.
+        struct tile_bounds
+        {
+            side_plane left, right;
+            float depth_min, depth_max;
+        };
+
+        //appends the spheres of in that pass both planes of a tile row to out
+        inline void filter_row_scalar(const sphere_set &in, side_plane bottom, side_plane top, sphere_set &out)
+        {
+            for (size_t i = 0; i < in.size; i++)
+            {
+                const float r = in.radius[i];
+                if (bottom.a*in.y[i] + bottom.b*in.depth[i] >= -r && top.a*in.y[i] + top.b*in.depth[i] >= -r)
+                    out.push(in.x[i], in.y[i], in.depth[i], r, in.index[i]);
+            }
+        }
+        inline void cull_tile_scalar(const sphere_set &row, const tile_bounds &tile, std::vector<uint32_t> &out)
+        {
+            for (size_t i = 0; i < row.size; i++)
+            {
+                const float r = row.radius[i], d = row.depth[i];
+                if (tile.left.a*row.x[i] + tile.left.b*d >= -r && tile.right.a*row.x[i] + tile.right.b*d >= -r &&
+                d + r >= tile.depth_min && d - r <= tile.depth_max)
+                    out.push_back(row.index[i]);
+            }
+        }
+#if TILED_CULLING_AVX
+        __attribute__((target("avx"))) inline __m256 plane_distance(side_plane plane, __m256 coordinate, __m256 depth)
+        {
+            return _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane.a), coordinate), _mm256_mul_ps(_mm256_set1_ps(plane.b), depth));
+        }
+        __attribute__((target("avx"))) inline void filter_row_avx(const sphere_set &in, side_plane bottom, side_plane top, sphere_set &out)
+        {
+            for (size_t i = 0; i < in.size; i += 8)
+            {
+                const __m256 y = _mm256_loadu_ps(&in.y[i]), depth = _mm256_loadu_ps(&in.depth[i]);
+                const __m256 neg_radius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(&in.radius[i]));
+                const __m256 inside = _mm256_and_ps(_mm256_cmp_ps(plane_distance(bottom, y, depth), neg_radius, _CMP_GE_OQ),
+                _mm256_cmp_ps(plane_distance(top, y, depth), neg_radius, _CMP_GE_OQ));
+                for (int mask = _mm256_movemask_ps(inside); mask; mask &= mask - 1)
+                {
+                    const size_t j = i + __builtin_ctz(mask);
+                    out.push(in.x[j], in.y[j], in.depth[j], in.radius[j], in.index[j]);
+                }
+            }
+        }
+        __attribute__((target("avx"))) inline void cull_tile_avx(const sphere_set &row, const tile_bounds &tile, std::vector<uint32_t> &out)
+        {
+            const __m256 depth_min = _mm256_set1_ps(tile.depth_min), depth_max = _mm256_set1_ps(tile.depth_max);
+            for (size_t i = 0; i < row.size; i += 8)
+            {
+                const __m256 x = _mm256_loadu_ps(&row.x[i]), depth = _mm256_loadu_ps(&row.depth[i]);
+                const __m256 radius = _mm256_loadu_ps(&row.radius[i]);
+                const __m256 neg_radius = _mm256_sub_ps(_mm256_setzero_ps(), radius);
+                __m256 inside = _mm256_and_ps(_mm256_cmp_ps(plane_distance(tile.left, x, depth), neg_radius, _CMP_GE_OQ),
+                _mm256_cmp_ps(plane_distance(tile.right, x, depth), neg_radius, _CMP_GE_OQ));
+                inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(depth, radius), depth_min, _CMP_GE_OQ));
+                inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_sub_ps(depth, radius), depth_max, _CMP_LE_OQ));
+                for (int mask = _mm256_movemask_ps(inside); mask; mask &= mask - 1)
+                    out.push_back(row.index[i + __builtin_ctz(mask)]);
+            }
+        }
+#endif
+    }
+
+    class tile_culler
+    {
+        glm::mat4 projection = glm::mat4(1.0f);
+        int width = 0, height = 0;
+        detail::sphere_set lights;
+        std::vector<detail::sphere_set> row_lights;             //per tile row scratch, kept between frames
+        std::vector<std::vector<uint32_t>> row_indices;
+        std::vector<detail::tile_bounds> tiles;
+        tile_lists lists;
+
+        //the plane where x (or y) in NDC equals ndc, facing the side where it is larger when facing_up
+        static detail::side_plane ndc_plane(float scale, float offset, float ndc, bool facing_up)
+        {
+            //clip.x = scale*x + offset*z, w = -z = depth  -->  x_ndc >= ndc  <=>  scale*x - (offset + ndc)*depth >= 0
+            float a = scale, b = -(offset + ndc);
+            const float length = std::sqrt(a*a + b*b);
+            a /= length; b /= length;
+            return facing_up ? detail::side_plane{a, b} : detail::side_plane{-a, -b};
+        }
+        //view depth of a window depth in [0, 1], for a perspective projection
+        float view_depth(float window_depth) const
+        {
+            return projection[3][2]/(2.0f*window_depth - 1.0f + projection[2][2]);
+        }
+        float ndc_x(int pixel) const {return 2.0f*std::min(pixel, width)/width - 1.0f;}
+        float ndc_y(int pixel) const {return 2.0f*std::min(pixel, height)/height - 1.0f;}
+
+        //min/max depth of the covered pixels of every tile in row ty. pixels left at the clear depth cover nothing.
+        void tile_depths(const float* window_depth, int ty)
+        {
+            const int y_end = std::min((ty + 1)*TILE_SIZE, height);
+            for (int tx = 0; tx < lists.tiles_x; tx++)
+            {
+                const int x_end = std::min((tx + 1)*TILE_SIZE, width);
+                float nearest = 1.0f, farthest = 0.0f;
+                for (int y = ty*TILE_SIZE; y < y_end; y++)
+                    for (int x = tx*TILE_SIZE; x < x_end; x++)
+                    {
+                        const float d = window_depth[size_t(y)*width + x];
+                        if (d < 1.0f)
+                        {
+                            nearest = std::min(nearest, d);
+                            farthest = std::max(farthest, d);
+                        }
+                    }
+                detail::tile_bounds &tile = tiles[ty*lists.tiles_x + tx];
+                tile.depth_min = nearest < 1.0f ? view_depth(nearest) : 1.0f;
+                tile.depth_max = nearest < 1.0f ? view_depth(farthest) : 0.0f;
+            }
+        }
+        void cull_row(int ty, bool simd)
+        {
+            const detail::side_plane bottom = ndc_plane(projection[1][1], projection[2][1], ndc_y(ty*TILE_SIZE), true);
+            const detail::side_plane top = ndc_plane(projection[1][1], projection[2][1], ndc_y((ty + 1)*TILE_SIZE), false);
+            detail::sphere_set &row = row_lights[ty];
+            std::vector<uint32_t> &indices = row_indices[ty];
+            row.clear();
+            indices.clear();
+#if TILED_CULLING_AVX
+            if (simd)
+                detail::filter_row_avx(lights, bottom, top, row);
+            else
+#endif
+                detail::filter_row_scalar(lights, bottom, top, row);
+            row.pad();
+            for (int tx = 0; tx < lists.tiles_x; tx++)
+            {
+                const detail::tile_bounds &tile = tiles[ty*lists.tiles_x + tx];
+                uint32_t* cell = &lists.grid[2*(ty*lists.tiles_x + tx)];
+                cell[0] = uint32_t(indices.size());     //relative to the row until the rows are joined
+                if (tile.depth_min <= tile.depth_max)
+#if TILED_CULLING_AVX
+                    simd ? detail::cull_tile_avx(row, tile, indices) : detail::cull_tile_scalar(row, tile, indices);
+#else
+                    detail::cull_tile_scalar(row, tile, indices);
+#endif
+                cell[1] = uint32_t(indices.size()) - cell[0];
+            }
+        }
+    public:
+        static bool avx_supported()
+        {
+#if TILED_CULLING_AVX
+            return __builtin_cpu_supports("avx");
+#else
+            return false;
+#endif
+        }
+        //a perspective projection (e.g. glm::perspective) and the size of the depth buffer in pixels
+        void set_projection(const glm::mat4 &new_projection, int new_width, int new_height)
+        {
+            projection = new_projection;
+            width = new_width;
+            height = new_height;
+            lists.tiles_x = (width + TILE_SIZE - 1)/TILE_SIZE;
+            lists.tiles_y = (height + TILE_SIZE - 1)/TILE_SIZE;
+            lists.grid.assign(2*size_t(lists.tiles_x)*lists.tiles_y, 0);
+            tiles.resize(size_t(lists.tiles_x)*lists.tiles_y);
+            row_lights.resize(lists.tiles_y);
+            row_indices.resize(lists.tiles_y);
+            for (int tx = 0; tx < lists.tiles_x; tx++)
+                for (int ty = 0; ty < lists.tiles_y; ty++)
+                {
+                    detail::tile_bounds &tile = tiles[ty*lists.tiles_x + tx];
+                    tile.left = ndc_plane(projection[0][0], projection[2][0], ndc_x(tx*TILE_SIZE), true);
+                    tile.right = ndc_plane(projection[0][0], projection[2][0], ndc_x((tx + 1)*TILE_SIZE), false);
+                }
+        }
+        //any light type with a world space position_radius (position in xyz, radius of influence in w), like
+        //clustered::point_light. light indices in the tile lists refer to this vector.
+        template <typename light_type>
+        void set_lights(const std::vector<light_type> &world_lights, const glm::mat4 &view)
+        {
+            lights.clear();
+            for (size_t i = 0; i < world_lights.size(); i++)
+            {
+                const glm::vec4 &sphere = world_lights[i].position_radius;
+                const glm::vec3 position = glm::vec3(view*glm::vec4(glm::vec3(sphere), 1.0f));
+                lights.push(position.x, position.y, -position.z, sphere.w, uint32_t(i));
+            }
+            if (lights.size)
+                lights.pad();
+        }
+        //culls the lights against the tiles of a window depth buffer (width*height floats, bottom row first, as
+        //glReadPixels returns it). simd = false forces the scalar tests, for reference and comparison.
+        const tile_lists& cull(const float* window_depth, bool simd = true)
+        {
+            simd = simd && avx_supported();
+            jobs::parallel_for(size_t(lists.tiles_y), [&](size_t ty)
+            {
+                tile_depths(window_depth, int(ty));
+                cull_row(int(ty), simd);
+            });
+            //join the rows into one index list
+            std::vector<uint32_t> row_offsets(lists.tiles_y + 1, 0);
+            for (int ty = 0; ty < lists.tiles_y; ty++)
+                row_offsets[ty + 1] = row_offsets[ty] + uint32_t(row_indices[ty].size());
+            lists.indices.resize(row_offsets.back());
+            jobs::parallel_for(size_t(lists.tiles_y), [&](size_t ty)
+            {
+                std::copy(row_indices[ty].begin(), row_indices[ty].end(), lists.indices.begin() + row_offsets[ty]);
+                for (int tx = 0; tx < lists.tiles_x; tx++)
+                    lists.grid[2*(ty*lists.tiles_x + tx)] += row_offsets[ty];
+            });
+            return lists;
+        }
+        const tile_lists& result() const {return lists;}
+    };
+}
+#endif
@@ -0,0 +1,83 @@
+#ifndef TRANSPARENCY
+#define TRANSPARENCY
+
+#include "glad/glad.h"
+#include "shader_manager.h"
+#include "post_processing.h"
+#include "render_graph.h"
+
+//order independent transparency by weighted blending (McGuire and Bavoil, Weighted Blended Order-Independent
+//Transparency, 2013). transparent surfaces are drawn in any order after the opaque scene, depth tested against it but
+//without writing depth, into two targets: a weighted sum of their premultiplied colors and the product of what each
+//leaves revealed (src/transparency.glsl). one fullscreen pass then blends the weighted average over the scene. there
+//is no sorting on the CPU and every transparent surface is drawn once. the average is exact for a single layer and an
+//approximation for overlapping ones, weighted so the nearest and most opaque layers dominate. both targets are
+//transients of the frame's render graph.
+namespace oit
+{
+    class weighted_blended
+    {
+        shader_manager* manager = nullptr;
+        shader_manager::handle composite_program = 0;
+        unsigned int empty_vao = 0;     //the fullscreen triangle has no vertex buffer, but core profile draws need a VAO
+
+        void composite(unsigned int framebuffer, unsigned int accumulation, unsigned int revealage)
+        {
+            const unsigned int program_id = manager->program(composite_program);
+            if (!program_id)
+                return;
+            if (!empty_vao)
+                glGenVertexArrays(1, &empty_vao);
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+            glDisable(GL_DEPTH_TEST);
+            glUseProgram(program_id);
+            glBindTextureUnit(0, accumulation);
+            glBindTextureUnit(1, revealage);
+            glBindVertexArray(empty_vao);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+            glBindVertexArray(0);
+            glEnable(GL_DEPTH_TEST);
+        }
+    public:
+        void init(shader_manager &shaders)
+        {
+            manager = &shaders;
+            composite_program = shaders.submit("src/fullscreen.vert", "src/oit_composite.frag");
+        }
+        //adds the passes drawing the transparent surfaces over scene. draw_surfaces draws them with their
+        //TRANSPARENT scene variants, in any order. returns the pass drawing them, for the resources they read.
+        graph::pass_builder add_passes(graph::render_graph &frame, const post::hdr_target &scene, void (*draw_surfaces)())
+        {
+            const graph::resource accumulation = frame.create_texture("oit accumulation", {scene.width, scene.height, 1, GL_RGBA16F, GL_NEAREST, GL_NEAREST});
+            //the product of many opacities drifts in 8 bits, half floats keep thin layers from vanishing
+            const graph::resource revealage = frame.create_texture("oit revealage", {scene.width, scene.height, 1, GL_R16F, GL_NEAREST, GL_NEAREST});
+            const graph::resource color = scene.color, depth = scene.depth_stencil;
+            const int width = scene.render_width, height = scene.render_height;
+            //the scene's depth is attached read only, so transparent surfaces hide behind opaque ones
+            graph::pass_builder surfaces = frame.add_pass("transparent surfaces", [&frame, accumulation, revealage, depth, width, height, draw_surfaces]()
+            {
+                glBindFramebuffer(GL_FRAMEBUFFER, frame.framebuffer({accumulation, revealage}, depth));
+                glViewport(0, 0, width, height);
+                const float no_color[4] = {0.0f, 0.0f, 0.0f, 0.0f}, fully_revealed[4] = {1.0f, 0.0f, 0.0f, 0.0f};
+                glClearBufferfv(GL_COLOR, 0, no_color);
+                glClearBufferfv(GL_COLOR, 1, fully_revealed);
+                glDepthMask(GL_FALSE);
+                glEnable(GL_BLEND);
+                glBlendFunci(0, GL_ONE, GL_ONE);
+                glBlendFunci(1, GL_ZERO, GL_ONE_MINUS_SRC_COLOR);
+                draw_surfaces();
+                glDepthMask(GL_TRUE);
+                glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+            });
+            surfaces.write(accumulation, graph::ATTACHMENT).write(revealage, graph::ATTACHMENT).read(depth, graph::ATTACHMENT);
+            //the composite only writes the scene's color, its motion stays that of the opaque surfaces
+            frame.add_pass("transparency composite", [this, &frame, accumulation, revealage, color, width, height]()
+            {
+                glViewport(0, 0, width, height);
+                composite(frame.framebuffer({color}), frame.id(accumulation), frame.id(revealage));
+            }).read(accumulation, graph::SAMPLED).read(revealage, graph::SAMPLED).write(color, graph::ATTACHMENT);
+            return surfaces;
+        }
+    };
+}
+#endif
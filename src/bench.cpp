@@ -0,0 +1,269 @@
+//CPU only benchmarks and sanity checks. needs no GL context or GPU : make bench
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#undef STB_IMAGE_IMPLEMENTATION
+#include "ibl_precompute.h"
+#include "tiled_culling.h"
+#include "job_system.h"
+#include "glm/gtc/matrix_transform.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <thread>
+
+double time_ms(const std::function<void()> &fn)
+{
+    const auto start = std::chrono::steady_clock::now();
+    fn();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+//sky-like environment : bright above the horizon, dim below, with a warm sun patch
+cubemap::cube_image make_environment(int size)
+{
+    cubemap::cube_image env;
+    env.resize(size);
+    for (int face = 0; face < 6; face++)
+        for (int y = 0; y < size; y++)
+            for (int x = 0; x < size; x++)
+            {
+                float d[3];
+                ibl::detail::texel_direction(face, x, y, size, d);
+                const float sky = 0.5f + 0.5f*d[1];
+                const float sun = std::pow(std::max(d[0]*0.6f + d[1]*0.8f, 0.0f), 64.0f)*20.0f;
+                float* texel = env.texel(face, x, y);
+                texel[0] = 0.2f + sky + sun; texel[1] = 0.3f + sky + 0.8f*sun; texel[2] = 0.5f + sky + 0.6f*sun;
+            }
+    return env;
+}
+//reference irradiance : brute force cosine weighted integral over every texel
+void irradiance_reference(const cubemap::cube_image &env, const float* n, float* out)
+{
+    out[0] = out[1] = out[2] = 0.0f;
+    for (int face = 0; face < 6; face++)
+        for (int y = 0; y < env.size; y++)
+            for (int x = 0; x < env.size; x++)
+            {
+                float d[3];
+                const float solid_angle = ibl::detail::texel_direction(face, x, y, env.size, d);
+                const float cosine = std::max(d[0]*n[0] + d[1]*n[1] + d[2]*n[2], 0.0f);
+                for (int c = 0; c < 3; c++)
+                    out[c] += env.texel(face, x, y)[c]*cosine*solid_angle;
+            }
+}
+void bench_ibl()
+{
+    std::cout << "== image based lighting precompute ==" << std::endl;
+    const int size = 256;
+    const cubemap::cube_image env = make_environment(size);
+    ibl::ibl_data data;
+    const double total = time_ms([&]() {data = ibl::precompute(env);});
+    std::cout << size << "px environment, " << std::thread::hardware_concurrency() << " threads : " << total << "ms total" << std::endl;
+
+    float sh[9][3];
+    std::cout << "  SH projection (32px)   : " << time_ms([&]() {ibl::project_irradiance_sh(env.downsample().downsample().downsample(), sh);}) << "ms" << std::endl;
+    std::cout << "  BRDF LUT 64x64         : " << time_ms([&]() {ibl::integrate_brdf_lut(64, 256);}) << "ms" << std::endl;
+
+    //irradiance of a smooth environment should be within a few percent of the SH approximation
+    float worst = 0.0f;
+    const float normals[4][3] = {{0, 1, 0}, {0, -1, 0}, {1, 0, 0}, {0.577f, 0.577f, 0.577f}};
+    for (const auto &n : normals)
+    {
+        float approx[3], exact[3];
+        ibl::evaluate_sh(data.sh, n, approx);
+        irradiance_reference(env, n, exact);
+        for (int c = 0; c < 3; c++)
+            worst = std::max(worst, std::fabs(approx[c] - exact[c])/exact[c]);
+    }
+    std::cout << "  SH irradiance max relative error : " << worst*100.0f << "%" << std::endl;
+
+    //a constant environment must stay constant through every stage
+    cubemap::cube_image flat;
+    flat.resize(64);
+    for (auto &face : flat.faces)
+        std::fill(face.begin(), face.end(), 1.0f);
+    ibl::ibl_settings small;
+    small.specular_size = 32;
+    const ibl::ibl_data flat_data = ibl::precompute(flat, small);
+    const float up[3] = {0, 1, 0};
+    float flat_irradiance[3];
+    ibl::evaluate_sh(flat_data.sh, up, flat_irradiance);
+    float specular_error = 0.0f;
+    for (const auto &level : flat_data.specular)
+        for (const auto &face : level.faces)
+            for (float v : face)
+                specular_error = std::max(specular_error, std::fabs(v - 1.0f));
+    const float* smooth_head_on = &flat_data.brdf_lut[(0*flat_data.lut_size + flat_data.lut_size - 1)*2];
+    std::cout << "  constant environment : irradiance/pi = " << flat_irradiance[0]/ibl::PI
+    << " (expect 1), specular max error = " << specular_error
+    << ", LUT scale+bias at roughness 0, NdotV 1 = " << smooth_head_on[0] + smooth_head_on[1] << " (expect ~1)" << std::endl;
+}
+//std430 layout of clustered_light, as clustered::point_light (that header needs GL)
+struct point_light
+{
+    glm::vec4 position_radius;
+    glm::vec4 color;
+};
+//window depth of a ground plane at y = 0 and a wall 60 units away, sky above the horizon
+std::vector<float> make_depth_buffer(const glm::mat4 &projection, const glm::mat4 &view, int width, int height)
+{
+    const glm::mat4 inverse_view_projection = glm::inverse(projection*view);
+    const glm::vec3 eye = glm::vec3(glm::inverse(view)[3]);
+    std::vector<float> depth(size_t(width)*height, 1.0f);
+    for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++)
+        {
+            const glm::vec4 far_point = inverse_view_projection*glm::vec4(2.0f*(x + 0.5f)/width - 1.0f, 2.0f*(y + 0.5f)/height - 1.0f, 1.0f, 1.0f);
+            const glm::vec3 ray = glm::vec3(far_point)/far_point.w - eye;
+            float t = 1.0f;
+            if (ray.y < 0.0f)
+                t = std::min(t, -eye.y/ray.y);
+            if (ray.z < 0.0f)
+                t = std::min(t, (-60.0f - eye.z)/ray.z);
+            if (t < 1.0f)
+            {
+                const glm::vec4 clip = projection*view*glm::vec4(eye + t*ray, 1.0f);
+                depth[size_t(y)*width + x] = 0.5f*clip.z/clip.w + 0.5f;
+            }
+        }
+    return depth;
+}
+void bench_tiled_culling()
+{
+    std::cout << "== CPU tiled light culling ==" << std::endl;
+    const int width = 1920, height = 1080;
+    const glm::mat4 projection = glm::perspective(glm::radians(45.0f), float(width)/height, 0.1f, 100.0f);
+    const glm::mat4 view = glm::lookAt(glm::vec3(0, 3, 0), glm::vec3(0, 0, -20), glm::vec3(0, 1, 0));
+    const std::vector<float> depth = make_depth_buffer(projection, view, width, height);
+    std::cout << width << "x" << height << ", " << tiled::TILE_SIZE << "px tiles, " << std::thread::hardware_concurrency()
+    << " threads, AVX " << (tiled::tile_culler::avx_supported() ? "on" : "not available") << std::endl;
+
+    tiled::tile_culler culler;
+    culler.set_projection(projection, width, height);
+    std::mt19937 generator(7);
+    std::uniform_real_distribution<float> spread_x(-40.0f, 40.0f), spread_y(0.0f, 4.0f), spread_z(-60.0f, 0.0f), radius(0.5f, 2.5f);
+    for (size_t count = 1024; count <= 65536; count *= 4)
+    {
+        std::vector<point_light> lights(count);
+        for (point_light &light : lights)
+            light = {glm::vec4(spread_x(generator), spread_y(generator), spread_z(generator), radius(generator)), glm::vec4(1.0f)};
+        culler.set_lights(lights, view);
+        culler.cull(depth.data(), false);   //warms the per row scratch buffers
+        const double scalar_ms = time_ms([&]() {culler.cull(depth.data(), false);});
+        const tiled::tile_lists scalar = culler.result();
+        const double simd_ms = time_ms([&]() {culler.cull(depth.data(), true);});
+        const tiled::tile_lists &simd = culler.result();
+
+        //a light touching a covered pixel must be in that pixel's tile
+        size_t missing = 0;
+        const glm::mat4 inverse_projection = glm::inverse(projection);
+        for (int y = 0; y < height; y += 7)
+            for (int x = 0; x < width; x += 13)
+            {
+                const float d = depth[size_t(y)*width + x];
+                if (d >= 1.0f)
+                    continue;
+                const glm::vec4 point = inverse_projection*glm::vec4(2.0f*(x + 0.5f)/width - 1.0f, 2.0f*(y + 0.5f)/height - 1.0f, 2.0f*d - 1.0f, 1.0f);
+                const glm::vec3 position = glm::vec3(point)/point.w;
+                const int tx = x/tiled::TILE_SIZE, ty = y/tiled::TILE_SIZE;
+                const uint32_t* first = &simd.indices[simd.offset(tx, ty)];
+                const uint32_t* last = first + simd.count(tx, ty);
+                for (uint32_t i = 0; i < count; i++)
+                {
+                    const glm::vec4 &sphere = lights[i].position_radius;
+                    if (glm::length(glm::vec3(view*glm::vec4(glm::vec3(sphere), 1.0f)) - position) < sphere.w*0.999f &&
+                    std::find(first, last, i) == last)
+                        missing++;
+                }
+            }
+        std::cout << "  " << count << " lights : scalar " << scalar_ms << "ms, SIMD " << simd_ms << "ms, "
+        << float(simd.indices.size())/(simd.tiles_x*simd.tiles_y) << " lights per tile, "
+        << (scalar.grid == simd.grid && scalar.indices == simd.indices ? "lists match" : "LISTS DIFFER")
+        << ", " << missing << " missed light/pixel pairs" << std::endl;
+    }
+}
+//a job that splits into four until depth reaches 0, so nearly every job is stolen off the thread that made it
+void fan_out(int depth)
+{
+    if (depth == 0)
+        return;
+    jobs::counter children;
+    for (int i = 0; i < 4; i++)
+        jobs::submit([depth]() {fan_out(depth - 1);}, &children);
+    jobs::wait(children);
+}
+void bench_jobs()
+{
+    std::cout << "== job system ==" << std::endl;
+    jobs::parallel_for(1, [](size_t) {});     //starts the workers
+    std::cout << jobs::pool.thread_count() << " workers" << std::endl;
+    const int rounds = 1000;
+
+    //what every parallel loop cost before the job system : a thread per hardware thread, spawned and joined
+    const double spawn_ms = time_ms([&]()
+    {
+        for (int round = 0; round < rounds; round++)
+        {
+            std::vector<std::thread> threads;
+            for (size_t w = 1; w < jobs::pool.thread_count(); w++)
+                threads.emplace_back([]() {});
+            for (std::thread &thread : threads)
+                thread.join();
+        }
+    });
+    const double loop_ms = time_ms([&]()
+    {
+        for (int round = 0; round < rounds; round++)
+            jobs::parallel_for(jobs::pool.thread_count(), [](size_t) {});
+    });
+    std::cout << "  empty parallel loop : " << 1000.0*loop_ms/rounds << "us per call, spawning and joining threads "
+    << 1000.0*spawn_ms/rounds << "us" << std::endl;
+
+    const int batch = 1000;
+    jobs::scheduler::statistics before = jobs::pool.stats();
+    const double flat_ms = time_ms([&]()
+    {
+        for (int round = 0; round < rounds; round++)
+        {
+            jobs::counter done;
+            for (int i = 0; i < batch; i++)
+                jobs::submit([]() {}, &done);
+            jobs::wait(done);
+        }
+    });
+    jobs::scheduler::statistics after = jobs::pool.stats();
+    std::cout << "  empty jobs, " << batch << " per wait : " << 1.0e6*flat_ms/(rounds*batch) << "ns per job, "
+    << after.stolen - before.stolen << " stolen, " << after.inline_runs - before.inline_runs << " run inline" << std::endl;
+
+    const int depth = 8;
+    size_t tree_jobs = 0;
+    for (int level = 1, width = 4; level <= depth; level++, width *= 4)
+        tree_jobs += width;
+    before = jobs::pool.stats();
+    const double tree_ms = time_ms([&]() {fan_out(depth);});
+    after = jobs::pool.stats();
+    std::cout << "  fan out, " << tree_jobs << " nested jobs : " << 1.0e6*tree_ms/tree_jobs << "ns per job, "
+    << after.stolen - before.stolen << " stolen" << std::endl;
+
+    //uneven iterations : every 64th costs a thousand times the others
+    std::vector<double> results(1 << 16);
+    auto iteration = [&](size_t i)
+    {
+        double sum = 0.0;
+        for (size_t k = 0, n = i % 64 == 0 ? 20000 : 20; k < n; k++)
+            sum += std::sqrt(double(k + i));
+        results[i] = sum;
+    };
+    const double serial_ms = time_ms([&]() {for (size_t i = 0; i < results.size(); i++) iteration(i);});
+    const double parallel_ms = time_ms([&]() {jobs::parallel_for(results.size(), iteration, 64);});
+    std::cout << "  uneven loop of " << results.size() << " : serial " << serial_ms << "ms, parallel_for " << parallel_ms << "ms" << std::endl;
+}
+int main()
+{
+    bench_ibl();
+    bench_tiled_culling();
+    bench_jobs();
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,41 @@
+//clustered forward lighting, see clustered_lighting.h. the grid and the buffer bindings must match that header.
+//the view frustum is split into CLUSTER_GRID_X*CLUSTER_GRID_Y screen tiles and CLUSTER_GRID_Z depth slices
+//spaced exponentially between the near and far planes.
+#define CLUSTER_GRID_X 16
+#define CLUSTER_GRID_Y 9
+#define CLUSTER_GRID_Z 24
+#define MAX_LIGHTS_PER_CLUSTER 128
+#define CLUSTER_COUNT (CLUSTER_GRID_X*CLUSTER_GRID_Y*CLUSTER_GRID_Z)
+
+struct clustered_light
+{
+    vec4 position_radius;   //world space position, radius of influence in w
+    vec4 color;             //rgb, shadow index in w (see shadow_atlas.glsl)
+};
+struct cluster_bounds
+{
+    vec4 min_point;         //view space AABB
+    vec4 max_point;
+};
+layout (std140, binding = 1) uniform cluster_params
+{
+    mat4 inverse_projection;
+    vec2 tile_size;         //pixels per screen tile
+    float slice_scale;      //slice = log(view depth)*slice_scale + slice_bias
+    float slice_bias;
+    float z_near;
+    float z_far;
+    uint light_count;
+};
+layout (std430, binding = 0) readonly buffer clustered_light_buffer {clustered_light clustered_lights[];};
+layout (std430, binding = 1) buffer cluster_bounds_buffer {cluster_bounds clusters[];};
+layout (std430, binding = 2) buffer cluster_count_buffer {uint cluster_light_counts[];};
+layout (std430, binding = 3) buffer cluster_index_buffer {uint cluster_light_indices[];};   //MAX_LIGHTS_PER_CLUSTER slots per cluster
+
+uint cluster_index(vec2 frag_coord, float view_depth)
+{
+    uvec3 cell;
+    cell.xy = min(uvec2(frag_coord/tile_size), uvec2(CLUSTER_GRID_X - 1, CLUSTER_GRID_Y - 1));
+    cell.z = min(uint(max(log(view_depth)*slice_scale + slice_bias, 0.0)), uint(CLUSTER_GRID_Z - 1));
+    return cell.x + CLUSTER_GRID_X*(cell.y + CLUSTER_GRID_Y*cell.z);
+}
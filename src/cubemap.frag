@@ -1,8 +1,14 @@
 #version 460 core
 in vec3 tex_coords;
+in vec4 current_clip;
+in vec4 previous_clip;
 uniform samplerCube cubemap;
-out vec4 frag_color;
+layout (location = 0) out vec4 frag_color;
+layout (location = 1) out vec4 motion_output;
+#include "gamma.glsl"
+#include "motion_vectors.glsl"
 void main()
 {
-    frag_color = texture(cubemap, tex_coords);
+    motion_output = motion_vector(current_clip, previous_clip);
+    frag_color = vec4(gamma_decode(texture(cubemap, tex_coords).rgb), 1.0);  //the faces are display encoded images
 }
\ No newline at end of file
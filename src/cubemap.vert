@@ -1,13 +1,24 @@
 #version 460 core
 layout (location = 0) in vec3 cube_pos;
 
-uniform mat4 projection_transform, view_transform;
-uniform mat4 model_transform;
+layout (std140, binding = 0) uniform matrices
+{
+    mat4 view_transform;
+    mat4 projection_transform;
+    mat4 view_projection;
+    mat4 previous_view_projection;
+};
 
 out vec3 tex_coords;
+out vec4 current_clip;
+out vec4 previous_clip;
 void main()
 {   
     tex_coords = cube_pos;
     mat4 view_transform_no_translate = mat4(mat3(view_transform));
-    gl_Position = projection_transform*view_transform_no_translate*vec4(cube_pos, 1.0);
+    vec4 clip_pos = projection_transform*view_transform_no_translate*vec4(cube_pos, 1.0);
+    gl_Position = clip_pos.xyww;    //depth of 1.0, so the skybox only fills what nothing else covered
+    //a direction (w of 0) is not moved by the view's translation, the sky only moves as the camera turns
+    current_clip = view_projection*vec4(cube_pos, 0.0);
+    previous_clip = previous_view_projection*vec4(cube_pos, 0.0);
 }
\ No newline at end of file
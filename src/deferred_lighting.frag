@@ -0,0 +1,35 @@
+#version 460 core
+//lighting pass of the deferred path. drawn as a fullscreen triangle, the stencil test limits it to pixels the
+//geometry pass covered, so every covered pixel is lit exactly once whatever the overdraw.
+layout (location = 0) out vec4 fragment_output;
+layout (location = 1) out vec4 motion_output;  //passed on from the G-buffer
+in vec2 screen_uv;
+
+layout (binding = 0) uniform sampler2D gbuffer_albedo_spec;
+layout (binding = 1) uniform sampler2D gbuffer_normal;
+layout (binding = 2) uniform sampler2D gbuffer_depth;
+layout (binding = 3) uniform sampler2D gbuffer_motion;
+uniform mat4 inverse_view_projection;
+
+#include "gamma.glsl"
+#include "gbuffer.glsl"
+vec3 world_position(vec2 uv, float depth)
+{
+    vec4 position = inverse_view_projection*vec4(vec3(uv, depth)*2.0 - 1.0, 1.0);
+    return position.xyz/position.w;
+}
+//the surface, read back from the G-buffer
+ivec2 texel = ivec2(gl_FragCoord.xy);
+vec4 albedo_spec = texelFetch(gbuffer_albedo_spec, texel, 0);
+float depth = texelFetch(gbuffer_depth, texel, 0).r;
+vec4 diffuse_map = vec4(gamma_decode(albedo_spec.rgb), 1.0);
+vec4 spec_map = vec4(vec3(albedo_spec.a), 1.0);
+vec3 normal = oct_decode(texelFetch(gbuffer_normal, texel, 0).rg);
+vec3 frag_pos = world_position(screen_uv, depth);
+#include "shading.glsl"
+
+void main()
+{
+    motion_output = texelFetch(gbuffer_motion, texel, 0);
+    fragment_output = vec4(shade_lights(depth), 1.0);   //linear, post_resolve.comp tone maps it
+}
@@ -0,0 +1,17 @@
+#version 460 core
+//depth pre-pass : positions only, transformed exactly like vShader.vert so the main pass can test with GL_EQUAL
+layout (location = 0) in vec3 vertexPos;
+
+layout (std140, binding = 0) uniform matrices
+{
+    mat4 view_transform;
+    mat4 projection_transform;
+};
+uniform mat4 model_transform;
+invariant gl_Position;
+
+void main()
+{
+    vec3 frag_pos = vec3(model_transform*vec4(vertexPos, 1.0));
+    gl_Position = projection_transform*view_transform*vec4(frag_pos, 1.0);
+}
@@ -1,13 +1,36 @@
 #version 460 core
-out vec4 fragment_output;
+//specialised per draw by shader_permutations.h, which injects these defines after the #version line.
+//the fallbacks below match the scene's default material, light count fallbacks live in shading.glsl.
+#ifndef HAS_SPEC_MAP
+#define HAS_SPEC_MAP 1
+#endif
+#ifndef HAS_NORMAL_MAP
+#define HAS_NORMAL_MAP 0
+#endif
+#ifndef EMISSIVE
+#define EMISSIVE 0
+#endif
+#ifndef TRANSPARENT
+#define TRANSPARENT 0
+#endif
+layout (location = 0) out vec4 fragment_output;    //the weighted color sum when TRANSPARENT
+#if TRANSPARENT
+layout (location = 1) out float revealage_output;
+uniform float opacity;
+#else
+layout (location = 1) out vec4 motion_output;
+#endif
 
 in vec3 vertex_color;
 in vec3 surface_normal;
 in vec2 tex_coord;
 in vec3 frag_pos;
+in vec4 current_clip;
+in vec4 previous_clip;
 
 uniform sampler2D diffuse_maps[16];
 uniform sampler2D spec_maps[16];
+uniform sampler2D normal_map;
 uniform int nr_valid_diffuse_maps;
 uniform int nr_valid_spec_maps;
 
@@ -15,103 +38,39 @@ uniform sampler2D tex_sampler0;
 uniform sampler2D tex_sampler1;
 uniform sampler2D tex_sampler2;
 
-struct light 
-{
-    vec4 pos;   //pos.w == 0 for directional light, pos == vec4(0) for ambient light,
-    vec3 color; //otherwise, point light assumed.
-};
-struct spotlight
-{
-    light core;
-    vec3 direction;
-    float cosine_angle;
-};
-
-uniform bool emissive;
-uniform vec3 eye_pos;
-const int NR_LIGHTS = 5;
-uniform light lights[NR_LIGHTS];
-int valid_size = 1;
-
-vec4 shade_directional(light dir_light);
-vec4 shade_point(light point_light);
-vec3 shade_spot(spotlight s_light);
+#include "gamma.glsl"
+#include "motion_vectors.glsl"
+#include "transparency.glsl"
+#include "normal_mapping.glsl"
 //statics
 vec4 diffuse_map = texture(diffuse_maps[0], tex_coord);
+#if HAS_SPEC_MAP
 vec4 spec_map = texture(spec_maps[0], tex_coord);
+#else
+vec4 spec_map = diffuse_map;    //materials without a specular map reuse the diffuse map
+#endif
 vec3 object_color = vertex_color;
+vec3 normal = normalize(surface_normal);
+#include "shading.glsl"
 
-const float SHININESS = 24.0;
-const float KL = 0.00;    //linear distance attenuation factor
-const float KQ = 1.00;    //quadratic distance attenuation factor
 void main()
 {
-    float gamma = 2.2;
-    spec_map = vec4(pow(spec_map.rgb, vec3(1/gamma)), spec_map.a);
-    vec4 light_output = vec4(0, 0, 0, 1);
-    for (int i = 0; i < valid_size; i++)
-    {
-        if (lights[i].pos.w==1)
-            light_output += shade_point(lights[i]);
-        else if (lights[i].pos.w==0)
-        {
-            if(lights[i].pos == vec4(0.0))
-                light_output += vec4(lights[i].color, 1.0);
-            else
-                   light_output += shade_directional(lights[i]);
-        }
-    }
-    spotlight s;
-    s.core.color = vec3(1.0);
-    s.core.pos = vec4(eye_pos, 1);
-    s.direction = vec3(0, 0, -1);
-    s.cosine_angle = cos(radians(12.5));
-    light_output += vec4(shade_spot(s), 1);
-    light sunlight;
-    sunlight.pos = vec4(0.0, -1.0, 0.0, 0.0);
-    sunlight.color = vec3(1.0, 0.85, 0.65);
-    //light_output += shade_directional(sunlight);
-    fragment_output = vec4(pow(light_output.rgb, vec3(1/gamma)), 1.0);
-}
-float spec(vec3 light_dir)
-{   //expects light_dir TOWARDS the surface
-    vec3 view_direction = normalize(eye_pos-frag_pos);
-    //vec3 reflect_direction = reflect(vec3(light_dir), normalize(surface_normal));
-    vec3 halfway_vector;
-    if (dot(normalize(surface_normal), normalize(light_dir))>0)
-        return 0;
-    else 
-        halfway_vector = normalize(view_direction+light_dir);
-    float angular_intensity = max(dot(halfway_vector, normalize(surface_normal)), 0);
-    float spec_intensity = pow(angular_intensity, SHININESS);
-    return spec_intensity;
-}
-vec3 shade_spot(spotlight s_light)
-{
-    vec3 differential = vec3(s_light.core.pos)-frag_pos;    //change these names
-    float cos_phi = dot(normalize(differential), normalize(-s_light.direction)); //equal to cos(phi)
-    if (cos_phi>=s_light.cosine_angle)
-    {
-        float d = length(frag_pos-vec3(s_light.core.pos));
-        float distance_attenuation = 1.0/(d*d);
-        //the higher this is, the closer we are to the center of the spotlight
-        float attenuation_factor = (cos_phi-s_light.cosine_angle);  //[0, 1-cosine_angle]
-        attenuation_factor /= (1-s_light.cosine_angle); //[0, 1]
-        return distance_attenuation*(0.5*attenuation_factor + 0.5*pow(attenuation_factor, 2))*   //sharpness factor * attenuation factor 
-        (vec3(diffuse_map)*s_light.core.color + vec3(spec_map)*spec(s_light.direction));
-    }
-    return vec3(0, 0, 0);
+#if EMISSIVE
+    const vec3 color = diffuse_map.rgb;
+#else
+#if HAS_NORMAL_MAP
+    normal = perturb_normal(surface_normal, frag_pos, tex_coord, texture(normal_map, tex_coord).xyz);
+#endif
+    spec_map = vec4(gamma_encode(spec_map.rgb), spec_map.a);
+    const vec3 color = shade_lights(gl_FragCoord.z);   //linear, post_resolve.comp tone maps it
+#endif
+#if TRANSPARENT
+    //transparent surfaces leave the motion of what is behind them to temporal anti-aliasing
+    const float alpha = opacity*diffuse_map.a;
+    fragment_output = oit_accumulation(color, alpha, 1.0/gl_FragCoord.w);
+    revealage_output = alpha;
+#else
+    fragment_output = vec4(color, 1.0);
+    motion_output = motion_vector(current_clip, previous_clip);
+#endif
 }
-vec4 shade_point(light point_light)
-{
-    vec3 light_dir = normalize(vec3(point_light.pos)-frag_pos);
-    float diffuse_intensity = max(dot(light_dir,  normalize(surface_normal)), 0.0);
-    float d = length(frag_pos-vec3(point_light.pos));
-    float attenuation = 1.0/(1.0+KL*d+KQ*d*d);
-    return attenuation*((vec4(diffuse_intensity*diffuse_map)*vec4(point_light.color, 1))+(spec(-light_dir)*spec_map));
-}
-vec4 shade_directional(light dir_light)
-{
-    float diffuse_intensity = max(dot(normalize(-vec3(dir_light.pos)),  normalize(surface_normal)), 0.0);
-    return (spec(vec3(dir_light.pos))*spec_map + diffuse_intensity*diffuse_map)*vec4(dir_light.color, 1.0);
-}
\ No newline at end of file
@@ -0,0 +1,8 @@
+#version 460 core
+//one triangle covering the screen, drawn with glDrawArrays(GL_TRIANGLES, 0, 3) and no vertex buffer
+out vec2 screen_uv;
+void main()
+{
+    screen_uv = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    gl_Position = vec4(screen_uv*2.0 - 1.0, 0.0, 1.0);
+}
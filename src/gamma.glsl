@@ -0,0 +1,16 @@
+//display encoding. the scene is shaded in linear light, only the final post pass encodes it for the display.
+const float GAMMA = 2.2;
+vec3 gamma_encode(vec3 linear_color)
+{
+    return pow(linear_color, vec3(1.0/GAMMA));
+}
+vec3 gamma_decode(vec3 encoded_color)
+{
+    return pow(encoded_color, vec3(GAMMA));
+}
+//half a step of interleaved gradient noise (Jimenez 2014) breaks up the banding of smooth gradients in 8 bits
+vec3 dither_8bit(vec3 encoded_color, vec2 pixel)
+{
+    const float noise = fract(52.9829189*fract(dot(pixel, vec2(0.06711056, 0.00583715))));
+    return encoded_color + (noise - 0.5)/255.0;
+}
@@ -0,0 +1,46 @@
+#version 460 core
+//geometry pass of the deferred path : writes the surface to the G-buffer, no lighting. see gbuffer.glsl.
+#ifndef HAS_SPEC_MAP
+#define HAS_SPEC_MAP 1
+#endif
+#ifndef HAS_NORMAL_MAP
+#define HAS_NORMAL_MAP 0
+#endif
+layout (location = 0) out vec4 albedo_spec;
+layout (location = 1) out vec2 packed_normal;
+layout (location = 2) out vec4 motion;
+
+in vec3 vertex_color;
+in vec3 surface_normal;
+in vec2 tex_coord;
+in vec3 frag_pos;
+in vec4 current_clip;
+in vec4 previous_clip;
+
+uniform sampler2D diffuse_maps[16];
+uniform sampler2D spec_maps[16];
+uniform sampler2D normal_map;
+
+#include "gamma.glsl"
+#include "gbuffer.glsl"
+#include "motion_vectors.glsl"
+#include "normal_mapping.glsl"
+
+void main()
+{
+    vec4 diffuse_map = texture(diffuse_maps[0], tex_coord);
+#if HAS_SPEC_MAP
+    vec3 spec_map = texture(spec_maps[0], tex_coord).rgb;
+#else
+    vec3 spec_map = diffuse_map.rgb;
+#endif
+#if HAS_NORMAL_MAP
+    vec3 normal = perturb_normal(surface_normal, frag_pos, tex_coord, texture(normal_map, tex_coord).xyz);
+#else
+    vec3 normal = normalize(surface_normal);
+#endif
+    //the forward pass shades with the gamma encoded specular map, keep its average as the intensity
+    albedo_spec = vec4(gamma_encode(diffuse_map.rgb), dot(gamma_encode(spec_map), vec3(1.0/3.0)));
+    packed_normal = oct_encode(normal);
+    motion = motion_vector(current_clip, previous_clip);
+}
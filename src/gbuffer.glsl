@@ -0,0 +1,23 @@
+//G-buffer layout of the deferred path, see deferred_renderer.h. 12 bytes of color targets per pixel :
+//  attachment 0, RGBA8      : gamma encoded albedo, specular intensity in alpha
+//  attachment 1, RG16_SNORM : octahedral world space normal
+//  attachment 2, RG16F      : motion vector, see motion_vectors.glsl
+//  depth/stencil            : world space position is reconstructed from depth, stencil marks covered pixels
+
+//octahedral normal encoding (Cigolle et al. 2014), unit vector to [-1, 1]^2
+vec2 sign_not_zero(vec2 v)
+{
+    return vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+vec2 oct_encode(vec3 n)
+{
+    vec2 p = n.xy/(abs(n.x) + abs(n.y) + abs(n.z));
+    return n.z <= 0.0 ? (1.0 - abs(p.yx))*sign_not_zero(p) : p;
+}
+vec3 oct_decode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx))*sign_not_zero(n.xy);
+    return normalize(n);
+}
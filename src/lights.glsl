@@ -0,0 +1,12 @@
+//light types shared by every lit shader
+struct light 
+{
+    vec4 pos;   //pos.w == 0 for directional light, otherwise point light
+    vec3 color;
+};
+struct spotlight
+{
+    light core;
+    vec3 direction;
+    float cosine_angle;
+};
@@ -6,19 +6,96 @@
 #include "glm/gtc/type_ptr.hpp"
 
 #include "shader_utils.h"
+#include "shader_manager.h"
 #include "object_interface.h"
+#include "shader_permutations.h"
+#include "file_watcher.h"
+#include "clustered_lighting.h"
+#include "deferred_renderer.h"
+#include "cascaded_shadows.h"
+#include "shadow_atlas.h"
+#include "post_processing.h"
+#include "transparency.h"
+#include "render_graph.h"
+#include "command_buffer.h"
+#include "snapshot_mailbox.h"
+#include "frame_pacing.h"
+
+#include <atomic>
+#include <random>
+#include <thread>
 
 //global constants
 constexpr float aspect_ratio = 16.0/9.0;
 constexpr int WINDOW_H = 600;
 constexpr int WINDOW_W = aspect_ratio * WINDOW_H;
+constexpr float FOV_Y = 45.0f;
+constexpr float Z_NEAR = 0.1f, Z_FAR = 100.0f;
+constexpr int NR_DYNAMIC_LIGHTS = 4096;
 //statics
 static object_3D::object my_object;
 static object_3D::array_drawable* cube_ptr;
 static object_3D::array_drawable* plane_ptr;
+static object_3D::array_drawable* skybox_ptr = nullptr;
+static object_3D::array_drawable* glass_ptr;
+//thin glass panes, drawn in this fixed order whatever the view, the transparent pass does not need them sorted
+static const glm::vec3 glass_positions[] = {{-1.0f, 0.3f, -1.5f}, {-0.6f, 0.4f, -0.5f}, {-1.4f, 0.2f, -1.0f}};
+static ibl::ibl_data environment_lighting;
+static bool ibl_loaded = false;
 static GLFWwindow* myWindow;
 
 static unsigned int program_ids[10];    //TODO should support dynamic id numbers
+static shader_manager shaders;
+static shader_manager::handle skybox_program;
+static shader_permutations scene_variants(shaders, "src/vShader.vert", "src/fShader.frag");
+static file_watcher shader_sources;     //edited shaders are recompiled while the scene keeps running
+static clustered::light_clusters light_clusters;
+static std::vector<clustered::point_light> dynamic_lights;
+static std::vector<glm::vec4> dynamic_light_orbits;    //centre xyz, phase
+static int framebuffer_width = WINDOW_W, framebuffer_height = WINDOW_H;
+enum render_path {FORWARD, DEFERRED};
+//the keys' toggles. the simulation thread flips them and every snapshot carries them to the render thread.
+struct scene_settings
+{
+    //the forward and deferred paths render the same scene, TAB switches between them to compare frame times
+    render_path path = FORWARD;
+    //the forward path can lay down depth with positions only first, so its lighting runs once per visible pixel. P toggles it.
+    bool depth_prepass = true;
+    bool temporal_aa = true;            //T
+    bool dynamic_resolution = true;     //R
+    bool vsync = true;                  //V, without it the pacer sleeps until every frame's slot
+    unsigned int graph_prints = 0;      //G presses, the render thread prints the frame graph when it changes
+};
+static scene_settings settings;
+static shader_manager::handle depth_prepass_program;
+static deferred::renderer deferred_path(shaders);
+static glm::mat4 view_transform(1.0f), projection_transform(1.0f);     //projection without the jitter
+static glm::mat4 previous_view_projection(1.0f);
+static shadows::sun_cascades sun_shadows;
+static const glm::vec3 sun_direction = glm::normalize(glm::vec3(-0.4f, -1.0f, -0.3f));
+static const glm::vec3 sun_color(0.45f, 0.42f, 0.38f);
+static shadows::shadow_atlas local_shadows;
+static shadows::shadow_atlas::handle rotating_light_shadow, flashlight_shadow;
+static const glm::vec3 flashlight_direction(0.0f, 0.0f, -1.0f);
+static const float flashlight_cosine = cos(glm::radians(12.5f));
+constexpr float FLASHLIGHT_RANGE = 16.0f;  //its 1/d^2 falloff is below 1/256 from here on
+//the scene is drawn offscreen and reaches the window through the post processing chain
+static post::hdr_target scene_target;
+static post::post_chain post_effects;
+static oit::weighted_blended transparent_pass;  //drawn over the opaque scene before post processing
+//every pass of a frame goes through it, it keeps the pooled transients and cached framebuffers across frames. G prints it.
+static graph::render_graph frame_graph;
+//this frame's shadow maps and light lists, read by every pass shading with the scene lights
+static graph::resource sun_shadow_maps, shadow_atlas_map, shadow_views, cluster_lights, cluster_counts, cluster_indices;
+//the opaque scene's draws are recorded into one command buffer per partition of it, in parallel, and replayed in order
+static std::vector<commands::command_buffer> scene_commands;
+static commands::replay_statistics scene_replay;
+constexpr size_t MIN_PARTS_PER_PARTITION = 16;     //fewer draws cost less to record than a thread to start
+static post::gpu_timer frame_timer;     //all of render(), the post passes time themselves inside it
+//the scene is drawn at a lower resolution when the GPU frame time exceeds its budget, R toggles it
+static post::resolution_controller resolution;
+static float render_scale = 1.0f;
+static int render_width = WINDOW_W, render_height = WINDOW_H;
 static unsigned int VAO_ids[10];
 static unsigned int tex_ids[10];
 static unsigned int uniform_buffer_block_ids[10];
@@ -27,15 +104,43 @@ static glm::vec3 cam_pos(0, 0, 1);
 static glm::vec3 cam_front(0, 0, -1);
 static glm::vec3 cam_up(0, 1, 0);
 
-static float frame_delta = 0.0;
+static float frame_delta = 0.0;     //between the render thread's frames
 static glm::vec2 mouse_pos(float(WINDOW_W)/2.0, float(WINDOW_H)/2.0);
 float yaw = -90.0f;
 float pitch;
+//the window's events and the simulation run on the main thread, the GL context lives on the render thread. the
+//simulation publishes a snapshot of everything it moves every step; the render thread draws a blend of the newest two,
+//so neither waits on the other and a hitch in one does not stall the other.
+struct scene_snapshot
+{
+    double time = 0.0;      //when the step was taken
+    glm::vec3 cam_pos, cam_front, cam_up;
+    glm::vec3 light_pos;
+    glm::mat4 object_transform;
+    std::vector<clustered::point_light> lights;
+    scene_settings settings;
+};
+constexpr double SIMULATION_STEP = 1.0/60.0;    //the simulated seconds every step advances, whatever the render rate
+constexpr int MAX_STEPS_PER_UPDATE = 5;         //behind by more, the simulation drops the backlog instead of catching up
+static snapshots::mailbox<scene_snapshot> scene_snapshots;
+//the render thread's newest two snapshots, and what it draws this frame
+static scene_snapshot previous_snapshot, current_snapshot, drawn;
+static std::atomic<int> window_width(WINDOW_W), window_height(WINDOW_H);   //set on the main thread when the window resizes
+//frames are held for an even number of display refreshes, and their times reported as percentiles
+static pacing::frame_pacer pacer;
+static pacing::frame_times frame_times;
 //functions 
 void frame_buffer_callback(GLFWwindow* window, int width, int height);
 void process_input(GLFWwindow* window);
 inline bool initialize();
 inline void render();
+shader_features scene_lighting();
+void spawn_dynamic_lights();
+void animate_dynamic_lights(double time);
+void simulate(double time);
+void blend_snapshots(double time);
+void render_loop();
+const object_3D::material& object_material(const object_3D::object &obj);
 void sendVertexData();
 int main()
 {
@@ -44,24 +149,24 @@ int main()
         glfwTerminate();
         return -1;
     }
-    {   //link shaders using a single vertex shader id. Program switching is expensive.
-        //the same shader can be attached to multiple programs, and the inverse is true.
-        unsigned int vShader, fShader;
-        bool shaders_made = 
-        compileShaderFromPath(VERTEX_SHADER, vShader, "src/vShader.vert") &&
-        compileShaderFromPath(FRAGMENT_SHADER, fShader, "src/fShader.frag")&&
-        linkShaders(program_ids[0], vShader, fShader);
-        if (!shaders_made)
-        {
-            glfwTerminate();
-            return -1;
-        }
-        glDeleteShader(vShader);
-        glDeleteShader(fShader);
-    }
-    gen_texture("marble.jpg", tex_ids[0]);
-    gen_texture("metal.png", tex_ids[1]);
-    if (!read_obj("backpack_model/backpack.obj", my_object))
+    //all programs compile on driver threads while assets load. linked programs are cached on disk,
+    //so later launches skip compilation entirely.
+    shaders.init((GLADloadproc)glfwGetProcAddress);
+    skybox_program = shaders.submit("src/cubemap.vert", "src/cubemap.frag");
+    depth_prepass_program = shaders.submit("src/depth_prepass.vert", "src/shadow_depth.frag");
+    light_clusters.init(shaders);
+    post_effects.init(shaders);
+    transparent_pass.init(shaders);
+    spawn_dynamic_lights();
+    sun_shadows.init(shaders);
+    sun_shadows.set_direction(sun_direction);
+    local_shadows.init(shaders);
+    rotating_light_shadow = local_shadows.add_point_light();
+    flashlight_shadow = local_shadows.add_spot_light();
+    resources::shared.acquire_texture("marble.jpg", tex_ids[0]);
+    resources::shared.acquire_texture("metal.png", tex_ids[1]);
+    streaming::streamer.set_view(WINDOW_H, glm::radians(45.f));
+    if (!read_obj("backpack_model/backpack.obj", my_object, true))
     {
         glfwTerminate();
         return -1;
@@ -123,97 +228,511 @@ int main()
 };
    
     object_3D::array_drawable plane(planeVertices, sizeof(planeVertices), true, true);
+    plane.position_stream = true;  //for the depth pre-pass and the shadow passes
     plane.send_data();
     plane.textures.diffuse_map.id = tex_ids[1];
     object_3D::array_drawable cube(cubeVertices, sizeof(cubeVertices), true, true);
+    cube.position_stream = true;
     cube.send_data();
     cube.textures.diffuse_map.id = tex_ids[0];
     cube_ptr = &cube;
     plane_ptr = &plane;
+    object_3D::array_drawable glass(cubeVertices, sizeof(cubeVertices), true, true);
+    glass.send_data();
+    glass.textures.diffuse_map.id = tex_ids[0];
+    glass.textures.opacity = 0.35f;
+    glass_ptr = &glass;
+    object_3D::array_drawable skybox(cubeVertices, sizeof(cubeVertices), true, true);
+    {   //the skybox is optional, the scene renders without it
+        const double load_start = glfwGetTime();
+        const std::vector<std::string> faces = {"skybox/right.jpg", "skybox/left.jpg", "skybox/top.jpg",
+        "skybox/bottom.jpg", "skybox/front.jpg", "skybox/back.jpg"};
+        if (gen_cubemap(faces, skybox.textures.cube_map.id))
+        {
+            std::cout << "skybox loaded in " << (glfwGetTime() - load_start)*1000.0 << "ms" << std::endl;
+            skybox.cubemap = true;
+            skybox.send_data();
+            skybox_ptr = &skybox;
+            //image based lighting from the same faces, precomputed on the CPU and cached under cache/
+            const double ibl_start = glfwGetTime();
+            if (ibl::prepare(faces, "cache", environment_lighting))
+            {
+                gen_ibl_textures(environment_lighting, tex_ids[2], tex_ids[3]);
+                ibl_loaded = true;
+                std::cout << "image based lighting ready in " << (glfwGetTime() - ibl_start)*1000.0 << "ms" << std::endl;
+            }
+        }
+    }
+    my_object.position_stream = true;
     my_object.send_data();
+    resources::shared.print_stats();
+    //submit every variant the scene's materials need, they compile while the remaining setup runs
+    scene_variants.request(material_features(plane.textures, scene_lighting()));
+    scene_variants.request(material_features(cube.textures, scene_lighting()));
+    scene_variants.request(material_features(object_material(my_object), scene_lighting()));
+    scene_variants.request(material_features(glass.textures, scene_lighting()));
+    deferred_path.prepare(material_features(plane.textures, shader_features()), scene_lighting());
+    deferred_path.prepare(material_features(cube.textures, shader_features()), scene_lighting());
+    deferred_path.prepare(material_features(object_material(my_object), shader_features()), scene_lighting());
+    for (const std::string &path : shaders.source_files())   //includes too, so editing a header reloads its users
+        shader_sources.watch(path);
+    shaders.poll();
+    std::cout << scene_variants.size() << " scene shader variants, " << shaders.pending() << " shader programs still compiling after asset loading ("
+    << (shaders.parallel_compile() ? "parallel" : "serial") << " compilation)" << std::endl;
+    if (shaders.pending() == 0)
+        program_cache::print_stats();
     //*****************************
     unsigned int &ubo = uniform_buffer_block_ids[0];
     glGenBuffers(1, &ubo);
     glBindBuffer(GL_UNIFORM_BUFFER, ubo);
-    glBufferData(GL_UNIFORM_BUFFER, 2*sizeof(glm::mat4), NULL, GL_STATIC_DRAW);
+    glBufferData(GL_UNIFORM_BUFFER, 4*sizeof(glm::mat4), NULL, GL_STATIC_DRAW);
     glBindBufferBase(GL_UNIFORM_BUFFER, 0, ubo);
     glBindBuffer(GL_UNIFORM_BUFFER, 0);
     //*****************************
     //renderloop
     glEnable(GL_DEPTH_TEST);
+    glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
     glEnable(GL_STENCIL_TEST);
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    
-    float previous_frame_time = 0.0;
-    float fps_sum = 0.0;
+
+    const GLFWvidmode* video_mode = glfwGetVideoMode(glfwGetPrimaryMonitor());
+    pacer.set_refresh_rate(video_mode ? video_mode->refreshRate : 60);
+    //the context moves to the render thread, the first snapshot is ready before it starts
+    double simulated_until = glfwGetTime();
+    simulate(simulated_until);
+    glfwMakeContextCurrent(NULL);
+    jobs::pool.release();   //the render thread submits the per-frame jobs from now on
+    std::thread render_thread(render_loop);
+    //GLFW only takes events on the main thread, which steps the simulation with them and waits for input in between.
+    //the simulation advances in fixed steps, as many as the time passed holds, so movement is the same at any rate
+    while (!glfwWindowShouldClose(myWindow))
+    {
+        glfwPollEvents();
+        const double now = glfwGetTime();
+        for (int steps = 0; simulated_until + SIMULATION_STEP <= now; steps++)
+        {
+            if (steps == MAX_STEPS_PER_UPDATE)
+            {   //after a long stall, moving on beats replaying it
+                simulated_until = now;
+                break;
+            }
+            simulated_until += SIMULATION_STEP;
+            process_input(myWindow);
+            simulate(simulated_until);
+        }
+        for (double left; (left = simulated_until + SIMULATION_STEP - glfwGetTime()) > 0.0 && !glfwWindowShouldClose(myWindow);)
+            glfwWaitEventsTimeout(left);
+    }
+    render_thread.join();
+    glfwMakeContextCurrent(myWindow);
+    //hand back what was taken from the registry, which then holds nothing
+    my_object.release();
+    resources::shared.release_texture(tex_ids[0]);
+    resources::shared.release_texture(tex_ids[1]);
+    resources::shared.print_stats();
+    glfwTerminate();
+    return 0;
+}
+//draws frames from the snapshots the simulation publishes, paced to the display
+void render_loop()
+{
+    glfwMakeContextCurrent(myWindow);
+    jobs::pool.adopt();
+    double previous_frame_time = glfwGetTime();
+    int swap_interval = -1;
     int frame_count = 0;
+    pacing::percentiles frame_percentiles;
 
     while (!glfwWindowShouldClose(myWindow))
     {
+        if (shaders.failures() > 0)
+        {
+            glfwSetWindowShouldClose(myWindow, true);
+            break;
+        }
+        const double frame_start = glfwGetTime();
         render();
+        const int interval = pacer.pace(1000.0f*float(glfwGetTime() - frame_start), float(frame_timer.milliseconds()), drawn.settings.vsync);
+        if (interval != swap_interval)
+            glfwSwapInterval(swap_interval = interval);
+        glfwSwapBuffers(myWindow);
         frame_delta = glfwGetTime() - previous_frame_time;
         previous_frame_time = glfwGetTime();
-        process_input(myWindow);
-        glfwSwapBuffers(myWindow);
-        glfwPollEvents();
-        //display fps 
-        frame_count++;
-        fps_sum += frame_delta;
-        float fps_avg = fps_sum/frame_count;
-        std::cout << '\r' << 1.0f/frame_delta << "FPS" << std::flush;
+        frame_times.record(1000.0f*frame_delta);
+        if (frame_count++ % 30 == 0)    //the percentiles of the last few thousand frames barely move in a frame
+            frame_percentiles = frame_times.summary();
+        const streaming::streaming_stats &streamed = streaming::streamer.stats();
+        std::cout << '\r' << "frame " << frame_percentiles.p50 << "/" << frame_percentiles.p99 << "/" << frame_percentiles.p999 << "ms p50/p99/p99.9, "
+        << pacer.refreshes_per_frame() << (drawn.settings.vsync ? " refreshes per frame (vsync) | " : " refreshes per frame (timed) | ") << int(100.0f*render_scale + 0.5f) << "% resolution " << (drawn.settings.path == DEFERRED ? "deferred" : (drawn.settings.depth_prepass ? "forward + depth pre-pass" : "forward")) << " | " << light_clusters.light_count() << " lights | shadows : " << sun_shadows.rendered_cascades() << " cascades, "
+        << local_shadows.statistics_last_update().views_rendered << " atlas views, " << sun_shadows.shadow_draws() + local_shadows.statistics_last_update().shadow_draws << " draws, "
+        << local_shadows.statistics_last_update().allocated_bytes/(1 << 20) << "/" << local_shadows.statistics_last_update().atlas_bytes/(1 << 20) << "MiB atlas | textures " << streamed.resident_bytes/(1 << 20) << "MiB resident, "
+        << streamed.pending_requests << " mips pending | GPU " << frame_timer.milliseconds() << "/" << resolution.budget_ms << "ms, post " << post_effects.total_milliseconds() << "ms, bloom "
+        << post_effects.bloom_milliseconds() << "ms (" << 100.0*post_effects.bloom_milliseconds()/std::max(frame_timer.milliseconds(), 1e-6) << "% of the frame) | graph "
+        << frame_graph.statistics_last_frame().passes - frame_graph.statistics_last_frame().culled << "/" << frame_graph.statistics_last_frame().passes << " passes, "
+        << frame_graph.statistics_last_frame().barriers << " barriers, transients " << frame_graph.statistics_last_frame().aliased_bytes/(1 << 20) << "/"
+        << frame_graph.statistics_last_frame().transient_bytes/(1 << 20) << "MiB aliased | scene " << scene_replay.draws << " draws from " << scene_commands.size()
+        << " command buffers, " << scene_replay.skipped << " redundant commands skipped | simulation " << scene_snapshots.stats().published
+        << " steps, " << scene_snapshots.stats().skipped << " not drawn   " << std::flush;
     }
-    glfwTerminate();
-    return 0;
+    glfwMakeContextCurrent(NULL);
 }
 inline void send_transforms()
 {
     using namespace glm;
     mat4 view(1.0f);
-    view = lookAt(cam_pos, cam_pos + cam_front, cam_up);
-    mat4 projection = perspective(radians(45.f), float(WINDOW_W)/WINDOW_H, 0.1f, 100.f);
+    view = lookAt(drawn.cam_pos, drawn.cam_pos + drawn.cam_front, drawn.cam_up);
+    mat4 projection = perspective(radians(FOV_Y), float(WINDOW_W)/WINDOW_H, Z_NEAR, Z_FAR);
+    light_clusters.set_projection(projection, Z_NEAR, Z_FAR, render_width, render_height);
     
     glBindBuffer(GL_UNIFORM_BUFFER, uniform_buffer_block_ids[0]);
 
-    mat4 data[2]{view, projection};
-    glBufferData(GL_UNIFORM_BUFFER, 2*sizeof(mat4), data, GL_STATIC_DRAW);
+    previous_view_projection = projection_transform*view_transform;
+    view_transform = view;
+    projection_transform = projection;
+    //draws use the jittered projection, motion vectors the plain ones, see vShader.vert
+    mat4 data[4]{view, post_effects.jitter(projection, render_width, render_height), projection*view, previous_view_projection};
+    glBufferData(GL_UNIFORM_BUFFER, 4*sizeof(mat4), data, GL_STATIC_DRAW);
 
     glBindBuffer(GL_UNIFORM_BUFFER,  0);
 }
 static glm::vec3 light_pos(0, 0, 1.2);
-inline void send_light_info()
+//small coloured lights scattered over the floor, plus the rotating light as light 0
+void spawn_dynamic_lights()
+{
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    dynamic_lights.resize(NR_DYNAMIC_LIGHTS);
+    dynamic_light_orbits.resize(NR_DYNAMIC_LIGHTS);
+    dynamic_lights[0] = {glm::vec4(light_pos, 10.0f), glm::vec4(1.0f, 1.0f, 1.0f, 0.0f)};
+    for (int i = 1; i < NR_DYNAMIC_LIGHTS; i++)
+    {
+        dynamic_light_orbits[i] = glm::vec4(10.0f*unit(rng) - 5.0f, -0.4f + 0.6f*unit(rng), 10.0f*unit(rng) - 5.0f, 6.2831853f*unit(rng));
+        const glm::vec3 color = glm::vec3(unit(rng), unit(rng), unit(rng))*0.05f;
+        dynamic_lights[i] = {glm::vec4(glm::vec3(dynamic_light_orbits[i]), 0.3f + 0.3f*unit(rng)), glm::vec4(color, 0.0f)};
+    }
+}
+void animate_dynamic_lights(double time)
+{
+    const float t = time;
+    dynamic_lights[0].position_radius = glm::vec4(light_pos, dynamic_lights[0].position_radius.w);
+    for (int i = 1; i < NR_DYNAMIC_LIGHTS; i++)
+    {
+        const glm::vec4 &orbit = dynamic_light_orbits[i];
+        dynamic_lights[i].position_radius.x = orbit.x + 0.3f*cos(t + orbit.w);
+        dynamic_lights[i].position_radius.z = orbit.z + 0.3f*sin(t + orbit.w);
+    }
+}
+//one simulation step at time, after process_input() moved the camera : moves the lights and publishes the snapshot
+void simulate(double time)
+{
+    light_pos = glm::vec3(3*sin(time), 1.2f, 3*cos(time));
+    animate_dynamic_lights(time);
+    scene_snapshot &snapshot = scene_snapshots.back();
+    snapshot.time = time;
+    snapshot.cam_pos = cam_pos;
+    snapshot.cam_front = cam_front;
+    snapshot.cam_up = cam_up;
+    snapshot.light_pos = light_pos;
+    snapshot.object_transform = glm::translate(glm::mat4(1.0), glm::vec3(0.25, 0, 0));
+    snapshot.lights = dynamic_lights;
+    snapshot.settings = settings;
+    scene_snapshots.publish();
+}
+//takes the simulation's newest snapshot, then blends the newest two into drawn at one step before time. the frame
+//then always lies between two published steps, and moves smoothly at any render rate.
+void blend_snapshots(double time)
+{
+    if (scene_snapshots.acquire())
+    {
+        std::swap(previous_snapshot, current_snapshot);
+        current_snapshot = scene_snapshots.front();
+        if (previous_snapshot.lights.size() != current_snapshot.lights.size())  //the first, nothing to blend from yet
+            previous_snapshot = current_snapshot;
+    }
+    const scene_snapshot &from = previous_snapshot, &to = current_snapshot;
+    const float t = snapshots::blend_factor(time - SIMULATION_STEP, from.time, to.time);
+    drawn.time = from.time + t*(to.time - from.time);
+    drawn.cam_pos = glm::mix(from.cam_pos, to.cam_pos, t);
+    drawn.cam_front = glm::normalize(glm::mix(from.cam_front, to.cam_front, t));
+    drawn.cam_up = glm::mix(from.cam_up, to.cam_up, t);
+    drawn.light_pos = glm::mix(from.light_pos, to.light_pos, t);
+    drawn.object_transform = (1.0f - t)*from.object_transform + t*to.object_transform;   //only ever translated
+    drawn.lights.resize(to.lights.size());
+    for (size_t i = 0; i < to.lights.size(); i++)
+        drawn.lights[i] = {glm::mix(from.lights[i].position_radius, to.lights[i].position_radius, t), to.lights[i].color};
+    drawn.settings = to.settings;
+}
+//the lights every scene shader variant is specialised for
+shader_features scene_lighting()
+{
+    shader_features lighting;
+    lighting.point_lights = 0;
+    lighting.clustered_lights = true;   //the rotating light and the floor lights
+    lighting.spot_lights = 1;           //the camera's flashlight
+    lighting.directional_lights = 1;    //the sun
+    lighting.sun_shadows = true;
+    lighting.local_shadows = true;      //the rotating light and the flashlight
+    lighting.ibl = ibl_loaded;
+    return lighting;
+}
+//objects are shaded with their first material
+const object_3D::material& object_material(const object_3D::object &obj)
+{
+    static const object_3D::material untextured;
+    return obj.materials.empty() ? untextured : obj.materials[0];
+}
+inline void send_light_info(unsigned int program_id)
+{
+    glUniform3f(glGetUniformLocation(program_id, "spot_lights[0].core.color"), 1.0, 1.0, 1.0);
+    glUniform4f(glGetUniformLocation(program_id, "spot_lights[0].core.pos"), drawn.cam_pos.x, drawn.cam_pos.y, drawn.cam_pos.z, 1);
+    glUniform3f(glGetUniformLocation(program_id, "spot_lights[0].direction"), flashlight_direction.x, flashlight_direction.y, flashlight_direction.z);
+    glUniform1f(glGetUniformLocation(program_id, "spot_lights[0].cosine_angle"), flashlight_cosine);
+    glUniform1i(glGetUniformLocation(program_id, "spot_shadow_indices[0]"), local_shadows.shadow_index(flashlight_shadow));
+    glUniform4f(glGetUniformLocation(program_id, "directional_lights[0].pos"), sun_direction.x, sun_direction.y, sun_direction.z, 0);
+    glUniform3f(glGetUniformLocation(program_id, "directional_lights[0].color"), sun_color.r, sun_color.g, sun_color.b);
+    sun_shadows.bind(program_id);
+    local_shadows.bind();
+    glUniform3f(glGetUniformLocation(program_id, "eye_pos"), drawn.cam_pos.x, drawn.cam_pos.y, drawn.cam_pos.z);
+}
+//texture units 14 and 15 are reserved for image based lighting, see fShader.frag
+inline void send_ibl_info(unsigned int program_id)
+{
+    if (!ibl_loaded)
+        return;
+    glUniform3fv(glGetUniformLocation(program_id, "sh_irradiance"), 9, &environment_lighting.sh[0][0]);
+    glUniform1f(glGetUniformLocation(program_id, "prefiltered_max_level"), float(environment_lighting.specular.size() - 1));
+    glActiveTexture(GL_TEXTURE14);
+    glBindTexture(GL_TEXTURE_2D, tex_ids[3]);
+    glActiveTexture(GL_TEXTURE15);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, tex_ids[2]);
+}
+//binds the smallest scene variant for mat and sends it the lights. 0 while that variant is still compiling.
+inline unsigned int use_scene_program(const object_3D::material &mat)
 {
-    glUniform3f(glGetUniformLocation(program_ids[0], "lights[0].color"), 1.0, 1.0, 1.0);
-    glUniform4f(glGetUniformLocation(program_ids[0], "lights[0].pos"), light_pos.x, light_pos.y, light_pos.z, 1);
-    glUniform3f(glGetUniformLocation(program_ids[0], "eye_pos"), cam_pos.x, cam_pos.y, cam_pos.z);
+    const unsigned int program_id = scene_variants.program(material_features(mat, scene_lighting()));
+    if (!program_id)
+        return 0;
+    glUseProgram(program_id);
+    send_light_info(program_id);
+    send_ibl_info(program_id);
+    glUniform1f(glGetUniformLocation(program_id, "opacity"), mat.opacity);
+    return program_id;
+}
+//the geometry pass of the deferred path only needs the material's textures, never the lights
+inline unsigned int use_geometry_program(const object_3D::material &mat)
+{
+    return deferred_path.use_geometry_program(material_features(mat, shader_features()));
+}
+//shadow casters, drawn from their position streams. the plane and the cube never move; the backpack's transform is set every frame,
+//so it is treated as dynamic and only cast into the cascades redrawn every frame.
+int draw_shadow_casters(unsigned int program_id, bool static_only)
+{
+    plane_ptr->draw_positions(program_id);
+    cube_ptr->draw_positions(program_id);
+    if (static_only)
+        return 2;
+    my_object.draw_positions(program_id);
+    return 2 + int(my_object.meshes.size());
+}
+//the opaque scene's depth, from the position streams only
+inline void draw_scene_depth(unsigned int program_id)
+{
+    plane_ptr->draw_positions(program_id);
+    cube_ptr->draw_positions(program_id);
+    my_object.draw_positions(program_id);
+}
+//draws the opaque scene, binding each object's program through use_program. programs are picked and sent their lights
+//here, on the GL thread; the scene's draws are then recorded as one job per partition and replayed.
+inline void draw_scene(unsigned int (*use_program)(const object_3D::material&))
+{
+    struct scene_draw
+    {
+        const object_3D::drawable* target;
+        unsigned int program_id;
+    };
+    const object_3D::drawable* const targets[3] = {plane_ptr, cube_ptr, &my_object};     //plane, cube, backpack
+    const object_3D::material* const materials[3] = {&plane_ptr->textures, &cube_ptr->textures, &object_material(my_object)};
+    scene_draw draws[3];
+    int draw_count = 0;
+    size_t parts = 0;
+    for (int i = 0; i < 3; i++)
+        if (unsigned int program_id = use_program(*materials[i]))
+        {
+            draws[draw_count++] = {targets[i], program_id};
+            parts += targets[i]->parts();
+        }
+    //one partition per thread of the job pool, worker 0 being this thread
+    const size_t partitions = std::max<size_t>(1, std::min<size_t>(jobs::pool.thread_count(), parts/MIN_PARTS_PER_PARTITION));
+    scene_commands.resize(partitions);
+    //partition p records the parts [first, last) of the scene, counted over the draws in order
+    commands::record_parallel(scene_commands, [&](size_t p, commands::command_buffer &out)
+    {
+        const size_t first = parts*p/partitions, last = parts*(p + 1)/partitions;
+        size_t offset = 0;
+        for (int i = 0; i < draw_count; i++)
+        {
+            const size_t count = draws[i].target->parts();
+            if (offset < last && offset + count > first)
+                draws[i].target->record(out, draws[i].program_id, std::max(first, offset) - offset, std::min(last, offset + count) - offset);
+            offset += count;
+        }
+    });
+    scene_replay = commands::replay(scene_commands);
+}
+//draws the transparent surfaces, in no particular order, in the transparent pass
+inline void draw_transparent_scene()
+{
+    const unsigned int program_id = use_scene_program(glass_ptr->textures);
+    if (!program_id)
+        return;
+    for (const glm::vec3 &position : glass_positions)
+    {
+        glass_ptr->model_transform = glm::scale(glm::translate(glm::mat4(1.0f), position), glm::vec3(0.8f, 0.8f, 0.05f));
+        glass_ptr->draw(program_id);
+    }
+}
+//adds the reads of the scene lights to a pass drawing with scene_lighting()
+void read_scene_lighting(graph::pass_builder pass)
+{
+    pass.read(sun_shadow_maps, graph::SAMPLED).read(shadow_atlas_map, graph::SAMPLED).read(shadow_views, graph::STORAGE)
+    .read(cluster_lights, graph::STORAGE).read(cluster_counts, graph::STORAGE).read(cluster_indices, graph::STORAGE);
 }
 void render()
 {
-    //glClearColor(0.65f, 0.45f, 0.75f, 1.f);
-    glClearColor(0.1f, 0.1f, 0.1f, 1.f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+    frame_timer.begin();
+    blend_snapshots(glfwGetTime());
+    post_effects.temporal_aa = drawn.settings.temporal_aa;
+    framebuffer_width = window_width;
+    framebuffer_height = window_height;
+    render_scale = drawn.settings.dynamic_resolution ? resolution.update(frame_timer.milliseconds()) : 1.0f;
+    render_width = std::min(post::scaled_size(framebuffer_width, render_scale), framebuffer_width);
+    render_height = std::min(post::scaled_size(framebuffer_height, render_scale), framebuffer_height);
+    //programs become usable as the driver finishes them, draws whose variant is not ready yet are skipped.
+    //edited shaders restart compiling here and replace their programs at the start of a later frame.
+    const std::vector<std::string> edited = shader_sources.changes();
+    for (const std::string &path : edited)
+        std::cout << "reloading " << path << " : " << shaders.reload(path) << " programs" << std::endl;
+    if (!edited.empty())
+        for (const std::string &path : shaders.source_files())  //edits may have added includes
+            shader_sources.watch(path);
+    const bool was_compiling = shaders.pending() > 0;
+    shaders.poll();
+    if (was_compiling && shaders.pending() == 0)
+        program_cache::print_stats();
+    program_ids[1] = shaders.program(skybox_program);
 
-    light_pos = glm::vec3(3*sin(glfwGetTime()), 1.2f, 3*cos(glfwGetTime()));
-    glUseProgram(program_ids[0]);
-    send_light_info();
     send_transforms();
-    //draw plane
-    plane_ptr->draw(program_ids[0]);
-    //draw cube
-    cube_ptr->draw(program_ids[0]);
-    //draw backpack 
-    my_object.model_transform = glm::translate(glm::mat4(1.0), glm::vec3(0.25, 0, 0));  
-    my_object.draw(program_ids[0]);
+    my_object.model_transform = drawn.object_transform;
+    //the frame's passes, in the order they depend on each other. the graph culls what nothing reads, places the
+    //barriers between them and the scene's targets in pooled memory
+    scene_target.create(frame_graph, framebuffer_width, framebuffer_height, render_scale);
+    //the shadow maps keep static lights' views across frames, so their passes always run
+    sun_shadow_maps = frame_graph.import_texture("sun cascades", sun_shadows.texture(), true);
+    shadow_atlas_map = frame_graph.import_texture("shadow atlas", local_shadows.texture(), true);
+    shadow_views = frame_graph.import_buffer("shadow views", local_shadows.view_buffer_id(), true);
+    cluster_lights = frame_graph.import_buffer("cluster lights", light_clusters.buffer(clustered::LIGHTS));
+    cluster_counts = frame_graph.import_buffer("cluster light counts", light_clusters.buffer(clustered::COUNTS));
+    cluster_indices = frame_graph.import_buffer("cluster light indices", light_clusters.buffer(clustered::INDICES));
+    frame_graph.add_pass("sun shadows", []()
+    {
+        sun_shadows.update(view_transform, glm::radians(FOV_Y), float(WINDOW_W)/WINDOW_H, Z_NEAR, draw_shadow_casters);
+    }).write(sun_shadow_maps, graph::ATTACHMENT);
+    frame_graph.add_pass("local shadows", []()
+    {
+        local_shadows.set_point_light(rotating_light_shadow, drawn.light_pos, drawn.lights[0].position_radius.w);
+        local_shadows.set_spot_light(flashlight_shadow, drawn.cam_pos, flashlight_direction, flashlight_cosine, FLASHLIGHT_RANGE);
+        local_shadows.update(drawn.cam_pos, glm::radians(FOV_Y), framebuffer_height, draw_shadow_casters);
+    }).write(shadow_atlas_map, graph::ATTACHMENT).write(shadow_views, graph::TRANSFER);
+    //added after the local shadows, so the rotating light picks up the shadow they gave it this frame. point lights
+    //reach the scene shaders through the clusters, binned against this frame's view
+    frame_graph.add_pass("light clusters", []()
+    {
+        drawn.lights[0].color.w = float(local_shadows.shadow_index(rotating_light_shadow));
+        light_clusters.set_lights(drawn.lights);
+        light_clusters.cull();
+    }).write(cluster_lights, graph::TRANSFER).write(cluster_counts, graph::STORAGE).write(cluster_indices, graph::STORAGE);
+    frame_graph.add_pass("clear scene", []()
+    {
+        scene_target.bind(frame_graph);
+        //scene_target.clear(glm::vec4(0.65f, 0.45f, 0.75f, 1.f));
+        scene_target.clear(glm::vec4(0.1f, 0.1f, 0.1f, 1.f));
+    }).write(scene_target.color, graph::TRANSFER).write(scene_target.motion, graph::TRANSFER).write(scene_target.depth_stencil, graph::TRANSFER);
+    if (drawn.settings.path == DEFERRED)
+        read_scene_lighting(deferred_path.add_passes(frame_graph, scene_target, scene_lighting(), projection_transform*view_transform,
+        []() {draw_scene(use_geometry_program);},
+        [](unsigned int program_id)
+        {
+            send_light_info(program_id);
+            send_ibl_info(program_id);
+        }));
+    else
+    {
+        //with the pre-pass the main pass only shades the fragment that won the depth test
+        const unsigned int prepass_id = drawn.settings.depth_prepass ? shaders.program(depth_prepass_program) : 0;
+        if (prepass_id)
+            frame_graph.add_pass("depth prepass", [prepass_id]()
+            {
+                scene_target.bind(frame_graph);
+                glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+                draw_scene_depth(prepass_id);
+                glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+            }).write(scene_target.depth_stencil, graph::ATTACHMENT);
+        read_scene_lighting(frame_graph.add_pass("forward opaque", [prepass_id]()
+        {
+            scene_target.bind(frame_graph);
+            if (prepass_id)
+            {
+                glDepthFunc(GL_EQUAL);
+                glDepthMask(GL_FALSE);
+            }
+            draw_scene(use_scene_program);
+            glDepthFunc(GL_LESS);
+            glDepthMask(GL_TRUE);
+        }).write(scene_target.color, graph::ATTACHMENT).write(scene_target.motion, graph::ATTACHMENT).write(scene_target.depth_stencil, graph::ATTACHMENT));
+    }
+    //draw skybox last, only where the depth buffer is still clear
+    if (skybox_ptr && program_ids[1])
+        frame_graph.add_pass("skybox", []()
+        {
+            scene_target.bind(frame_graph);
+            glDepthFunc(GL_LEQUAL);
+            skybox_ptr->draw(program_ids[1]);
+            glDepthFunc(GL_LESS);
+        }).write(scene_target.color, graph::ATTACHMENT).write(scene_target.motion, graph::ATTACHMENT).read(scene_target.depth_stencil, graph::ATTACHMENT);
+    //transparent surfaces are always drawn forward, on top of either path's opaque scene and its depth
+    read_scene_lighting(transparent_pass.add_passes(frame_graph, scene_target, draw_transparent_scene));
+    post_effects.add_passes(frame_graph, scene_target);
+    static unsigned int graph_prints = 0;
+    if (frame_graph.compile() && drawn.settings.graph_prints != graph_prints)
+        frame_graph.print();
+    graph_prints = drawn.settings.graph_prints;
+    frame_graph.execute();
+    //next frame's motion vectors start from where everything is now
+    plane_ptr->previous_model_transform = plane_ptr->model_transform;
+    cube_ptr->previous_model_transform = cube_ptr->model_transform;
+    my_object.previous_model_transform = my_object.model_transform;
+    frame_timer.end();
+    //request the mips the backpack needs at its current distance and its materials' UV density, then stream them in
+    const float object_distance = glm::length(drawn.cam_pos - glm::vec3(my_object.model_transform[3]));
+    for (const object_3D::material &mat : my_object.materials)
+    {
+        streaming::streamer.request(mat.diffuse_map.id, object_distance, mat.uv_density);
+        streaming::streamer.request(mat.spec_map.id, object_distance, mat.uv_density);
+    }
+    streaming::streamer.update();
 }
+//called on the main thread, the render thread picks the size up with its next frame
 void frame_buffer_callback(GLFWwindow* window, int width, int height)
 {
-    glViewport(0, 0, width, height);
+    window_width = width;
+    window_height = height;
 }
 void process_input(GLFWwindow* window)
 {
     if(glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
-    const float speed = 2*frame_delta;
+    const float speed = 2*SIMULATION_STEP;
     const glm::vec3 cam_right = glm::normalize(glm::cross(cam_front, cam_up)) * speed;
     if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
         cam_pos += speed * cam_front;
@@ -227,6 +746,36 @@ void process_input(GLFWwindow* window)
         cam_up += cam_right;
     if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS)
         cam_up -= cam_right;
+    static bool tab_was_down = false;
+    const bool tab_down = glfwGetKey(window, GLFW_KEY_TAB) == GLFW_PRESS;
+    if (tab_down && !tab_was_down)
+        settings.path = settings.path == FORWARD ? DEFERRED : FORWARD;
+    tab_was_down = tab_down;
+    static bool p_was_down = false;
+    const bool p_down = glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS;
+    if (p_down && !p_was_down)
+        settings.depth_prepass = !settings.depth_prepass;
+    p_was_down = p_down;
+    static bool t_was_down = false;
+    const bool t_down = glfwGetKey(window, GLFW_KEY_T) == GLFW_PRESS;
+    if (t_down && !t_was_down)
+        settings.temporal_aa = !settings.temporal_aa;
+    t_was_down = t_down;
+    static bool r_was_down = false;
+    const bool r_down = glfwGetKey(window, GLFW_KEY_R) == GLFW_PRESS;
+    if (r_down && !r_was_down)
+        settings.dynamic_resolution = !settings.dynamic_resolution;
+    r_was_down = r_down;
+    static bool g_was_down = false;
+    const bool g_down = glfwGetKey(window, GLFW_KEY_G) == GLFW_PRESS;
+    if (g_down && !g_was_down)
+        settings.graph_prints++;
+    g_was_down = g_down;
+    static bool v_was_down = false;
+    const bool v_down = glfwGetKey(window, GLFW_KEY_V) == GLFW_PRESS;
+    if (v_down && !v_was_down)
+        settings.vsync = !settings.vsync;
+    v_was_down = v_down;
 }
 void mouse_pos_callback(GLFWwindow* window, double x_pos, double y_pos)
 {
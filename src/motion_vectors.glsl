@@ -0,0 +1,7 @@
+//motion vectors for temporal anti-aliasing. the vertex shader passes the position in this frame's and last frame's
+//clip space, both without the projection jitter, the fragment shader writes how far the surface moved in uv since
+//last frame. post_processing.h reads them back to find where a pixel was in the history.
+vec4 motion_vector(vec4 current_clip, vec4 previous_clip)
+{
+    return vec4(0.5*(current_clip.xy/current_clip.w - previous_clip.xy/previous_clip.w), 0.0, 1.0);
+}
@@ -0,0 +1,19 @@
+//tangent frame from screen space derivatives, so normal maps need no per vertex tangents (Schuler 2006)
+mat3 cotangent_frame(vec3 n, vec3 p, vec2 uv)
+{
+    vec3 dp1 = dFdx(p);
+    vec3 dp2 = dFdy(p);
+    vec2 duv1 = dFdx(uv);
+    vec2 duv2 = dFdy(uv);
+    vec3 dp2perp = cross(dp2, n);
+    vec3 dp1perp = cross(n, dp1);
+    vec3 t = dp2perp*duv1.x + dp1perp*duv2.x;
+    vec3 b = dp2perp*duv1.y + dp1perp*duv2.y;
+    float invmax = inversesqrt(max(max(dot(t, t), dot(b, b)), 1e-12));
+    return mat3(t*invmax, b*invmax, n);
+}
+//world space normal from a tangent space normal map texel
+vec3 perturb_normal(vec3 surface_n, vec3 p, vec2 uv, vec3 map_texel)
+{
+    return normalize(cotangent_frame(normalize(surface_n), p, uv)*(map_texel*2.0 - 1.0));
+}
@@ -0,0 +1,19 @@
+#version 460 core
+//blends the transparent surfaces over the opaque scene: their weighted average color, covering as much of the pixel
+//as the product of their opacities leaves unrevealed. see transparency.glsl.
+layout (location = 0) out vec4 fragment_output;
+
+layout (binding = 0) uniform sampler2D accumulation;
+layout (binding = 1) uniform sampler2D revealage;
+
+void main()
+{
+    const ivec2 texel = ivec2(gl_FragCoord.xy);
+    const float revealed = texelFetch(revealage, texel, 0).r;
+    if (revealed >= 1.0)
+        discard;    //no transparent surface here, leave the pixel untouched
+    //half floats overflow to inf on many bright layers close to the camera. clamped to the largest half, the
+    //channels that did not overflow still keep the pixel's hue
+    const vec4 sum = min(texelFetch(accumulation, texel, 0), vec4(65504.0));
+    fragment_output = vec4(sum.rgb/max(sum.a, 1e-5), 1.0 - revealed);
+}
@@ -0,0 +1,7 @@
+//separable kernel shared by the post processing passes. post_processing.h scales it to the current resolution
+//and fills the weights, centre first, the kernel is symmetric.
+#define TILE_SIZE 16            //post::TILE_SIZE
+#define MAX_KERNEL_RADIUS 16    //post::MAX_KERNEL_RADIUS
+uniform int kernel_radius;
+uniform ivec2 render_size;      //the scene covers this many texels of the post targets, which have the output size
+uniform float kernel_weights[MAX_KERNEL_RADIUS + 1];
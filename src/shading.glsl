@@ -0,0 +1,183 @@
+//light uniforms and the shading model shared by the forward pass (fShader.frag) and the deferred lighting pass.
+//the including shader defines the surface first : diffuse_map, spec_map, normal and frag_pos (world space).
+//light counts are compile time constants, specialised per draw by shader_permutations.h.
+#ifndef NR_POINT_LIGHTS
+#define NR_POINT_LIGHTS 1
+#endif
+#ifndef NR_DIRECTIONAL_LIGHTS
+#define NR_DIRECTIONAL_LIGHTS 0
+#endif
+#ifndef NR_SPOT_LIGHTS
+#define NR_SPOT_LIGHTS 1
+#endif
+#ifndef HAS_AMBIENT_LIGHT
+#define HAS_AMBIENT_LIGHT 0
+#endif
+#ifndef USE_IBL
+#define USE_IBL 0
+#endif
+#ifndef CLUSTERED_LIGHTS
+#define CLUSTERED_LIGHTS 0
+#endif
+#ifndef SUN_SHADOWS
+#define SUN_SHADOWS 0
+#endif
+#ifndef LOCAL_SHADOWS
+#define LOCAL_SHADOWS 0
+#endif
+#include "lights.glsl"
+#if CLUSTERED_LIGHTS
+#include "clusters.glsl"
+#endif
+#if SUN_SHADOWS
+#include "shadows.glsl"
+#endif
+#if LOCAL_SHADOWS
+#include "shadow_atlas.glsl"
+#endif
+
+uniform vec3 eye_pos;
+#if NR_POINT_LIGHTS > 0
+uniform light point_lights[NR_POINT_LIGHTS];
+#endif
+#if NR_DIRECTIONAL_LIGHTS > 0
+uniform light directional_lights[NR_DIRECTIONAL_LIGHTS];    //with SUN_SHADOWS, light 0 is the sun
+#endif
+#if NR_SPOT_LIGHTS > 0
+uniform spotlight spot_lights[NR_SPOT_LIGHTS];
+#if LOCAL_SHADOWS
+uniform int spot_shadow_indices[NR_SPOT_LIGHTS];   //see shadow_atlas.glsl
+#endif
+#endif
+#if HAS_AMBIENT_LIGHT
+uniform vec3 ambient_light;
+#endif
+//image based lighting, see ibl_precompute.h. units 14 and 15 are reserved so material samplers never collide.
+uniform vec3 sh_irradiance[9];      //irradiance SH, already convolved with the cosine lobe
+uniform float prefiltered_max_level;
+layout (binding = 14) uniform sampler2D brdf_lut;
+layout (binding = 15) uniform samplerCube prefiltered_specular;
+
+const float SHININESS = 24.0;
+const float KL = 0.00;    //linear distance attenuation factor
+const float KQ = 1.00;    //quadratic distance attenuation factor
+
+float spec(vec3 light_dir)
+{   //expects light_dir TOWARDS the surface
+    vec3 view_direction = normalize(eye_pos-frag_pos);
+    //vec3 reflect_direction = reflect(vec3(light_dir), normal);
+    vec3 halfway_vector;
+    if (dot(normal, normalize(light_dir))>0)
+        return 0;
+    else 
+        halfway_vector = normalize(view_direction+light_dir);
+    float angular_intensity = max(dot(halfway_vector, normal), 0);
+    float spec_intensity = pow(angular_intensity, SHININESS);
+    return spec_intensity;
+}
+vec3 shade_spot(spotlight s_light)
+{
+    vec3 differential = vec3(s_light.core.pos)-frag_pos;    //change these names
+    float cos_phi = dot(normalize(differential), normalize(-s_light.direction)); //equal to cos(phi)
+    if (cos_phi>=s_light.cosine_angle)
+    {
+        float d = length(frag_pos-vec3(s_light.core.pos));
+        float distance_attenuation = 1.0/(d*d);
+        //the higher this is, the closer we are to the center of the spotlight
+        float attenuation_factor = (cos_phi-s_light.cosine_angle);  //[0, 1-cosine_angle]
+        attenuation_factor /= (1-s_light.cosine_angle); //[0, 1]
+        return distance_attenuation*(0.5*attenuation_factor + 0.5*pow(attenuation_factor, 2))*   //sharpness factor * attenuation factor 
+        (vec3(diffuse_map)*s_light.core.color + vec3(spec_map)*spec(s_light.direction));
+    }
+    return vec3(0, 0, 0);
+}
+vec4 shade_point(light point_light)
+{
+    vec3 light_dir = normalize(vec3(point_light.pos)-frag_pos);
+    float diffuse_intensity = max(dot(light_dir,  normal), 0.0);
+    float d = length(frag_pos-vec3(point_light.pos));
+    float attenuation = 1.0/(1.0+KL*d+KQ*d*d);
+    return attenuation*((vec4(diffuse_intensity*diffuse_map)*vec4(point_light.color, 1))+(spec(-light_dir)*spec_map));
+}
+#if CLUSTERED_LIGHTS
+//a point light faded to zero at its radius, so culling it outside that radius is invisible
+vec4 shade_clustered(clustered_light c_light)
+{
+    float d = length(frag_pos-c_light.position_radius.xyz);
+    float falloff = clamp(1.0 - pow(d/c_light.position_radius.w, 4.0), 0.0, 1.0);
+    float shadow = 1.0;
+#if LOCAL_SHADOWS
+    if (c_light.color.w > 0.0)
+        shadow = point_shadow(int(c_light.color.w), c_light.position_radius.xyz);
+#endif
+    light core = light(vec4(c_light.position_radius.xyz, 1.0), c_light.color.rgb);
+    return shadow*falloff*falloff*shade_point(core);
+}
+#endif
+vec4 shade_directional(light dir_light)
+{
+    float diffuse_intensity = max(dot(normalize(-vec3(dir_light.pos)),  normal), 0.0);
+    return (spec(vec3(dir_light.pos))*spec_map + diffuse_intensity*diffuse_map)*vec4(dir_light.color, 1.0);
+}
+vec3 shade_ambient_ibl()
+{
+    const float PI = 3.14159265;
+    const float roughness = sqrt(2.0/(SHININESS+2.0)); //blinn-phong exponent to GGX roughness
+    vec3 n = normal;
+    vec3 v = normalize(eye_pos-frag_pos);
+    vec3 irradiance = sh_irradiance[0]*0.282095
+    + sh_irradiance[1]*0.488603*n.y + sh_irradiance[2]*0.488603*n.z + sh_irradiance[3]*0.488603*n.x
+    + sh_irradiance[4]*1.092548*n.x*n.y + sh_irradiance[5]*1.092548*n.y*n.z
+    + sh_irradiance[6]*0.315392*(3.0*n.z*n.z-1.0) + sh_irradiance[7]*1.092548*n.x*n.z
+    + sh_irradiance[8]*0.546274*(n.x*n.x-n.y*n.y);
+    float n_dot_v = max(dot(n, v), 0.0);
+    vec2 split_sum = texture(brdf_lut, vec2(n_dot_v, roughness)).rg;
+    vec3 radiance = textureLod(prefiltered_specular, reflect(-v, n), roughness*prefiltered_max_level).rgb;
+    return vec3(diffuse_map)*max(irradiance, 0.0)/PI + radiance*vec3(spec_map)*(0.04*split_sum.x + split_sum.y);
+}
+//every light affecting the surface. window_depth is the surface's depth buffer value, used to find its light cluster.
+vec3 shade_lights(float window_depth)
+{
+    vec4 light_output = vec4(0, 0, 0, 1);
+#if NR_POINT_LIGHTS > 0
+    for (int i = 0; i < NR_POINT_LIGHTS; i++)
+        light_output += shade_point(point_lights[i]);
+#endif
+#if NR_DIRECTIONAL_LIGHTS > 0
+    for (int i = 0; i < NR_DIRECTIONAL_LIGHTS; i++)
+    {
+        vec4 directional = shade_directional(directional_lights[i]);
+#if SUN_SHADOWS
+        if (i == 0)
+            directional.rgb *= sun_shadow();
+#endif
+        light_output += directional;
+    }
+#endif
+#if NR_SPOT_LIGHTS > 0
+    for (int i = 0; i < NR_SPOT_LIGHTS; i++)
+    {
+        vec3 spot = shade_spot(spot_lights[i]);
+#if LOCAL_SHADOWS
+        if (spot_shadow_indices[i] > 0)
+            spot *= atlas_shadow(spot_shadow_indices[i] - 1);
+#endif
+        light_output += vec4(spot, 1);
+    }
+#endif
+#if CLUSTERED_LIGHTS
+    //only the lights binned into this fragment's cluster by cluster_cull.comp
+    float view_depth = z_near*z_far/(z_far - window_depth*(z_far - z_near));
+    uint cluster = cluster_index(gl_FragCoord.xy, view_depth);
+    uint cluster_count = min(cluster_light_counts[cluster], uint(MAX_LIGHTS_PER_CLUSTER));
+    for (uint i = 0; i < cluster_count; i++)
+        light_output += shade_clustered(clustered_lights[cluster_light_indices[cluster*MAX_LIGHTS_PER_CLUSTER + i]]);
+#endif
+#if HAS_AMBIENT_LIGHT
+    light_output += vec4(ambient_light, 1.0);
+#endif
+#if USE_IBL
+    light_output += vec4(shade_ambient_ibl(), 0.0);
+#endif
+    return light_output.rgb;
+}
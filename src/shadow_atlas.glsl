@@ -0,0 +1,39 @@
+//point and spot light shadows from the atlas of shadow_atlas.h. the including shader defines normal and frag_pos.
+//lights refer to their shadow by index + 1 of their first view, 0 means unshadowed.
+struct shadow_view
+{
+    mat4 view_projection;
+    vec4 atlas_rect;        //offset and size of the tile in atlas uv
+    vec4 position_texel;    //light position, world space texel size one unit away from the light in w
+};
+layout (std430, binding = 4) readonly buffer shadow_view_buffer {shadow_view shadow_views[];};
+layout (binding = 12) uniform sampler2DShadow shadow_atlas;
+
+//1 where the light of the view reaches the surface, 3x3 bilinear comparisons kept inside the tile
+float atlas_shadow(int view_index)
+{
+    shadow_view view = shadow_views[view_index];
+    float distance_to_light = length(frag_pos - view.position_texel.xyz);
+    vec3 offset_pos = frag_pos + normal*(1.5*view.position_texel.w*distance_to_light);
+    vec4 clip = view.view_projection*vec4(offset_pos, 1.0);
+    vec3 coord = clip.xyz/clip.w*0.5 + 0.5;
+    if (any(lessThan(coord, vec3(0.0))) || any(greaterThan(coord, vec3(1.0))))
+        return 1.0;
+    vec2 texel = 1.0/vec2(textureSize(shadow_atlas, 0));
+    vec2 tile_min = view.atlas_rect.xy + 0.5*texel;
+    vec2 tile_max = view.atlas_rect.xy + view.atlas_rect.zw - 0.5*texel;
+    vec2 uv = view.atlas_rect.xy + coord.xy*view.atlas_rect.zw;
+    float lit = 0.0;
+    for (int y = -1; y <= 1; y++)
+        for (int x = -1; x <= 1; x++)
+            lit += texture(shadow_atlas, vec3(clamp(uv + vec2(x, y)*texel, tile_min, tile_max), coord.z));
+    return lit/9.0;
+}
+//a point light's shadow : the cube face along the major axis of the direction from the light
+float point_shadow(int shadow_index, vec3 light_position)
+{
+    vec3 d = frag_pos - light_position;
+    vec3 a = abs(d);
+    int face = a.x >= a.y && a.x >= a.z ? (d.x > 0.0 ? 0 : 1) : (a.y >= a.z ? (d.y > 0.0 ? 2 : 3) : (d.z > 0.0 ? 4 : 5));
+    return atlas_shadow(shadow_index - 1 + face);
+}
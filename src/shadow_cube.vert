@@ -0,0 +1,10 @@
+#version 460 core
+//position only, in world space. src/shadow_cube.geom projects it into every cube face.
+layout (location = 0) in vec3 vertexPos;
+
+uniform mat4 model_transform;
+
+void main()
+{
+    gl_Position = model_transform*vec4(vertexPos, 1.0);
+}
@@ -0,0 +1,5 @@
+#version 460 core
+//depth only passes (shadow maps, the depth pre-pass) have no color to write
+void main()
+{
+}
@@ -0,0 +1,11 @@
+#version 460 core
+//depth only pass for shadow maps. reads nothing but the position, see cascaded_shadows.h
+layout (location = 0) in vec3 vertexPos;
+
+uniform mat4 model_transform;
+uniform mat4 light_view_projection;
+
+void main()
+{
+    gl_Position = light_view_projection*model_transform*vec4(vertexPos, 1.0);
+}
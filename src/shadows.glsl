@@ -0,0 +1,32 @@
+//sun shadows from the cascades of cascaded_shadows.h. the including shader defines normal and frag_pos (world space).
+#define SHADOW_CASCADES 4
+
+layout (binding = 13) uniform sampler2DArrayShadow sun_shadow_map;
+uniform mat4 sun_shadow_matrices[SHADOW_CASCADES];
+uniform float sun_texel_sizes[SHADOW_CASCADES];     //world space size of a shadow map texel
+
+//16 bilinear comparisons over a 4x4 texel footprint
+float filter_shadow(vec3 coord, int cascade)
+{
+    vec2 texel = 1.0/vec2(textureSize(sun_shadow_map, 0).xy);
+    float lit = 0.0;
+    for (float y = -1.5; y <= 1.5; y += 1.0)
+        for (float x = -1.5; x <= 1.5; x += 1.0)
+            lit += texture(sun_shadow_map, vec4(coord.xy + vec2(x, y)*texel, float(cascade), coord.z));
+    return lit/16.0;
+}
+//1 where the sun reaches the surface, 0 in full shadow
+float sun_shadow()
+{
+    //the first cascade whose map covers the surface, with room for the filter footprint, is the sharpest one
+    float border = 3.0/float(textureSize(sun_shadow_map, 0).x);
+    for (int i = 0; i < SHADOW_CASCADES; i++)
+    {
+        //pushing the lookup out along the normal by about a texel keeps surfaces from shadowing themselves
+        vec3 offset_pos = frag_pos + normal*(1.5*sun_texel_sizes[i]);
+        vec3 coord = (sun_shadow_matrices[i]*vec4(offset_pos, 1.0)).xyz*0.5 + 0.5;
+        if (all(greaterThan(coord.xy, vec2(border))) && all(lessThan(coord.xy, vec2(1.0 - border))) && coord.z <= 1.0)
+            return filter_shadow(coord, i);
+    }
+    return 1.0;
+}
@@ -0,0 +1,10 @@
+//weighted blended order independent transparency (McGuire and Bavoil 2013). every transparent fragment adds its
+//premultiplied color into the accumulation target, weighted so nearer and more opaque surfaces count for more, and
+//multiplies (1 - opacity) into the revealage target. oit_composite.frag divides the weighted sum back out, so the
+//result does not depend on the order the fragments arrive in. see transparency.h for the blend setup.
+vec4 oit_accumulation(vec3 color, float opacity, float view_depth)
+{
+    //equation 9 of the paper, for scenes spanning a few hundred units
+    const float weight = clamp(10.0/(1e-5 + pow(view_depth/5.0, 2.0) + pow(view_depth/200.0, 6.0)), 1e-2, 3e3);
+    return vec4(color*opacity, opacity)*opacity*weight;
+}
@@ -7,13 +7,19 @@ out vec3 vertex_color;
 out vec3 surface_normal;
 out vec3 frag_pos;
 out vec2 tex_coord;
+out vec4 current_clip;      //unjittered, for motion_vectors.glsl
+out vec4 previous_clip;
 
 layout (std140, binding = 0) uniform matrices
 {
     mat4 view_transform;    //0-->64
-    mat4 projection_transform; //64--128
+    mat4 projection_transform; //64--128, jittered while temporal anti-aliasing is on
+    mat4 view_projection;   //128--192, without the jitter
+    mat4 previous_view_projection; //192--256, last frame's without the jitter
 };
 uniform mat4 model_transform;
+uniform mat4 previous_model_transform;
+invariant gl_Position;  //matches depth_prepass.vert bit for bit, the main pass depth tests with GL_EQUAL
 
 void main()
 {
@@ -22,4 +28,6 @@ void main()
     frag_pos = vec3(model_transform*vec4(vertexPos, 1.0));
     tex_coord = vertex_tex_coord;
     gl_Position = projection_transform*view_transform*vec4(frag_pos, 1.0);
+    current_clip = view_projection*vec4(frag_pos, 1.0);
+    previous_clip = previous_view_projection*previous_model_transform*vec4(vertexPos, 1.0);
 }
\ No newline at end of file